@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gzinfo.h"
+
+// Recompression advice. Spans of the uncompressed data are kept from the
+// output of verify_gzip() as it goes by, then each is deflated with each
+// candidate setting and inflated back, in parallel, timing both on the
+// thread's own clock. The length isn't known until the end, so the spans are
+// taken at a stride that doubles whenever twice as many as wanted are held,
+// dropping every other one, and thinned to the number wanted at the end. They
+// are then evenly spread over the data, however long it is. Sizes are
+// projected to the whole file from the spans' ratio, so the setting that wins
+// on the spans is the one to try.
+
+typedef struct {
+    const char *name;
+    int level, strategy;
+    size_t block;                   // independent blocks of this size, or 0
+} setting;
+
+static const setting settings[] = {
+    {"level 1", 1, Z_DEFAULT_STRATEGY, 0},
+    {"level 6", 6, Z_DEFAULT_STRATEGY, 0},
+    {"level 9", 9, Z_DEFAULT_STRATEGY, 0},
+    {"filtered 6", 6, Z_FILTERED, 0},
+    {"rle", 6, Z_RLE, 0},
+    {"huffman only", 6, Z_HUFFMAN_ONLY, 0},
+    {"fixed 6", 6, Z_FIXED, 0},
+    {"bgzf 6", 6, Z_DEFAULT_STRATEGY, 65280},
+    {"bgzf 1", 1, Z_DEFAULT_STRATEGY, 65280},
+};
+#define SETTINGS (sizeof(settings) / sizeof(settings[0]))
+#define BGZF_WRAP 26                // BGZF header and trailer per block
+
+struct keep {
+    size_t want, size;              // spans wanted, and their length
+    uint64_t stride;                // distance between span starts
+    uint64_t at;                    // uncompressed offset of the next data
+    unsigned char **span;
+    size_t *fill;
+    size_t have;                    // spans started
+    int err;
+};
+
+static void keep_window(void *ctx, const unsigned char *data, size_t len) {
+    struct keep *k = ctx;
+    while (len && !k->err) {
+        uint64_t i = k->at / k->stride, off = k->at % k->stride;
+        if (off >= k->size) {
+            // Between spans.
+            uint64_t skip = k->stride - off < len ? k->stride - off : len;
+            k->at += skip;
+            data += skip;
+            len -= skip;
+            continue;
+        }
+        if (i == 2 * k->want) {
+            // Keep every other span, and double the stride.
+            for (size_t j = 0; j < k->want; j++) {
+                free(k->span[2 * j + 1]);
+                k->span[j] = k->span[2 * j];
+                k->fill[j] = k->fill[2 * j];
+            }
+            k->have = k->want;
+            k->stride *= 2;
+            continue;
+        }
+        if (i == k->have) {
+            k->span[i] = malloc(k->size);
+            if (k->span[i] == NULL) {
+                k->err = 1;
+                break;
+            }
+            k->fill[i] = 0;
+            k->have++;
+        }
+        size_t n = k->size - off < len ? k->size - off : len;
+        memcpy(k->span[i] + off, data, n);
+        k->fill[i] += n;
+        k->at += n;
+        data += n;
+        len -= n;
+    }
+}
+
+typedef struct {
+    uint64_t in, out;
+    double ctime, dtime;
+    int bad;
+} trial;
+
+struct bench {
+    struct keep *k;
+    trial *t;                       // SETTINGS for each span
+};
+
+// Deflate len bytes at p with s into a gzip stream at z. Return its length.
+static size_t squeeze(const setting *s, const unsigned char *p, size_t len,
+                      unsigned char *z, size_t room) {
+    z_stream strm = {0};
+    if (deflateInit2(&strm, s->level, Z_DEFLATED, 31, 8, s->strategy) != Z_OK)
+        return 0;
+    strm.next_in = (unsigned char *)p;
+    strm.avail_in = len;
+    strm.next_out = z;
+    strm.avail_out = room;
+    int ret = deflate(&strm, Z_FINISH);
+    size_t got = room - strm.avail_out;
+    deflateEnd(&strm);
+    return ret == Z_STREAM_END ? got : 0;
+}
+
+// Inflate the gzip stream z[0..zlen-1] to p, which must then hold len bytes.
+static int unsqueeze(const unsigned char *z, size_t zlen, unsigned char *p,
+                     size_t len) {
+    size_t got;
+    return gz_inflate_member(z, zlen, p, len, &got) == Z_OK && got == len ?
+           0 : -1;
+}
+
+static void bench_job(void *ctx, size_t job) {
+    struct bench *b = ctx;
+    size_t i = job / SETTINGS;
+    const setting *s = settings + job % SETTINGS;
+    trial *t = b->t + job;
+    const unsigned char *p = b->k->span[i];
+    size_t len = b->k->fill[i];
+    size_t step = s->block ? s->block : len ? len : 1;
+    size_t room = deflateBound(NULL, step) + 64;
+    unsigned char *z = malloc(room * ((len + step - 1) / step + 1));
+    unsigned char *back = malloc(len ? len : 1);
+    size_t *zlen = malloc(((len + step - 1) / step + 1) * sizeof(size_t));
+    t->in = len;
+    if (z == NULL || back == NULL || zlen == NULL) {
+        t->bad = 1;
+        free(z);
+        free(back);
+        free(zlen);
+        return;
+    }
+
+    // Each block is deflated on its own, as BGZF does.
+    double start = cpu_now();
+    size_t nz = 0, zat = 0;
+    for (size_t at = 0; at < len; at += step, nz++) {
+        size_t n = len - at < step ? len - at : step;
+        zlen[nz] = squeeze(s, p + at, n, z + zat, room);
+        if (zlen[nz] == 0)
+            t->bad = 1;
+        zat += zlen[nz];
+        t->out += zlen[nz] + (s->block ? BGZF_WRAP - 18 : 0);
+    }
+    t->ctime = cpu_now() - start;
+
+    start = cpu_now();
+    zat = 0;
+    for (size_t at = 0, j = 0; at < len && !t->bad; at += step, j++) {
+        size_t n = len - at < step ? len - at : step;
+        if (unsqueeze(z + zat, zlen[j], back + at, n) < 0)
+            t->bad = 1;
+        zat += zlen[j];
+    }
+    t->dtime = cpu_now() - start;
+    if (!t->bad && memcmp(back, p, len))
+        t->bad = 1;
+    free(z);
+    free(back);
+    free(zlen);
+}
+
+int cmd_advise(int argc, char **argv) {
+    int threads = 0, opt;
+    size_t want = 16, size = 1 << 20;
+    while ((opt = getopt(argc, argv, "n:b:j:")) != -1)
+        switch (opt) {
+        case 'n':
+            want = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1 || want == 0 || size == 0) {
+        fprintf(stderr, "usage: gzinfo advise [-n samples] [-b bytes] "
+                        "[-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+
+    // Decode the file once, keeping the spans.
+    struct keep k = {want, size, size, 0, calloc(2 * want, sizeof(char *)),
+                     calloc(2 * want, sizeof(size_t)), 0, 0};
+    verify_hooks hooks = {keep_window, NULL, &k};
+    int ret = k.span == NULL || k.fill == NULL ? Z_MEM_ERROR :
+              verify_gzip(name, &hooks);
+    if (ret == Z_OK && k.err)
+        ret = Z_MEM_ERROR;
+    if (ret != Z_OK) {
+        if (ret == Z_MEM_ERROR)
+            fprintf(stderr, "gzinfo: out of memory\n");
+        for (size_t i = 0; k.span != NULL && i < k.have; i++)
+            free(k.span[i]);
+        free(k.span);
+        free(k.fill);
+        return 1;
+    }
+    print_gzip_info();
+
+    // Between want and twice that many spans were kept. Thin them to want,
+    // still spread evenly.
+    if (k.have > k.want) {
+        size_t n = k.have, next = 0;
+        for (size_t i = 0; i < n; i++)
+            if (next < k.want && i == next * n / k.want) {
+                k.span[next] = k.span[i];
+                k.fill[next++] = k.fill[i];
+            }
+            else
+                free(k.span[i]);
+        k.have = k.want;
+    }
+
+    struct bench b = {&k, calloc(k.have * SETTINGS + 1, sizeof(trial))};
+    if (b.t == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        ret = 1;
+    }
+    else
+        pool_run(threads, k.have * SETTINGS, bench_job, &b);
+
+    uint64_t sampled = 0;
+    for (size_t i = 0; i < k.have; i++)
+        sampled += k.fill[i];
+    double now = uncompressed_size ? (double)compressed_size / uncompressed_size :
+                                     1;
+    printf("\nSamples: %zu of %s", k.have, humanSize(size));
+    printf(" (%.1f%% of the data)\n", uncompressed_size ?
+           100.0 * sampled / uncompressed_size : 0.0);
+    printf("%-14s %8s %14s %8s %13s %12s\n", "Setting", "Ratio",
+           "Projected", "Change", "Compress MB/s", "Decode MB/s");
+    printf("%-14s %7.2f%% %14s %8s %13s %12s\n", "this file", 100 * now,
+           humanSize(compressed_size), "", "", "");
+    for (size_t s = 0; b.t != NULL && s < SETTINGS; s++) {
+        trial sum = {0, 0, 0, 0, 0};
+        for (size_t i = 0; i < k.have; i++) {
+            const trial *t = b.t + i * SETTINGS + s;
+            sum.in += t->in;
+            sum.out += t->out;
+            sum.ctime += t->ctime;
+            sum.dtime += t->dtime;
+            sum.bad |= t->bad;
+        }
+        if (sum.bad) {
+            fprintf(stderr, "gzinfo: %s did not round-trip\n", settings[s].name);
+            ret = 1;
+            continue;
+        }
+        double ratio = sum.in ? (double)sum.out / sum.in : 1;
+        double proj = ratio * uncompressed_size;
+        printf("%-14s %7.2f%% %14s %+7.1f%% %13.1f %12.1f\n", settings[s].name,
+               100 * ratio, humanSize(proj),
+               compressed_size ? 100 * (proj - compressed_size) /
+                                 compressed_size : 0.0,
+               sum.ctime > 0 ? sum.in / sum.ctime / 1e6 : 0.0,
+               sum.dtime > 0 ? sum.in / sum.dtime / 1e6 : 0.0);
+    }
+
+    for (size_t i = 0; i < k.have; i++)
+        free(k.span[i]);
+    free(k.span);
+    free(k.fill);
+    free(b.t);
+    return ret != 0;
+}
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "gzinfo.h"
+
+// Carving of gzip and zlib streams out of arbitrary data. The file is split
+// into segments scanned in parallel. A vector scan picks out bytes that can
+// start a stream -- 0x1f for gzip, or a zlib CMF byte with method 8 and a
+// window of at most 32K -- and detect_mode() applies the full signature
+// check. Each candidate is then trial-inflated to its end, which for a real
+// stream includes the CRC-32 or Adler-32 check.
+
+#define SEGMENT (4U << 20)
+
+typedef struct {
+    uint64_t off, len, out;
+    int mode;
+} carved;
+
+struct carve {
+    const unsigned char *in;
+    size_t len;
+    int want;                   // GZIP, ZLIB, or 0 for both
+    pthread_mutex_t lock;
+    carved *found;
+    size_t have, size;
+    uint64_t tried;
+};
+
+// Inflate the stream at p[0..n-1] to its end, discarding the output. Return
+// true if it is complete and checks out, with its lengths in *c.
+static int trial(z_stream *strm, unsigned char *win, const unsigned char *p,
+                 size_t n, carved *c) {
+    if (inflateReset2(strm, c->mode) != Z_OK)
+        return 0;
+    int ret;
+    uint64_t out = 0;
+    strm->next_in = (unsigned char *)p;
+    strm->avail_in = 0;
+    do {
+        if (strm->avail_in == 0) {
+            size_t left = n - (strm->next_in - p);
+            if (left == 0)
+                return 0;
+            strm->avail_in = left < (1U << 30) ? left : (1U << 30);
+        }
+        strm->next_out = win;
+        strm->avail_out = WINSIZE;
+        ret = inflate(strm, Z_NO_FLUSH);
+        out += WINSIZE - strm->avail_out;
+    } while (ret == Z_OK);
+    if (ret != Z_STREAM_END)
+        return 0;
+    c->len = strm->next_in - p;
+    c->out = out;
+    return 1;
+}
+
+static void carve_job(void *ctx, size_t i) {
+    struct carve *c = ctx;
+    uint64_t from = (uint64_t)i * SEGMENT, to = from + SEGMENT;
+    if (to > c->len)
+        to = c->len;
+    z_stream strm = {0};
+    unsigned char *win = malloc(WINSIZE);
+    if (win == NULL || inflateInit2(&strm, GZIP) != Z_OK) {
+        free(win);
+        return;
+    }
+
+    const unsigned char *in = c->in;
+    uint64_t tried = 0, at = from;
+    while (at < to) {
+        // Find the next byte that could start a stream.
+#ifdef __SSE2__
+        const __m128i magic = _mm_set1_epi8(0x1f), mask = _mm_set1_epi8(0x8f),
+                      cm = _mm_set1_epi8(0x08);
+        while (to - at >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + at));
+            __m128i hit = _mm_or_si128(
+                _mm_cmpeq_epi8(v, magic),
+                _mm_cmpeq_epi8(_mm_and_si128(v, mask), cm));
+            unsigned bits = _mm_movemask_epi8(hit);
+            if (bits) {
+                at += __builtin_ctz(bits);
+                break;
+            }
+            at += 16;
+        }
+#endif
+        while (at < to && in[at] != 0x1f && (in[at] & 0x8f) != 0x08)
+            at++;
+        if (at >= to)
+            break;
+
+        carved k = {at, 0, 0, 0};
+        k.mode = detect_mode(in + at, c->len - at);
+        if (k.mode != PLAIN && (c->want == 0 || c->want == k.mode)) {
+            tried++;
+            if (trial(&strm, win, in + at, c->len - at, &k)) {
+                pthread_mutex_lock(&c->lock);
+                if (c->have == c->size) {
+                    size_t size = c->size ? c->size << 1 : 64;
+                    carved *more = realloc(c->found, size * sizeof(carved));
+                    if (more != NULL) {
+                        c->found = more;
+                        c->size = size;
+                    }
+                }
+                if (c->have < c->size)
+                    c->found[c->have++] = k;
+                pthread_mutex_unlock(&c->lock);
+                at += k.len;        // go on after it, not inside it
+                continue;
+            }
+        }
+        at++;
+    }
+    inflateEnd(&strm);
+    free(win);
+    pthread_mutex_lock(&c->lock);
+    c->tried += tried;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static int by_offset(const void *a, const void *b) {
+    uint64_t x = ((const carved *)a)->off, y = ((const carved *)b)->off;
+    return x < y ? -1 : x > y;
+}
+
+int cmd_carve(int argc, char **argv) {
+    int threads = 0, want = 0, opt;
+    while ((opt = getopt(argc, argv, "gzj:")) != -1)
+        switch (opt) {
+        case 'g':
+            want = GZIP;
+            break;
+        case 'z':
+            want = ZLIB;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo carve [-g | -z] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    struct carve c = {NULL, st.st_size, want, PTHREAD_MUTEX_INITIALIZER,
+                      NULL, 0, 0, 0};
+    if (c.len) {
+        c.in = mmap(NULL, c.len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (c.in == MAP_FAILED) {
+            fprintf(stderr, "gzinfo: could not map %s\n", name);
+            close(fd);
+            return 1;
+        }
+    }
+    close(fd);
+
+    pool_run(threads, (c.len + SEGMENT - 1) / SEGMENT, carve_job, &c);
+
+    // A stream that runs past its segment's end can contain candidates found
+    // by the next segment: keep only the outermost streams.
+    qsort(c.found, c.have, sizeof(carved), by_offset);
+    uint64_t end = 0, zin = 0, zout = 0;
+    size_t kept = 0;
+    printf("%-16s %-14s %-5s %s\n", "offset", "length", "mode", "uncompressed");
+    for (size_t i = 0; i < c.have; i++) {
+        carved *k = c.found + i;
+        if (k->off < end)
+            continue;
+        printf("%-16llu %-14llu %-5s %llu\n", (unsigned long long)k->off,
+               (unsigned long long)k->len, k->mode == GZIP ? "gzip" : "zlib",
+               (unsigned long long)k->out);
+        end = k->off + k->len;
+        zin += k->len;
+        zout += k->out;
+        kept++;
+    }
+    printf("Streams: %zu (%llu candidates tried)\n", kept,
+           (unsigned long long)c.tried);
+    printf("Compressed: %s\n", humanSize(zin));
+    printf("Uncompressed: %s\n", humanSize(zout));
+
+    free(c.found);
+    pthread_mutex_destroy(&c.lock);
+    if (c.len)
+        munmap((void *)c.in, c.len);
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gzinfo.h"
+
+// Content-defined chunking of the uncompressed stream, FastCDC style: a gear
+// hash rolls over the output windows of verify_gzip() and a chunk ends where
+// its top bits are all zero. Normalized chunking uses a harder mask before
+// the average size and an easier one after, which tightens the size spread.
+
+#define TOPBITS(b) (~0ULL << (64 - (b)))
+
+static uint64_t gear[256];
+
+static void gear_init(void) {
+    // splitmix64 from a fixed seed, so chunk boundaries are reproducible.
+    uint64_t x = 0x2545f4914f6cdd1dULL;
+    for (int i = 0; i < 256; i++)
+        gear[i] = splitmix(&x);
+}
+
+// 64-bit fingerprint of p[0..n-1], a word at a time. Longer data can be
+// hashed piecewise by passing the previous result as the seed.
+uint64_t hash64(const unsigned char *p, size_t n, uint64_t seed) {
+    uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL), w;
+    for (; n >= 8; p += 8, n -= 8) {
+        memcpy(&w, p, 8);
+        h ^= w * 0x87c37b91114253d5ULL;
+        h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937fULL;
+    }
+    w = 0;
+    memcpy(&w, p, n);
+    h ^= w * 0x87c37b91114253d5ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+typedef struct {
+    uint64_t fp;
+    uint32_t len;
+} cdc_chunk;
+
+struct cdc {
+    size_t min, avg, max;
+    uint64_t mask_s, mask_l;
+    uint64_t h;                 // gear hash of the current chunk
+    size_t len;                 // bytes in the current chunk
+    unsigned char *data;        // current chunk contents
+    uint64_t off;               // uncompressed offset of the current chunk
+    cdc_chunk *list;            // chunks of the current file
+    size_t have, size;
+    const char *name;
+    int verbose;
+    int oom;                    // a chunk could not be recorded
+};
+
+static void cdc_emit(struct cdc *c) {
+    if (c->have == c->size) {
+        size_t size = c->size ? c->size << 1 : 1024;
+        cdc_chunk *list = realloc(c->list, size * sizeof(cdc_chunk));
+        if (list == NULL) {
+            c->oom = 1;
+            return;
+        }
+        c->list = list;
+        c->size = size;
+    }
+    cdc_chunk *k = c->list + c->have++;
+    k->fp = hash64(c->data, c->len, 0);
+    k->len = c->len;
+    if (c->verbose)
+        printf("%s\t%llu\t%zu\t%016llx\n", c->name, (unsigned long long)c->off,
+               c->len, (unsigned long long)k->fp);
+    c->off += c->len;
+    c->len = 0;
+    c->h = 0;
+}
+
+static void cdc_window(void *ctx, const unsigned char *p, size_t n) {
+    struct cdc *c = ctx;
+    while (n) {
+        size_t lim = c->max - c->len, i = 0, len = c->len;
+        uint64_t h = c->h;
+        int cut = 0;
+        if (lim > n)
+            lim = n;
+
+        // A chunk can't end in its first min bytes, so they aren't hashed.
+        if (len < c->min) {
+            i = c->min - len < lim ? c->min - len : lim;
+            len += i;
+        }
+        for (; i < lim; i++) {
+            h = (h << 1) + gear[p[i]];
+            len++;
+            if ((h & (len < c->avg ? c->mask_s : c->mask_l)) == 0) {
+                i++;
+                cut = 1;
+                break;
+            }
+        }
+
+        memcpy(c->data + c->len, p, i);
+        c->len = len;
+        c->h = h;
+        if (cut || len == c->max)
+            cdc_emit(c);
+        p += i;
+        n -= i;
+    }
+}
+
+// Open-addressed set of chunk fingerprints seen so far in the batch.
+struct seen {
+    uint64_t *fp;               // 0 marks an empty slot
+    size_t size, used;
+};
+
+// Add fp to the set. Return 1 if it was new, 0 if already present, or -1 if
+// out of memory.
+static int seen_add(struct seen *s, uint64_t fp) {
+    if (fp == 0)
+        fp = 1;
+    if (2 * (s->used + 1) > s->size) {
+        size_t size = s->size ? s->size << 1 : 1 << 16;
+        uint64_t *tab = calloc(size, sizeof(uint64_t));
+        if (tab == NULL)
+            return -1;
+        for (size_t i = 0; i < s->size; i++)
+            if (s->fp[i]) {
+                size_t j = s->fp[i] & (size - 1);
+                while (tab[j])
+                    j = (j + 1) & (size - 1);
+                tab[j] = s->fp[i];
+            }
+        free(s->fp);
+        s->fp = tab;
+        s->size = size;
+    }
+    size_t j = fp & (s->size - 1);
+    while (s->fp[j]) {
+        if (s->fp[j] == fp)
+            return 0;
+        j = (j + 1) & (s->size - 1);
+    }
+    s->fp[j] = fp;
+    s->used++;
+    return 1;
+}
+
+int cmd_cdc(int argc, char **argv) {
+    size_t avg = 8192;
+    int verbose = 0, opt;
+    while ((opt = getopt(argc, argv, "a:v")) != -1)
+        switch (opt) {
+        case 'a':
+            avg = strtoul(optarg, NULL, 0);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        default:
+            optind = argc + 1;
+        }
+    if (optind >= argc || avg < 256 || avg > (1 << 20) || (avg & (avg - 1))) {
+        fprintf(stderr, "usage: gzinfo cdc [-a avg] [-v] file...\n"
+                        "       avg is a power of two from 256 to 1M\n");
+        return 1;
+    }
+
+    int bits = 0;
+    while ((1UL << bits) < avg)
+        bits++;
+    struct cdc c = {0};
+    c.avg = avg;
+    c.min = avg / 4;
+    c.max = avg * 8;
+    c.mask_s = TOPBITS(bits + 2);
+    c.mask_l = TOPBITS(bits - 2);
+    c.verbose = verbose;
+    c.data = malloc(c.max);
+    struct seen seen = {0};
+    if (c.data == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        return 1;
+    }
+    gear_init();
+
+    verify_hooks hooks = {cdc_window, NULL, &c};
+    uint64_t total = 0, unique = 0, chunks = 0;
+    int status = 0;
+    printf("%-40s %14s %10s %14s %7s\n", "file", "bytes", "chunks", "new bytes",
+           "new");
+    for (int i = optind; i < argc; i++) {
+        c.name = argv[i];
+        c.have = c.len = 0;
+        c.h = c.off = 0;
+        if (verify_gzip(argv[i], &hooks) != Z_OK) {
+            status = 1;
+            continue;
+        }
+        if (c.len)
+            cdc_emit(&c);
+        if (c.oom) {
+            fprintf(stderr, "gzinfo: out of memory\n");
+            status = 1;
+            break;
+        }
+
+        // Bytes are counted as new the first time their chunk is seen in the
+        // batch, in command line order.
+        uint64_t fresh = 0;
+        for (size_t k = 0; k < c.have; k++) {
+            int ret = seen_add(&seen, c.list[k].fp);
+            if (ret < 0) {
+                fprintf(stderr, "gzinfo: out of memory\n");
+                status = 1;
+                break;
+            }
+            if (ret)
+                fresh += c.list[k].len;
+        }
+        printf("%-40s %14llu %10zu %14llu %6.1f%%\n", argv[i],
+               (unsigned long long)uncompressed_size, c.have,
+               (unsigned long long)fresh,
+               uncompressed_size ? 100.0 * fresh / uncompressed_size : 0.0);
+        total += uncompressed_size;
+        unique += fresh;
+        chunks += c.have;
+    }
+
+    printf("Total Uncompressed: %s\n", humanSize(total));
+    printf("Unique After Dedup: %s\n", humanSize(unique));
+    printf("Chunks: %llu (average %s)\n", (unsigned long long)chunks,
+           humanSize(chunks ? total / chunks : 0));
+    printf("Dedup Ratio: %.3f\n", unique ? (double)total / unique : 1.0);
+    free(seen.fp);
+    free(c.list);
+    free(c.data);
+    return status;
+}
@@ -0,0 +1,429 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Verification of a file that arrives in pieces, in any order, as from
+// parallel ranged downloads. Each piece is copied into place, and every gzip
+// member header signature that it completes starts a candidate member there.
+// A candidate is inflated as far as the data present after it runs, and
+// picks up again when more arrives, so a member is checked against its
+// trailer as soon as its last byte is in, however it was split. Most false
+// signatures inside compressed data fail within a few bytes. The work is done
+// by the threads adding the pieces, each taking any candidate that can make
+// progress. Once everything is in, the verified members must chain from the
+// start of the file to its end. A zlib or raw deflate stream has one real
+// candidate, at the start. Until the first piece arrives the mode isn't
+// known, so gzip signatures seen before then start candidates too, which
+// fail or are never chained to.
+
+typedef struct {
+    uint64_t start, at;             // where it starts, and the next byte
+    uint64_t out;
+    z_stream strm;
+    int busy;                       // being inflated by some thread
+    int done;                       // Z_STREAM_END, or an error
+    size_t slot;                    // its place in the active list
+} candidate;
+
+typedef struct {
+    uint64_t start, end, out;
+} piece;
+
+struct gz_chunks {
+    pthread_mutex_t lock;
+    unsigned char *data;
+    uint64_t size;
+    uint64_t (*have)[2];            // the runs that have arrived, in order
+    size_t runs, runs_size;
+    candidate **live;               // candidates that may yet end
+    size_t nlive, live_size;
+    piece *members;                 // verified members, in no order
+    size_t nmem, mem_size;
+    piece *failed;                  // failed candidates: start, where, 0
+    size_t nfail, fail_size;
+    int mode;
+    int err;                        // out of memory
+};
+
+// Grow *list to hold one more than have of size bytes each. Return 0 or -1.
+static int more(void *list, size_t *size, size_t have, size_t each) {
+    void **p = list;
+    if (have < *size)
+        return 0;
+    size_t want = *size ? 2 * *size : 16;
+    void *grown = realloc(*p, want * each);
+    if (grown == NULL)
+        return -1;
+    *p = grown;
+    *size = want;
+    return 0;
+}
+
+// Return the end of the run of arrived data that off is in, or off if none.
+static uint64_t avail(const gz_chunks *c, uint64_t off) {
+    size_t lo = 0, hi = c->runs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (c->have[mid][1] <= off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < c->runs && c->have[lo][0] <= off ? c->have[lo][1] : off;
+}
+
+// Record off..end as arrived, merging it with its neighbours. Return the
+// start of the merged run, or -1 if it overlaps data already there.
+static int64_t arrive(gz_chunks *c, uint64_t off, uint64_t end) {
+    size_t i = 0;
+    while (i < c->runs && c->have[i][1] < off)
+        i++;
+    if (i < c->runs && c->have[i][0] < end && c->have[i][1] > off)
+        return -1;
+    if (i < c->runs && c->have[i][1] == off) {
+        c->have[i][1] = end;
+        if (i + 1 < c->runs && c->have[i + 1][0] == end) {
+            c->have[i][1] = c->have[i + 1][1];
+            memmove(c->have + i + 1, c->have + i + 2,
+                    (c->runs - i - 2) * sizeof(c->have[0]));
+            c->runs--;
+        }
+        return c->have[i][0];
+    }
+    if (i < c->runs && c->have[i][0] == end) {
+        c->have[i][0] = off;
+        return off;
+    }
+    if (more(&c->have, &c->runs_size, c->runs, sizeof(c->have[0])) < 0)
+        return -2;
+    memmove(c->have + i + 1, c->have + i, (c->runs - i) * sizeof(c->have[0]));
+    c->have[i][0] = off;
+    c->have[i][1] = end;
+    c->runs++;
+    return off;
+}
+
+static void add_candidate(gz_chunks *c, uint64_t start, int mode) {
+    candidate *k = calloc(1, sizeof(candidate));
+    if (k == NULL || more(&c->live, &c->live_size, c->nlive,
+                          sizeof(candidate *)) < 0 ||
+        inflateInit2(&k->strm, mode) != Z_OK) {
+        free(k);
+        c->err = 1;
+        return;
+    }
+    k->start = k->at = start;
+    k->slot = c->nlive;
+    c->live[c->nlive++] = k;
+}
+
+static void drop_candidate(gz_chunks *c, candidate *k) {
+    c->live[k->slot] = c->live[--c->nlive];
+    c->live[k->slot]->slot = k->slot;
+    inflateEnd(&k->strm);
+    free(k);
+}
+
+// Inflate k over the data from k->at to end, without the lock.
+static void advance(gz_chunks *c, candidate *k, uint64_t end) {
+    unsigned char out[WINSIZE];
+    int ret = Z_OK;
+    while (ret == Z_OK && k->at < end) {
+        uint64_t n = end - k->at < UINT32_MAX ? end - k->at : UINT32_MAX;
+        k->strm.next_in = c->data + k->at;
+        k->strm.avail_in = n;
+        do {
+            k->strm.next_out = out;
+            k->strm.avail_out = sizeof(out);
+            ret = inflate(&k->strm, Z_NO_FLUSH);
+            k->out += sizeof(out) - k->strm.avail_out;
+        } while (ret == Z_OK && (k->strm.avail_in || k->strm.avail_out == 0));
+        k->at += n - k->strm.avail_in;
+        if (ret == Z_BUF_ERROR && k->strm.avail_in == 0)
+            ret = Z_OK;                 // it needs more than has arrived
+    }
+    if (ret != Z_OK)
+        k->done = ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
+}
+
+// Run candidates that can make progress until there are none. Called and
+// returns with the lock held.
+static void work(gz_chunks *c) {
+    for (;;) {
+        candidate *k = NULL;
+        uint64_t end = 0;
+        for (size_t i = 0; i < c->nlive && k == NULL; i++)
+            if (!c->live[i]->busy &&
+                (end = avail(c, c->live[i]->at)) > c->live[i]->at)
+                k = c->live[i];
+        if (k == NULL)
+            return;
+        k->busy = 1;
+        pthread_mutex_unlock(&c->lock);
+        advance(c, k, end);
+        pthread_mutex_lock(&c->lock);
+        k->busy = 0;
+        if (k->done == Z_STREAM_END) {
+            if (more(&c->members, &c->mem_size, c->nmem, sizeof(piece)) < 0)
+                c->err = 1;
+            else
+                c->members[c->nmem++] = (piece){k->start, k->at, k->out};
+            drop_candidate(c, k);
+        }
+        else if (k->done) {
+            if (more(&c->failed, &c->fail_size, c->nfail, sizeof(piece)) < 0)
+                c->err = 1;
+            else
+                c->failed[c->nfail++] = (piece){k->start, k->at, 0};
+            drop_candidate(c, k);
+        }
+    }
+}
+
+// Start verifying a file of size bytes. Return NULL if out of memory.
+gz_chunks *gz_chunks_open(uint64_t size) {
+    gz_chunks *c = calloc(1, sizeof(gz_chunks));
+    if (c == NULL || (c->data = malloc(size ? size : 1)) == NULL) {
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    c->size = size;
+    return c;
+}
+
+// Add the len bytes at off, and verify what that makes possible. Any number
+// of threads may add pieces at once. Return 0, or -1 if the piece is outside
+// the file or overlaps one already added.
+int gz_chunks_add(gz_chunks *c, uint64_t off, const void *data, size_t len) {
+    if (off > c->size || len > c->size - off)
+        return -1;
+    if (len == 0)
+        return 0;
+    pthread_mutex_lock(&c->lock);
+    int64_t run = arrive(c, off, off + len);
+    if (run < 0) {
+        c->err |= run == -2;
+        pthread_mutex_unlock(&c->lock);
+        return -1;
+    }
+
+    // Copied with the lock held, as any candidate still inflating without it
+    // took its end before this was recorded, and so doesn't read this part.
+    memcpy(c->data + off, data, len);
+    uint64_t end = avail(c, off);
+    const unsigned char *p = c->data;
+    if (off == 0) {
+        c->mode = (p[0] & 0xf) == 8 ? ZLIB : p[0] == 0x1f ? GZIP : RAW;
+        add_candidate(c, 0, c->mode);
+    }
+
+    // Look for member headers at the places where this completes the
+    // signature: those within two bytes before it, and in it.
+    uint64_t from = off >= 2 && off - 2 >= (uint64_t)run ? off - 2 : (uint64_t)run;
+    int gzip = c->mode == 0 || c->mode == GZIP;
+    for (uint64_t i = from ? from : 1; gzip && i + 3 <= end && i < off + len;
+         i++) {
+        const unsigned char *q = memchr(p + i, 0x1f, off + len - i);
+        if (q == NULL)
+            break;
+        i = q - p;
+        if (i + 3 <= end && i && q[1] == 0x8b && q[2] == 8 &&
+            (i + 3 == end || (q[3] & 0xe0) == 0))
+            add_candidate(c, i, GZIP);
+    }
+    work(c);
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+}
+
+static int by_start(const void *a, const void *b) {
+    uint64_t x = ((const piece *)a)->start, y = ((const piece *)b)->start;
+    return x < y ? -1 : x > y;
+}
+
+// Once the pieces are in, set *members and *out for the verified members that
+// chain from the start. Return 0 if they cover the whole file, 1 if pieces
+// are still missing, or -1 if the data is bad from *bad on.
+int gz_chunks_result(gz_chunks *c, uint64_t *members, uint64_t *out,
+                     uint64_t *bad) {
+    pthread_mutex_lock(&c->lock);
+    *members = *out = *bad = 0;
+    int missing = c->size && avail(c, 0) < c->size;
+    qsort(c->members, c->nmem, sizeof(piece), by_start);
+    qsort(c->failed, c->nfail, sizeof(piece), by_start);
+    uint64_t at = 0;
+    size_t i = 0;
+    while (at < c->size) {
+        while (i < c->nmem && c->members[i].start < at)
+            i++;
+        if (i == c->nmem || c->members[i].start != at)
+            break;
+        at = c->members[i].end;
+        *out += c->members[i].out;
+        (*members)++;
+    }
+    int ret = 0;
+    if (c->err) {
+        *bad = at;
+        ret = -1;
+    }
+    else if (at < c->size && !missing) {
+        // Say where the member that should start there went wrong.
+        *bad = at;
+        for (size_t k = 0; k < c->nfail; k++)
+            if (c->failed[k].start == at)
+                *bad = c->failed[k].end;
+        ret = -1;
+    }
+    else if (at < c->size || c->size == 0)
+        ret = c->size == 0 ? -1 : 1;
+    pthread_mutex_unlock(&c->lock);
+    return ret;
+}
+
+void gz_chunks_close(gz_chunks *c) {
+    if (c == NULL)
+        return;
+    while (c->nlive)
+        drop_candidate(c, c->live[0]);
+    free(c->live);
+    free(c->have);
+    free(c->members);
+    free(c->failed);
+    free(c->data);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+// Stand in for a parallel download: fetch the file in pieces, in a shuffled
+// order, from several threads, each adding what it fetched.
+
+struct fetch {
+    gz_chunks *c;
+    int fd;
+    uint64_t size, chunk;
+    uint64_t *order;
+    unsigned delay;                 // microseconds per piece
+    double start, last;             // when the last piece was fetched
+    pthread_mutex_t lock;
+    int err;
+};
+
+static void fetch_job(void *ctx, size_t i) {
+    struct fetch *f = ctx;
+    uint64_t off = f->order[i] * f->chunk;
+    size_t len = f->size - off < f->chunk ? f->size - off : f->chunk;
+    unsigned char *buf = malloc(len);
+    if (f->delay) {
+        struct timespec t = {f->delay / 1000000, f->delay % 1000000 * 1000};
+        nanosleep(&t, NULL);
+    }
+    if (buf == NULL || pread_full(f->fd, buf, len, off) < 0) {
+        f->err = 1;
+        free(buf);
+        return;
+    }
+    pthread_mutex_lock(&f->lock);
+    f->last = wall_now();
+    pthread_mutex_unlock(&f->lock);
+    if (gz_chunks_add(f->c, off, buf, len) < 0)
+        f->err = 1;
+    free(buf);
+}
+
+int cmd_chunks(int argc, char **argv) {
+    int threads = 0, opt;
+    uint64_t chunk = 1 << 20, seed = 1;
+    unsigned delay = 0;
+    while ((opt = getopt(argc, argv, "c:j:s:d:")) != -1)
+        switch (opt) {
+        case 'c':
+            chunk = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'd':
+            delay = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1 || chunk == 0) {
+        fprintf(stderr, "usage: gzinfo chunks [-c chunk] [-j threads] "
+                        "[-s seed] [-d delay] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+    struct stat st;
+    int fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    struct fetch f = {gz_chunks_open(st.st_size), fd, st.st_size, chunk, NULL,
+                      delay, 0, 0, PTHREAD_MUTEX_INITIALIZER, 0};
+    size_t n = (f.size + chunk - 1) / chunk;
+    f.order = malloc((n ? n : 1) * sizeof(uint64_t));
+    if (f.c == NULL || f.order == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        gz_chunks_close(f.c);
+        free(f.order);
+        close(fd);
+        return 1;
+    }
+
+    // Fisher-Yates, for a reproducible arrival order.
+    uint64_t x = seed;
+    for (size_t i = 0; i < n; i++)
+        f.order[i] = i;
+    for (size_t i = n; i > 1; i--) {
+        size_t j = splitmix(&x) % i;
+        uint64_t t = f.order[i - 1];
+        f.order[i - 1] = f.order[j];
+        f.order[j] = t;
+    }
+
+    f.start = wall_now();
+    pool_run(threads, n, fetch_job, &f);
+    double end = wall_now();
+    close(fd);
+
+    uint64_t members, out, bad;
+    int ret = gz_chunks_result(f.c, &members, &out, &bad);
+    printf("Pieces: %zu of %s, in shuffled order (seed %llu)\n", n,
+           humanSize(chunk), (unsigned long long)seed);
+    printf("Last Piece In: %.3f s\n", f.last - f.start);
+    printf("Verified: %.3f s (%.3f s after the last piece)\n", end - f.start,
+           end - f.last);
+    if (f.err || ret == 1) {
+        fprintf(stderr, "gzinfo: could not read all of %s\n", name);
+        ret = 1;
+    }
+    else if (ret < 0) {
+        fprintf(stderr, "gzinfo: compressed data error at %llu in %s\n",
+                (unsigned long long)bad, name);
+        ret = 1;
+    }
+    else {
+        printf("Number of Members: %llu\n", (unsigned long long)members);
+        printf("Uncompressed Size: %s\n", humanSize(out));
+    }
+    gz_chunks_close(f.c);
+    free(f.order);
+    pthread_mutex_destroy(&f.lock);
+    return ret;
+}
@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "gzinfo.h"
+
+// Return the index of the first byte at which a[] and b[] differ, or n if
+// they are equal.
+static size_t mismatch(const unsigned char *a, const unsigned char *b,
+                       size_t n) {
+    size_t i = 0;
+
+    // Skip over equal stretches with the library memcmp(), which is already
+    // vectorized, then pin down the difference within the one that failed.
+    while (n - i >= 4096 && memcmp(a + i, b + i, 4096) == 0)
+        i += 4096;
+#ifdef __SSE2__
+    for (; n - i >= 16; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned ne = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffff;
+        if (ne)
+            return i + __builtin_ctz(ne);
+    }
+#endif
+    for (; i < n; i++)
+        if (a[i] != b[i])
+            break;
+    return i;
+}
+
+// Compare the uncompressed contents of a and b by decompressing both in
+// lockstep. Return 0 if equal, 1 if they differ with *off set to the first
+// differing uncompressed offset (the shorter length if one is a prefix of
+// the other), or a negative zlib error.
+int cmp_serial(const char *a, const char *b, uint64_t *off) {
+    gz_scan *sa = malloc(sizeof(gz_scan));
+    gz_scan *sb = malloc(sizeof(gz_scan));
+    if (sa == NULL || sb == NULL) {
+        free(sa);
+        free(sb);
+        return Z_MEM_ERROR;
+    }
+    int ret = scan_open(sa, a);
+    if (ret != Z_OK) {
+        free(sa);
+        free(sb);
+        return ret;
+    }
+    ret = scan_open(sb, b);
+    if (ret != Z_OK) {
+        scan_close(sa);
+        free(sa);
+        free(sb);
+        return ret;
+    }
+
+    const unsigned char *pa = NULL, *pb = NULL;
+    long na = 0, nb = 0;
+    uint64_t pos = 0;
+    for (;;) {
+        if (na == 0 && (na = scan_read(sa, &pa)) < 0) {
+            fprintf(stderr, "gzinfo: compressed data error at %llu in %s\n",
+                    (unsigned long long)sa->totin, a);
+            ret = na;
+            break;
+        }
+        if (nb == 0 && (nb = scan_read(sb, &pb)) < 0) {
+            fprintf(stderr, "gzinfo: compressed data error at %llu in %s\n",
+                    (unsigned long long)sb->totin, b);
+            ret = nb;
+            break;
+        }
+        if (na == 0 || nb == 0) {
+            ret = na != nb;
+            *off = pos;
+            break;
+        }
+        size_t n = na < nb ? na : nb;
+        size_t k = mismatch(pa, pb, n);
+        if (k < n) {
+            ret = 1;
+            *off = pos + k;
+            break;
+        }
+        pos += n;
+        pa += n;
+        pb += n;
+        na -= n;
+        nb -= n;
+    }
+    scan_close(sa);
+    scan_close(sb);
+    free(sa);
+    free(sb);
+    return ret;
+}
+
+// Member-parallel comparison of two files with the same member layout.
+struct cmp_members {
+    int fa, fb;
+    const gz_member *ma, *mb;
+    const uint64_t *start;          // uncompressed offset of each member
+    pthread_mutex_t lock;
+    size_t first;                   // lowest member found to differ
+    uint64_t off;                   // first difference within that member
+    int err;
+};
+
+static void cmp_member_job(void *ctx, size_t i) {
+    struct cmp_members *c = ctx;
+    pthread_mutex_lock(&c->lock);
+    int skip = i > c->first || c->err;
+    pthread_mutex_unlock(&c->lock);
+    if (skip)
+        return;
+
+    const gz_member *a = c->ma + i, *b = c->mb + i;
+    size_t isize = a->isize;
+    unsigned char *za = malloc(a->len), *zb = malloc(b->len);
+    unsigned char *ua = malloc(isize + 1), *ub = malloc(isize + 1);
+    int ret = Z_OK;
+    uint64_t off = isize;
+    if (za == NULL || zb == NULL || ua == NULL || ub == NULL)
+        ret = Z_MEM_ERROR;
+    else if (pread_full(c->fa, za, a->len, a->off) < 0 ||
+             pread_full(c->fb, zb, b->len, b->off) < 0)
+        ret = Z_ERRNO;
+    else if (a->len != b->len || memcmp(za, zb, a->len)) {
+        // Identical compressed bytes need no inflating. Otherwise inflate
+        // both, which also checks each against its own trailer.
+        size_t ga, gb;
+        ret = gz_inflate_member(za, a->len, ua, isize + 1, &ga);
+        if (ret == Z_OK)
+            ret = gz_inflate_member(zb, b->len, ub, isize + 1, &gb);
+        if (ret == Z_OK && (ga != isize || gb != isize))
+            ret = Z_DATA_ERROR;
+        if (ret == Z_OK)
+            off = mismatch(ua, ub, isize);
+    }
+    free(za);
+    free(zb);
+    free(ua);
+    free(ub);
+
+    pthread_mutex_lock(&c->lock);
+    if (ret != Z_OK && c->err == Z_OK)
+        c->err = ret;
+    else if (off < isize && i < c->first) {
+        c->first = i;
+        c->off = c->start[i] + off;
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+int cmd_cmp(int argc, char **argv) {
+    int threads = 0, quick = 0, opt;
+    while ((opt = getopt(argc, argv, "tj:")) != -1)
+        switch (opt) {
+        case 't':
+            quick = 1;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: gzinfo %s [-t] [-j threads] a b\n", argv[0]);
+            return 2;
+        }
+    if (argc - optind != 2) {
+        fprintf(stderr, "usage: gzinfo %s [-t] [-j threads] a b\n", argv[0]);
+        return 2;
+    }
+    const char *a = argv[optind], *b = argv[optind + 1];
+
+    int fa = open(a, O_RDONLY), fb = open(b, O_RDONLY);
+    if (fa < 0 || fb < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", fa < 0 ? a : b);
+        if (fa >= 0)
+            close(fa);
+        if (fb >= 0)
+            close(fb);
+        return 2;
+    }
+
+    // When both files can be walked member by member without inflating,
+    // the trailers give each member's uncompressed size and CRC up front.
+    // Hopping sees only the first of a set of split volumes, so sets are
+    // left to cmp_serial().
+    gz_member *ma = NULL, *mb = NULL;
+    long na = vol_count(a) > 1 || vol_count(b) > 1 ? -1 :
+              gz_hop_members(fa, &ma);
+    long nb = na < 0 ? -1 : gz_hop_members(fb, &mb);
+    int ret = 0, done = 0;
+    uint64_t off = 0;
+    if (na >= 0 && nb >= 0) {
+        uint64_t ta = 0, tb = 0;
+        long i;
+        for (i = 0; i < na; i++)
+            ta += ma[i].isize;
+        for (i = 0; i < nb; i++)
+            tb += mb[i].isize;
+        int aligned = na == nb;
+        for (i = 0; aligned && i < na; i++)
+            aligned = ma[i].isize == mb[i].isize;
+
+        if (quick && ta != tb) {
+            printf("%s %s differ: uncompressed sizes %llu and %llu\n", a, b,
+                   (unsigned long long)ta, (unsigned long long)tb);
+            ret = 1;
+            done = 1;
+        }
+        else if (aligned) {
+            uint64_t *start = malloc((na + 1) * sizeof(uint64_t));
+            struct cmp_members c = {fa, fb, ma, mb, start,
+                                    PTHREAD_MUTEX_INITIALIZER, na, 0, Z_OK};
+            if (start != NULL) {
+                start[0] = 0;
+                for (i = 0; i < na; i++)
+                    start[i + 1] = start[i] + ma[i].isize;
+                for (i = 0; quick && i < na; i++)
+                    if (ma[i].crc != mb[i].crc) {
+                        printf("%s %s differ: member %ld, uncompressed bytes "
+                               "%llu..%llu\n", a, b, i,
+                               (unsigned long long)start[i],
+                               (unsigned long long)start[i + 1] - 1);
+                        ret = 1;
+                        done = 1;
+                        break;
+                    }
+                if (!done) {
+                    pool_run(threads, na, cmp_member_job, &c);
+                    done = 1;
+                    ret = c.err != Z_OK ? c.err : c.first < (size_t)na;
+                    off = c.off;
+                    if (c.err != Z_OK)
+                        fprintf(stderr, "gzinfo: compressed data error in %s or %s\n", a, b);
+                    else if (ret == 1)
+                        printf("%s %s differ: uncompressed offset %llu\n", a, b,
+                               (unsigned long long)off);
+                }
+                free(start);
+            }
+            pthread_mutex_destroy(&c.lock);
+        }
+    }
+    free(ma);
+    free(mb);
+    close(fa);
+    close(fb);
+
+    if (!done) {
+        ret = cmp_serial(a, b, &off);
+        if (ret == 1)
+            printf("%s %s differ: uncompressed offset %llu\n", a, b,
+                   (unsigned long long)off);
+    }
+    if (ret < 0)
+        return 2;
+    return ret;
+}
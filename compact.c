@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Compact access-point index. A restart at a point needs only those bytes of
+// its window that are copied from by the first 32K of output after it, since
+// later output can't reach back that far. Those are found by decoding that
+// much from each point with the in-tree decoder. The rest of the window is
+// zeroed, the leading zeros are dropped, and what remains is deflated. In a
+// typical file most of a window is never referred to, so the index is a small
+// fraction of zran's. The file is laid out to be used in place from a memory
+// map: a header, the point offsets in Eytzinger order with the point number
+// of each, fixed-size point records, and the compressed windows. Integers are
+// little-endian and aligned, so only little-endian hosts map it directly.
+//
+// Layout, with n points:
+//   0   "GZXC", version (4), mode (4), 0 (4), span, length, csize, mtime, n,
+//       0 (8 each)
+//   64  eytz[n + 1] (8 each), eytz[0] unused
+//       rank[n + 1] (4 each), padded to a multiple of 8
+//       n point records: out, in, window offset (8 each), window compressed
+//       length (4), window start (2), bits (1), 0 (1)
+//       the compressed windows
+
+#define MAGIC "GZXC"
+#define VERSION 1
+#define HEAD 64
+#define REC 32
+
+static uint64_t rd8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+struct shrink {
+    const gz_index *x;
+    const unsigned char *data;      // the compressed file, mapped
+    size_t size;
+    unsigned char **z;              // compressed window of each point
+    uLong *zlen;
+    unsigned *lo;                   // where its window starts
+    int err;
+};
+
+// Mark in used[] the bytes of p's window that are copied from. Return 0, or
+// -1 if that could not be decided.
+static int window_use(const struct shrink *s, const gz_point *p,
+                      unsigned char *used) {
+    dfl d;
+    if (p->in > s->size || (p->in == 0 && p->bits) ||
+        dfl_init(&d, s->data, s->size, 8 * p->in - p->bits, p->window,
+                 WINSIZE, 0) < 0)
+        return -1;
+    d.used = used;
+    int ret = DFL_OK;
+    while (ret == DFL_OK && d.total < WINSIZE)
+        ret = dfl_block(&d);
+    dfl_free(&d);
+    return ret == DFL_OK || ret == DFL_END ? 0 : -1;
+}
+
+static void shrink_job(void *ctx, size_t i) {
+    struct shrink *s = ctx;
+    const gz_point *p = s->x->list + i;
+    unsigned char used[WINSIZE], win[WINSIZE];
+    s->lo[i] = WINSIZE;
+    if (p->window == NULL || p->out == 0)
+        return;
+    memset(used, 0, WINSIZE);
+    if (window_use(s, p, used) < 0)
+        memset(used, 1, WINSIZE);           // keep it all
+    unsigned lo = 0;
+    while (lo < WINSIZE && !used[lo])
+        lo++;
+    if (lo == WINSIZE)
+        return;
+    for (unsigned k = lo; k < WINSIZE; k++)
+        win[k] = used[k] ? p->window[k] : 0;
+    uLong n = compressBound(WINSIZE - lo);
+    s->z[i] = malloc(n);
+    if (s->z[i] == NULL || compress2(s->z[i], &n, win + lo, WINSIZE - lo,
+                                     Z_BEST_COMPRESSION) != Z_OK) {
+        s->err = 1;
+        return;
+    }
+    s->zlen[i] = n;
+    s->lo[i] = lo;
+}
+
+// Fill eytz[] and rank[] from the sorted points, in order, at slot k and its
+// subtree. Return the next point to place.
+static size_t eytzinger(const gz_index *x, uint64_t *eytz, uint32_t *rank,
+                        size_t i, size_t k) {
+    if (k <= x->have) {
+        i = eytzinger(x, eytz, rank, i, 2 * k);
+        eytz[k] = x->list[i].out;
+        rank[k] = i++;
+        i = eytzinger(x, eytz, rank, i, 2 * k + 1);
+    }
+    return i;
+}
+
+static int write_compact(const char *path, const gz_index *x,
+                         const struct shrink *s, const uint64_t *eytz,
+                         const uint32_t *rank) {
+    size_t n = x->have;
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for writing\n", path);
+        return -1;
+    }
+    fwrite(MAGIC, 1, 4, out);
+    put_le(out, VERSION, 4);
+    put_le(out, (uint32_t)x->mode, 4);
+    put_le(out, 0, 4);
+    put_le(out, x->span, 8);
+    put_le(out, x->length, 8);
+    put_le(out, x->csize, 8);
+    put_le(out, x->mtime, 8);
+    put_le(out, n, 8);
+    put_le(out, 0, 8);
+    for (size_t k = 0; k <= n; k++)
+        put_le(out, eytz[k], 8);
+    for (size_t k = 0; k <= n; k++)
+        put_le(out, rank[k], 4);
+    if ((n + 1) & 1)
+        put_le(out, 0, 4);
+    uint64_t woff = HEAD + 8 * (n + 1) + 4 * ((n + 2) & ~(size_t)1) + REC * n;
+    for (size_t i = 0; i < n; i++) {
+        const gz_point *p = x->list + i;
+        put_le(out, p->out, 8);
+        put_le(out, p->in, 8);
+        put_le(out, woff, 8);
+        put_le(out, s->zlen[i], 4);
+        put_le(out, s->lo[i], 2);
+        put_le(out, p->bits, 1);
+        put_le(out, 0, 1);
+        woff += s->zlen[i];
+    }
+    for (size_t i = 0; i < n; i++)
+        if (s->zlen[i])                 // no window, and s->z[i] is NULL
+            fwrite(s->z[i], 1, s->zlen[i], out);
+    int err = ferror(out);
+    if (fclose(out) != 0 || err) {
+        fprintf(stderr, "gzinfo: write error on %s\n", path);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Save x as a compact index at path, reading the file open on fd to find the
+// window bytes in use. Return 0, or -1 after a message.
+int gz_compact_save(const char *path, const gz_index *x, int fd, int threads) {
+    size_t n = x->have;
+    struct stat st;
+    if (n == 0 || n >= UINT32_MAX || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "gzinfo: nothing to index\n");
+        return -1;
+    }
+    struct shrink s = {x, NULL, st.st_size, calloc(n, sizeof(unsigned char *)),
+                       calloc(n, sizeof(uLong)), calloc(n, sizeof(unsigned)), 0};
+    uint64_t *eytz = calloc(n + 1, sizeof(uint64_t));
+    uint32_t *rank = calloc(n + 1, sizeof(uint32_t));
+    void *map = mmap(NULL, s.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int ret = -1;
+    if (map == MAP_FAILED || s.z == NULL || s.zlen == NULL || s.lo == NULL ||
+        eytz == NULL || rank == NULL)
+        fprintf(stderr, "gzinfo: out of memory\n");
+    else {
+        s.data = map;
+        pool_run(threads, n, shrink_job, &s);
+        eytzinger(x, eytz, rank, 0, 1);
+        if (s.err)
+            fprintf(stderr, "gzinfo: out of memory\n");
+        else
+            ret = write_compact(path, x, &s, eytz, rank);
+    }
+    if (map != MAP_FAILED)
+        munmap(map, s.size);
+    for (size_t i = 0; s.z != NULL && i < n; i++)
+        free(s.z[i]);
+    free(s.z);
+    free(s.zlen);
+    free(s.lo);
+    free(eytz);
+    free(rank);
+    return ret;
+}
+
+// Map the compact index at path. Return 0, or -1 if it is not one.
+int gz_compact_open(const char *path, gz_compact *c) {
+    const uint16_t one = 1;
+    struct stat st;
+    memset(c, 0, sizeof(gz_compact));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < HEAD ||
+        *(const unsigned char *)&one != 1) {
+        close(fd);
+        return -1;
+    }
+    c->len = st.st_size;
+    c->map = mmap(NULL, c->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->map == MAP_FAILED) {
+        c->map = NULL;
+        return -1;
+    }
+    const unsigned char *h = c->map;
+    c->n = rd8(h + 48);
+    if (memcmp(h, MAGIC, 4) || le32(h + 4) != VERSION || c->n == 0 ||
+        c->n > (c->len - HEAD) / (8 + 4 + REC) ||
+        HEAD + 8 * (c->n + 1) + 4 * ((c->n + 2) & ~(size_t)1) + REC * c->n >
+        c->len) {
+        gz_compact_close(c);
+        return -1;
+    }
+    c->mode = (int32_t)le32(h + 8);
+    c->span = rd8(h + 16);
+    c->length = rd8(h + 24);
+    c->csize = rd8(h + 32);
+    c->mtime = rd8(h + 40);
+    c->eytz = (const uint64_t *)(c->map + HEAD);
+    c->rank = (const uint32_t *)(c->eytz + c->n + 1);
+    c->point = (const unsigned char *)(c->rank + ((c->n + 2) & ~(size_t)1));
+    return 0;
+}
+
+// Return the number of the last point at or before off. The search walks the
+// implicit tree from the root, so the first levels share cache lines and
+// the next ones are fetched ahead.
+size_t gz_compact_find(const gz_compact *c, uint64_t off) {
+    const uint64_t *e = c->eytz;
+    size_t k = 1, n = c->n;
+    while (k <= n) {
+        __builtin_prefetch(e + 16 * k);
+        k = 2 * k + (e[k] <= off);
+    }
+    // k now leads to the first offset past off, found by dropping the right
+    // turns taken after it, or to none if it is 0.
+    k >>= __builtin_ffsll(~k);
+    return k == 0 ? n - 1 : c->rank[k] ? c->rank[k] - 1 : 0;
+}
+
+// Fill *p with point i, expanding its window, if it needs one, into window.
+// Return 0, or -1 if the index is damaged.
+int gz_compact_point(const gz_compact *c, size_t i, gz_point *p,
+                     unsigned char *window) {
+    const unsigned char *r = c->point + REC * i;
+    uint64_t woff = rd8(r + 16);
+    uint32_t wlen = le32(r + 24);
+    unsigned lo = r[28] | (r[29] << 8);
+    p->out = rd8(r);
+    p->in = rd8(r + 8);
+    p->bits = r[30] & 7;
+    p->window = NULL;
+    if (wlen == 0)
+        return 0;
+    uLongf got = WINSIZE - lo;
+    if (lo >= WINSIZE || woff > c->len || wlen > c->len - woff ||
+        uncompress(window + lo, &got, c->map + woff, wlen) != Z_OK ||
+        got != WINSIZE - lo)
+        return -1;
+    memset(window, 0, lo);
+    p->window = window;
+    return 0;
+}
+
+// Expand the whole of c into an ordinary index. Return 0 or -1.
+int gz_compact_expand(const gz_compact *c, gz_index *x) {
+    unsigned char win[WINSIZE];
+    memset(x, 0, sizeof(gz_index));
+    x->mode = c->mode;
+    x->span = c->span;
+    x->length = c->length;
+    x->csize = c->csize;
+    x->mtime = c->mtime;
+    if ((x->list = calloc(c->n, sizeof(gz_point))) == NULL)
+        return -1;
+    x->size = c->n;
+    for (; x->have < c->n; x->have++) {
+        gz_point *p = x->list + x->have;
+        if (gz_compact_point(c, x->have, p, win) < 0 ||
+            (p->window != NULL && (p->window = malloc(WINSIZE)) == NULL)) {
+            gz_index_free(x);
+            return -1;
+        }
+        if (p->window != NULL)
+            memcpy(p->window, win, WINSIZE);
+    }
+    return 0;
+}
+
+void gz_compact_close(gz_compact *c) {
+    if (c->map != NULL)
+        munmap(c->map, c->len);
+    memset(c, 0, sizeof(gz_compact));
+}
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Staged duplicate detection across a batch. Each stage only looks at the
+// files the previous one left as candidates:
+//   1. file size and the last eight bytes, which for gzip are the CRC-32 and
+//      ISIZE trailer -- a few bytes read per file;
+//   2. a 128-bit hash of the compressed bytes, confirming byte-identical
+//      files without inflating anything;
+//   3. a decompressing comparison, only for gzip files that share a trailer
+//      but not their compressed bytes.
+// Content matches in stage 3 require the final trailers to agree, so a
+// multi-member file is only matched to files that end the same way.
+
+struct dfile {
+    const char *name;
+    uint64_t size;
+    int gz;                     // starts with a gzip header
+    unsigned char trl[8];       // last eight bytes
+    uint64_t h[2];              // stage 2 hash of the whole file
+    int same;                   // index of the byte-identical original, or -1
+    int like;                   // index of the same-content original, or -1
+    int err;
+};
+
+struct dedup {
+    struct dfile *f;
+    int *order;                 // candidate file indices for the current job
+    int *group;                 // start of each stage 3 group in order[]
+    pthread_mutex_t lock;
+    uint64_t read1, read2, inflated;
+};
+
+static void stage1_job(void *ctx, size_t i) {
+    struct dedup *d = ctx;
+    struct dfile *f = d->f + i;
+    unsigned char head[3] = {0};
+    struct stat st;
+    int fd = open(f->name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        f->err = 1;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    f->size = st.st_size;
+    size_t tail = f->size < 8 ? f->size : 8;
+    size_t lead = f->size < 3 ? f->size : 3;
+    if (pread_full(fd, head, lead, 0) < 0 ||
+        pread_full(fd, f->trl, tail, f->size - tail) < 0)
+        f->err = 1;
+    f->gz = f->size >= 18 && head[0] == 0x1f && head[1] == 0x8b && head[2] == 8;
+    close(fd);
+    pthread_mutex_lock(&d->lock);
+    d->read1 += lead + tail;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static void stage2_job(void *ctx, size_t i) {
+    struct dedup *d = ctx;
+    struct dfile *f = d->f + d->order[i];
+    unsigned char *buf = malloc(1 << 20);
+    int fd = open(f->name, O_RDONLY);
+    uint64_t off = 0;
+    f->h[0] = 0;
+    f->h[1] = 0x6a09e667f3bcc908ULL;
+    if (buf == NULL || fd < 0)
+        f->err = 1;
+    while (!f->err && off < f->size) {
+        size_t n = f->size - off < (1 << 20) ? f->size - off : (1 << 20);
+        if (pread_full(fd, buf, n, off) < 0)
+            f->err = 1;
+        f->h[0] = hash64(buf, n, f->h[0]);
+        f->h[1] = hash64(buf, n, f->h[1]);
+        off += n;
+    }
+    if (fd >= 0)
+        close(fd);
+    free(buf);
+    pthread_mutex_lock(&d->lock);
+    d->read2 += off;
+    pthread_mutex_unlock(&d->lock);
+}
+
+// Cluster one group of distinct gzip files sharing a trailer by their
+// uncompressed contents, comparing each against the originals so far.
+static void stage3_job(void *ctx, size_t g) {
+    struct dedup *d = ctx;
+    int *first = d->order + d->group[g], *last = d->order + d->group[g + 1];
+    uint64_t inflated = 0;
+    for (int *p = first + 1; p < last; p++)
+        for (int *q = first; q < p; q++) {
+            struct dfile *a = d->f + *q, *b = d->f + *p;
+            if (a->like >= 0 || a->err)
+                continue;
+            uint64_t off;
+            int ret = cmp_serial(a->name, b->name, &off);
+            inflated += a->size + b->size;
+            if (ret < 0)
+                b->err = 1;
+            if (ret == 0) {
+                b->like = *q;
+                break;
+            }
+            if (ret < 0)
+                break;
+        }
+    pthread_mutex_lock(&d->lock);
+    d->inflated += inflated;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static struct dfile *sort_files;
+
+static int by_size_trailer(const void *x, const void *y) {
+    const struct dfile *a = sort_files + *(const int *)x;
+    const struct dfile *b = sort_files + *(const int *)y;
+    if (a->size != b->size)
+        return a->size < b->size ? -1 : 1;
+    int c = memcmp(a->trl, b->trl, 8);
+    return c ? c : *(const int *)x - *(const int *)y;
+}
+
+static int same_key(const struct dfile *f, int a, int b) {
+    return f[a].size == f[b].size && memcmp(f[a].trl, f[b].trl, 8) == 0;
+}
+
+static int by_trailer(const void *x, const void *y) {
+    const struct dfile *a = sort_files + *(const int *)x;
+    const struct dfile *b = sort_files + *(const int *)y;
+    int c = memcmp(a->trl, b->trl, 8);
+    return c ? c : *(const int *)x - *(const int *)y;
+}
+
+int cmd_dedup(int argc, char **argv) {
+    int threads = 0, opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1)
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    int n = argc - optind;
+    if (n < 1) {
+        fprintf(stderr, "usage: gzinfo dedup [-j threads] file...\n");
+        return 1;
+    }
+
+    struct dedup d = {0};
+    d.f = calloc(n, sizeof(struct dfile));
+    d.order = malloc(n * sizeof(int));
+    d.group = malloc((n + 1) * sizeof(int));
+    if (d.f == NULL || d.order == NULL || d.group == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        free(d.f);
+        free(d.order);
+        free(d.group);
+        return 1;
+    }
+    pthread_mutex_init(&d.lock, NULL);
+    for (int i = 0; i < n; i++) {
+        d.f[i].name = argv[optind + i];
+        d.f[i].same = d.f[i].like = -1;
+    }
+    sort_files = d.f;
+
+    // Stage 1: size and trailer.
+    pool_run(threads, n, stage1_job, &d);
+    int m = 0;
+    for (int i = 0; i < n; i++)
+        if (d.f[i].err)
+            fprintf(stderr, "gzinfo: could not read %s\n", d.f[i].name);
+        else
+            d.order[m++] = i;
+    qsort(d.order, m, sizeof(int), by_size_trailer);
+    int cand = 0;
+    for (int i = 0; i < m; i++)
+        if ((i > 0 && same_key(d.f, d.order[i - 1], d.order[i])) ||
+            (i + 1 < m && same_key(d.f, d.order[i], d.order[i + 1])))
+            d.order[cand++] = d.order[i];
+    printf("Stage 1: %d files, %llu bytes read, %d candidates\n", m,
+           (unsigned long long)d.read1, cand);
+
+    // Stage 2: hash the compressed bytes of the candidates. Within a run of
+    // equal size and trailer, the first file with each hash is the original.
+    pool_run(threads, cand, stage2_job, &d);
+    for (int i = 1; i < cand; i++) {
+        struct dfile *f = d.f + d.order[i];
+        for (int k = i - 1; k >= 0; k--) {
+            struct dfile *o = d.f + d.order[k];
+            if (!same_key(d.f, d.order[k], d.order[i]))
+                break;
+            if (!o->err && !f->err && o->same < 0 &&
+                o->h[0] == f->h[0] && o->h[1] == f->h[1]) {
+                f->same = d.order[k];
+                break;
+            }
+        }
+    }
+    printf("Stage 2: %d files hashed, %llu bytes read\n", cand,
+           (unsigned long long)d.read2);
+
+    // Stage 3: distinct gzip files with equal trailers, grouped by trailer.
+    m = 0;
+    for (int i = 0; i < n; i++)
+        if (!d.f[i].err && d.f[i].gz && d.f[i].same < 0)
+            d.order[m++] = i;
+    qsort(d.order, m, sizeof(int), by_trailer);
+    int groups = 0, w = 0;
+    d.group[0] = 0;
+    for (int i = 0, k = 0; i < m; i++) {
+        if (i + 1 < m && memcmp(d.f[d.order[i]].trl, d.f[d.order[i + 1]].trl, 8) == 0)
+            continue;
+        if (i > k) {
+            memmove(d.order + w, d.order + k, (i + 1 - k) * sizeof(int));
+            w += i + 1 - k;
+            d.group[++groups] = w;
+        }
+        k = i + 1;
+    }
+    pool_run(threads, groups, stage3_job, &d);
+    printf("Stage 3: %d groups, %llu compressed bytes inflated\n", groups,
+           (unsigned long long)d.inflated);
+
+    // Report each original with its duplicates. Same-content files can keep
+    // only the smallest copy.
+    uint64_t reclaim = 0;
+    int dups = 0;
+    for (int i = 0; i < n; i++) {
+        struct dfile *f = d.f + i;
+        if (f->err || f->same >= 0 || f->like >= 0)
+            continue;
+        int shown = 0;
+        uint64_t small = f->size, sum = f->size;
+        for (int j = i + 1; j < n; j++) {
+            struct dfile *g = d.f + j;
+            int root = g->same >= 0 ? g->same : j;
+            if (g->err || (root != i && d.f[root].like != i))
+                continue;
+            if (!shown)
+                printf("%s\n", f->name);
+            shown = 1;
+            printf("  %s %s\n", g->same >= 0 ? "=" : "~", g->name);
+            dups++;
+            if (g->same >= 0)
+                reclaim += g->size;
+            else {
+                sum += g->size;
+                if (g->size < small)
+                    small = g->size;
+            }
+        }
+        reclaim += sum - small;
+    }
+    printf("Duplicates: %d (= same bytes, ~ same content)\n", dups);
+    printf("Reclaimable: %s\n", humanSize(reclaim));
+
+    pthread_mutex_destroy(&d.lock);
+    free(d.f);
+    free(d.order);
+    free(d.group);
+    return 0;
+}
@@ -0,0 +1,439 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gzinfo.h"
+
+// A small table-driven deflate decoder, after puff.c. Unlike zlib it can
+// start at any bit offset and decode without the preceding window, in which
+// case bytes copied from before the start are counted as unknown. It also
+// reports exactly where in the input a block or an error is.
+
+#define DFL_MAXBITS 15
+#define DFL_OUT (1U << 18)              // output run between flushes
+
+static const uint16_t lbase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t lext[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dbase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577};
+static const uint8_t dext[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Return at least 57 bits of input starting at bit d->pos, zero-filled past
+// the end. Reading past the end is caught by the callers checking d->pos.
+static inline uint64_t peek(const dfl *d) {
+    uint64_t at = d->pos >> 3, v = 0;
+    if (at + 8 <= d->len)
+        memcpy(&v, d->in + at, 8);
+    else
+        for (unsigned i = 0; at + i < d->len && i < 8; i++)
+            v |= (uint64_t)d->in[at + i] << (8 * i);
+    return v >> (d->pos & 7);
+}
+
+static inline unsigned bits(dfl *d, int n) {
+    unsigned v = peek(d) & ((1U << n) - 1);
+    d->pos += n;
+    return v;
+}
+
+// Build the decoding tables for n code lengths. Return 0 for a complete
+// code, positive for an incomplete one, or negative if over-subscribed.
+static int build(dfl_huff *h, const unsigned char *length, int n) {
+    uint16_t offs[DFL_MAXBITS + 1];
+    int len, sym, left;
+
+    memset(h->count, 0, sizeof(h->count));
+    for (sym = 0; sym < n; sym++)
+        h->count[length[sym]]++;
+    memset(h->fast, 0, sizeof(h->fast));
+    if (h->count[0] == n)
+        return 0;
+
+    left = 1;
+    for (len = 1; len <= DFL_MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0)
+            return left;
+    }
+
+    offs[1] = 0;
+    for (len = 1; len < DFL_MAXBITS; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+    for (sym = 0; sym < n; sym++)
+        if (length[sym] != 0)
+            h->symbol[offs[length[sym]]++] = sym;
+
+    // Fill the fast table with the bit-reversed codes of up to DFL_FAST bits.
+    unsigned code = 0, index = 0;
+    for (len = 1; len <= DFL_FAST; len++) {
+        for (int k = 0; k < h->count[len]; k++, code++) {
+            unsigned rev = 0;
+            for (int b = 0; b < len; b++)
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            uint16_t entry = (h->symbol[index++] << 4) | len;
+            for (unsigned j = rev; j < (1U << DFL_FAST); j += 1U << len)
+                h->fast[j] = entry;
+        }
+        code <<= 1;
+    }
+    return left;
+}
+
+static inline int decode(dfl *d, const dfl_huff *h) {
+    uint64_t v = peek(d);
+    unsigned e = h->fast[v & ((1U << DFL_FAST) - 1)];
+    if (e) {
+        d->pos += e & 15;
+        return e >> 4;
+    }
+
+    // Longer code: walk the canonical code a bit at a time.
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= DFL_MAXBITS; len++) {
+        code |= v & 1;
+        v >>= 1;
+        int count = h->count[len];
+        if (code - count < first) {
+            d->pos += len;
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    d->msg = "invalid code";
+    return DFL_BAD;
+}
+
+// Hand the pending output to the sink, then slide the window down if the
+// buffer is close to full.
+static void flush(dfl *d, int slide) {
+    if (d->sink != NULL && d->have > d->flushed)
+        d->sink(d->ctx, d->win + d->flushed, d->have - d->flushed);
+    d->flushed = d->have;
+    if (slide && d->have > WINSIZE) {
+        memmove(d->win, d->win + d->have - WINSIZE, WINSIZE);
+        if (d->unk != NULL)
+            memmove(d->unk, d->unk + d->have - WINSIZE, WINSIZE);
+        d->have = d->flushed = WINSIZE;
+    }
+}
+
+static int stored(dfl *d) {
+    d->pos = (d->pos + 7) & ~(uint64_t)7;
+    if (d->pos + 32 > 8 * (uint64_t)d->len)
+        return DFL_EOF;
+    unsigned len = bits(d, 16);
+    if ((bits(d, 16) ^ 0xffff) != len) {
+        d->msg = "invalid stored block lengths";
+        return DFL_BAD;
+    }
+    if (d->pos + 8 * (uint64_t)len > 8 * (uint64_t)d->len)
+        return DFL_EOF;
+    const unsigned char *src = d->in + (d->pos >> 3);
+    d->pos += 8 * (uint64_t)len;
+    while (len) {
+        if (d->have == d->size)
+            flush(d, 1);
+        unsigned n = d->size - d->have < len ? d->size - d->have : len;
+        memcpy(d->win + d->have, src, n);
+        if (d->unk != NULL)
+            memset(d->unk + d->have, 0, n);
+        d->have += n;
+        d->total += n;
+        d->stats.literals += n;
+        src += n;
+        len -= n;
+    }
+    return DFL_OK;
+}
+
+static int codes(dfl *d) {
+    uint64_t end = 8 * (uint64_t)d->len;
+    for (;;) {
+        if (d->size - d->have < 258)
+            flush(d, 1);
+        int sym = decode(d, &d->lencode);
+        if (sym < 0)
+            return d->pos > end ? DFL_EOF : sym;
+        if (sym < 256) {
+            if (d->unk != NULL)
+                d->unk[d->have] = 0;
+            d->win[d->have++] = sym;
+            d->total++;
+            d->stats.literals++;
+            if (d->hist != NULL)
+                d->hist->lit[sym]++;
+        }
+        else if (sym == 256)
+            break;
+        else {
+            sym -= 257;
+            if (sym >= 29) {
+                d->msg = "invalid literal/length code";
+                return DFL_BAD;
+            }
+            unsigned len = lbase[sym] + bits(d, lext[sym]);
+            int dsym = decode(d, &d->distcode);
+            if (dsym < 0)
+                return d->pos > end ? DFL_EOF : dsym;
+            if (dsym >= 30) {
+                d->msg = "invalid distance code";
+                return DFL_BAD;
+            }
+            unsigned dist = dbase[dsym] + bits(d, dext[dsym]);
+            if (dist > d->have) {
+                d->msg = "invalid distance too far back";
+                return d->pos > end ? DFL_EOF : DFL_BAD;
+            }
+            if (d->used != NULL && dist > d->total) {
+                // Nothing has slid yet, so the window is still at the start.
+                unsigned n = dist - d->total < len ? dist - d->total : len;
+                memset(d->used + d->have - dist, 1, n);
+            }
+            d->stats.matches++;
+            d->stats.match_bytes += len;
+            if (dist == 1)
+                d->stats.rle++;
+            if (d->hist != NULL) {
+                d->hist->len[len]++;
+                d->hist->dist[dsym]++;
+            }
+            unsigned char *to = d->win + d->have, *from = to - dist;
+            if (d->unk != NULL) {
+                unsigned char *uto = d->unk + d->have, *ufrom = uto - dist;
+                for (unsigned i = 0; i < len; i++) {
+                    d->unknown += ufrom[i];
+                    uto[i] = ufrom[i];
+                }
+            }
+            if (dist >= len)
+                memcpy(to, from, len);
+            else
+                for (unsigned i = 0; i < len; i++)
+                    to[i] = from[i];
+            d->have += len;
+            d->total += len;
+        }
+        if (d->pos > end)
+            return DFL_EOF;
+    }
+    return d->pos > end ? DFL_EOF : DFL_OK;
+}
+
+static int fixed(dfl *d) {
+    unsigned char lengths[288];
+    int sym;
+    for (sym = 0; sym < 144; sym++)
+        lengths[sym] = 8;
+    for (; sym < 256; sym++)
+        lengths[sym] = 9;
+    for (; sym < 280; sym++)
+        lengths[sym] = 7;
+    for (; sym < 288; sym++)
+        lengths[sym] = 8;
+    build(&d->lencode, lengths, 288);
+    for (sym = 0; sym < 30; sym++)
+        lengths[sym] = 5;
+    build(&d->distcode, lengths, 30);
+    return codes(d);
+}
+
+static int dynamic(dfl *d) {
+    static const uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    unsigned char lengths[320];
+    int nlen = bits(d, 5) + 257;
+    int ndist = bits(d, 5) + 1;
+    int ncode = bits(d, 4) + 4;
+    int index, err;
+    if (nlen > 286 || ndist > 30) {
+        d->msg = "too many length or distance codes";
+        return DFL_BAD;
+    }
+
+    for (index = 0; index < ncode; index++)
+        lengths[order[index]] = bits(d, 3);
+    for (; index < 19; index++)
+        lengths[order[index]] = 0;
+    if (build(&d->lencode, lengths, 19) != 0) {
+        d->msg = "invalid code lengths set";
+        return DFL_BAD;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int sym = decode(d, &d->lencode), len = 0, rep;
+        if (sym < 0)
+            return sym;
+        if (sym < 16) {
+            lengths[index++] = sym;
+            continue;
+        }
+        if (sym == 16) {
+            if (index == 0) {
+                d->msg = "invalid bit length repeat";
+                return DFL_BAD;
+            }
+            len = lengths[index - 1];
+            rep = 3 + bits(d, 2);
+        }
+        else if (sym == 17)
+            rep = 3 + bits(d, 3);
+        else
+            rep = 11 + bits(d, 7);
+        if (index + rep > nlen + ndist) {
+            d->msg = "invalid bit length repeat";
+            return DFL_BAD;
+        }
+        while (rep--)
+            lengths[index++] = len;
+    }
+    if (lengths[256] == 0) {
+        d->msg = "invalid code -- missing end-of-block";
+        return DFL_BAD;
+    }
+
+    // Incomplete codes are only allowed for a single length-1 code.
+    err = build(&d->lencode, lengths, nlen);
+    if (err && (err < 0 || nlen != d->lencode.count[0] + d->lencode.count[1])) {
+        d->msg = "invalid literal/lengths set";
+        return DFL_BAD;
+    }
+    err = build(&d->distcode, lengths + nlen, ndist);
+    if (err && (err < 0 || ndist != d->distcode.count[0] + d->distcode.count[1])) {
+        d->msg = "invalid distances set";
+        return DFL_BAD;
+    }
+    if (d->pos > 8 * (uint64_t)d->len)
+        return DFL_EOF;
+    d->header_bits = d->pos - d->block;
+    return codes(d);
+}
+
+// Set up to decode in[0..len-1] from bit offset bit. If window is not NULL,
+// its wlen bytes (at most WINSIZE) precede the data. If unknown is true, a
+// full window of unknown bytes precedes the data instead, so that any
+// distance is accepted and the bytes it reaches are counted in d->unknown.
+// Return 0, or -1 if out of memory.
+int dfl_init(dfl *d, const unsigned char *in, size_t len, uint64_t bit,
+             const unsigned char *window, size_t wlen, int unknown) {
+    memset(d, 0, sizeof(*d));
+    d->in = in;
+    d->len = len;
+    d->pos = d->block = bit;
+    d->size = WINSIZE + DFL_OUT;
+    d->win = malloc(d->size);
+    if (d->win == NULL)
+        return -1;
+    if (unknown) {
+        d->unk = malloc(d->size);
+        if (d->unk == NULL) {
+            free(d->win);
+            return -1;
+        }
+        memset(d->win, 0, WINSIZE);
+        memset(d->unk, 1, WINSIZE);
+        d->have = d->flushed = WINSIZE;
+    }
+    else if (window != NULL) {
+        memcpy(d->win, window, wlen);
+        d->have = d->flushed = wlen;
+    }
+    return 0;
+}
+
+void dfl_free(dfl *d) {
+    free(d->win);
+    free(d->unk);
+}
+
+// Decode the next deflate block. Return DFL_OK, DFL_END after the last
+// block, or DFL_EOF or DFL_BAD (with d->msg set) on error, with d->pos at
+// the bit where decoding stopped.
+int dfl_block(dfl *d) {
+    if (d->pos + 3 > 8 * (uint64_t)d->len)
+        return DFL_EOF;
+    d->block = d->pos;
+    d->header_bits = 3;
+    d->final = bits(d, 1);
+    d->type = bits(d, 2);
+    d->msg = NULL;
+    int ret;
+    switch (d->type) {
+    case 0:
+        ret = stored(d);
+        d->header_bits = d->pos - d->block;
+        break;
+    case 1:
+        ret = fixed(d);
+        break;
+    case 2:
+        ret = dynamic(d);
+        break;
+    default:
+        d->msg = "invalid block type";
+        ret = DFL_BAD;
+    }
+    if (ret != DFL_OK)
+        return ret;
+    d->blocks++;
+    if (d->hist != NULL) {
+        d->hist->type[d->type]++;
+        if (d->type == 2)
+            d->hist->header_bits += d->header_bits;
+    }
+    flush(d, 0);
+    return d->final ? DFL_END : DFL_OK;
+}
+
+// Search bits [from, to) of in[0..len-1] for the start of a non-final
+// deflate block that decodes without error, followed by 8K of blocks (or the
+// end of the data) that do too. Stored blocks are recognized by their length
+// check, at any bit offset, as the padding after the header takes them to a
+// byte boundary. Dynamic blocks are recognized by trial decoding. Fixed blocks
+// are not searched for. Return the bit offset found, or -1 if none.
+int64_t dfl_find_block(const unsigned char *in, size_t len, uint64_t from,
+                       uint64_t to) {
+    dfl d;
+    if (dfl_init(&d, in, len, from, NULL, 0, 1) < 0)
+        return -1;
+    if (to > 8 * (uint64_t)len)
+        to = 8 * (uint64_t)len;
+    int64_t found = -1;
+    for (uint64_t pos = from; pos < to && found < 0; pos++) {
+        d.pos = pos;
+        uint64_t head = peek(&d);
+        int dyn = (head & 7) == 4 && ((head >> 3) & 31) <= 29 &&
+                  ((head >> 8) & 31) <= 29;
+        uint64_t at = (pos + 10) >> 3;     // LEN, after the padding
+        int sto = (head & 7) == 0 && 8 * at + 32 <= to && at + 4 <= len &&
+                  (in[at] | in[at + 1]) != 0 && (in[at] ^ in[at + 2]) == 0xff &&
+                  (in[at + 1] ^ in[at + 3]) == 0xff;
+        if (!dyn && !sto)
+            continue;
+
+        // Trial decode, with a full unknown window so no distance fails. A
+        // false start can decode a block by chance, most easily a stored one
+        // followed by short fixed ones, so what follows has to decode too.
+        d.have = d.flushed = WINSIZE;
+        if (dfl_block(&d) != DFL_OK)
+            continue;
+        uint64_t after = d.pos;
+        int ret;
+        while ((ret = dfl_block(&d)) == DFL_OK && d.pos - after < 65536)
+            ;
+        if (ret != DFL_BAD)
+            found = pos;
+    }
+    dfl_free(&d);
+    return found;
+}
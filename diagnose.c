@@ -0,0 +1,399 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Encoder pathologies. Some producers flush after every record, leaving an
+// empty stored block (00 00 ff ff) each time, or write fixed-code blocks
+// where a dynamic code would be smaller, or end dynamic blocks after a few
+// hundred bytes so that the header is most of each block, or start a new
+// gzip member per record. The block walk with the in-tree decoder finds and
+// counts each, with the bytes it wastes. The slowdown is measured, not
+// guessed: a prefix of the file is inflated and timed, then the same data is
+// deflated as one level 6 stream and that is inflated and timed, each on the
+// thread's own clock. With more than one file they are ranked by the time
+// lost on each full read, which is where fixing the producer pays most.
+
+#define TINY 4096                   // output of a dynamic block to call tiny
+#define SMALL 65536                 // output of a member to call small
+#define PREFIX (16U << 20)          // uncompressed bytes to time
+#define HEADER 600                  // bits for a dynamic header, if no others
+#define RUNS 7                      // timed runs of each, to take the fastest
+
+enum { SYNC, FIXED, TINYDYN, MEMBERS, KINDS };
+
+static const char *kinds[KINDS] = {"sync flush markers",
+                                   "fixed-code blocks",
+                                   "tiny dynamic blocks",
+                                   "small members"};
+
+static const unsigned char lext[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+    5, 5, 5, 5, 0};
+static const unsigned char dext[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+    11, 11, 12, 12, 13, 13};
+
+typedef struct {
+    char *name;
+    const char *why;                // what went wrong, or NULL
+    uint64_t at;                    // where, or UINT64_MAX
+    uint64_t size, out, blocks, members;
+    uint64_t count[KINDS];
+    double waste[KINDS];            // bytes that a well-formed stream saves
+    double slow;                    // decoding time over level 6's, less 1
+    double lost;                    // seconds more for each full decode
+} diag;
+
+// Length code (0..28) for a match length of 3..258.
+static int len_code(unsigned len) {
+    static const unsigned short base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51,
+        59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    int c = 28;
+    while (base[c] > len)
+        c--;
+    return c;
+}
+
+static double shannon(const uint64_t *n, int k) {
+    uint64_t all = 0;
+    for (int i = 0; i < k; i++)
+        all += n[i];
+    double bits = 0;
+    for (int i = 0; i < k; i++)
+        if (n[i])
+            bits -= n[i] * log2((double)n[i] / all);
+    return bits;
+}
+
+// Bits that a dynamic code would take for the symbols in h, with a header of
+// hdr bits. Shannon is a bound that Huffman codes come close to.
+static double dynamic_bits(const dfl_hist *h, double hdr) {
+    uint64_t ll[286] = {0}, extra = 0;
+    memcpy(ll, h->lit, sizeof(h->lit));
+    ll[256] = 1;
+    for (unsigned len = 3; len <= 258; len++)
+        if (h->len[len]) {
+            int c = len_code(len);
+            ll[257 + c] += h->len[len];
+            extra += h->len[len] * lext[c];
+        }
+    for (int c = 0; c < 30; c++)
+        extra += h->dist[c] * dext[c];
+    return 3 + hdr + shannon(ll, 286) + shannon(h->dist, 30) + extra;
+}
+
+// Walk the blocks of in[0..len-1], classifying them into g. Return NULL, or
+// what went wrong with g->at set to where.
+static const char *walk(const unsigned char *in, size_t len, int mode,
+                        diag *g) {
+    dfl_hist *h = malloc(sizeof(dfl_hist));
+    if (h == NULL)
+        return "out of memory";
+    uint64_t dyn = 0, dyn_bits = 0, pos = 0;
+    size_t nfix = 0, room = 0;
+    struct fix { double fixed, dynamic; } *fix = NULL;
+    const char *why = NULL;
+    while (why == NULL && pos < len) {
+        uint64_t start = 0, hdrlen = 0;
+        gz_hdr hd;
+        if (mode == GZIP) {
+            if (gz_header_parse(in + pos, len - pos, &hd) <= 0) {
+                why = "invalid gzip header";
+                break;
+            }
+            start = pos + hd.hdrlen;
+            hdrlen = hd.hdrlen;
+        }
+        else if (mode == ZLIB)
+            start = 2;
+        dfl d;
+        if (dfl_init(&d, in, len, 8 * start, NULL, 0, 0) < 0) {
+            why = "out of memory";
+            break;
+        }
+        d.hist = h;
+        int ret;
+        do {
+            uint64_t bit = d.pos, made = d.total;
+            memset(h, 0, sizeof(dfl_hist));
+            ret = dfl_block(&d);
+            if (ret < 0)
+                break;
+            uint64_t n = d.total - made, used = d.pos - bit;
+            if (d.type == 0 && n == 0 && !d.final) {
+                g->count[SYNC]++;
+                g->waste[SYNC] += used / 8.0;
+            }
+            else if (d.type == 1 && n) {
+                // Whether it would be smaller dynamic is settled at the end,
+                // once the usual header size is known.
+                if (nfix == room) {
+                    room = room ? 2 * room : 16;
+                    struct fix *f = realloc(fix, room * sizeof(struct fix));
+                    if (f == NULL) {
+                        why = "out of memory";
+                        break;
+                    }
+                    fix = f;
+                }
+                fix[nfix].fixed = used;
+                fix[nfix++].dynamic = dynamic_bits(h, 0);
+            }
+            else if (d.type == 2) {
+                dyn++;
+                dyn_bits += d.header_bits;
+                if (n < TINY && !d.final) {
+                    g->count[TINYDYN]++;
+                    g->waste[TINYDYN] += d.header_bits / 8.0;
+                }
+            }
+        } while (ret == DFL_OK);
+        g->blocks += d.blocks;
+        g->out += d.total;
+        uint64_t t = (d.pos + 7) >> 3, made = d.total;
+        if (why == NULL && ret != DFL_END)
+            why = d.msg != NULL ? d.msg : "unexpected end of data";
+        else if (why == NULL && t + (mode == GZIP ? 8 : mode == ZLIB ? 4 : 0) > len)
+            why = "missing trailer";
+        dfl_free(&d);
+        if (why != NULL) {
+            pos = d.pos >> 3;
+            break;
+        }
+        g->members++;
+        if (mode == GZIP && made < SMALL) {
+            g->count[MEMBERS]++;
+            g->waste[MEMBERS] += hdrlen + 8;
+        }
+        pos = t + (mode == GZIP ? 8 : mode == ZLIB ? 4 : 0);
+        if (mode != GZIP)
+            break;
+    }
+    if (g->members < 2) {
+        // One small member is just a small file.
+        g->count[MEMBERS] = 0;
+        g->waste[MEMBERS] = 0;
+    }
+    double hdr = dyn ? (double)dyn_bits / dyn : HEADER;
+    for (size_t i = 0; why == NULL && i < nfix; i++) {
+        double save = fix[i].fixed - fix[i].dynamic - hdr;
+        if (save > 0) {
+            g->count[FIXED]++;
+            g->waste[FIXED] += save / 8;
+        }
+    }
+    free(fix);
+    free(h);
+    g->at = pos;
+    return why;
+}
+
+// Inflate in[0..len-1] of the given mode, member after member, into
+// out[0..room-1] until it is full or the data ends. Return the CPU time it
+// took, with the bytes made in *got, or -1 on error.
+static double inflate_time(const unsigned char *in, size_t len, int mode,
+                           unsigned char *out, size_t room, size_t *got) {
+    z_stream strm = {0};
+    if (inflateInit2(&strm, mode) != Z_OK)
+        return -1;
+    double start = cpu_now();
+    strm.next_in = (unsigned char *)in;
+    strm.avail_in = len;
+    strm.next_out = out;
+    strm.avail_out = room;
+    int ret;
+    do {
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END && mode == GZIP && strm.avail_in &&
+            strm.avail_out)
+            ret = inflateReset(&strm);
+    } while (ret == Z_OK && strm.avail_out && strm.avail_in);
+    double t = cpu_now() - start;
+    *got = room - strm.avail_out;
+    inflateEnd(&strm);
+    return ret == Z_OK || ret == Z_STREAM_END ? t : -1;
+}
+
+// Time a prefix of the file against the same data as one level 6 stream,
+// alternating between the two and keeping the fastest run of each.
+static const char *measure(const unsigned char *in, size_t len, int mode,
+                           diag *g) {
+    size_t room = g->out < PREFIX ? g->out : PREFIX, got, back;
+    unsigned char *out = malloc(room + 1), *again = malloc(room + 1);
+    size_t zroom = deflateBound(NULL, room) + 32, zlen = 0;
+    unsigned char *z = malloc(zroom);
+    if (out == NULL || again == NULL || z == NULL) {
+        free(out);
+        free(again);
+        free(z);
+        return "out of memory";
+    }
+    const char *why = NULL;
+    double have = inflate_time(in, len, mode, out, room, &got), ref = -1;
+    if (have < 0)
+        why = "compressed data error";
+    else {
+        z_stream strm = {0};
+        if (deflateInit2(&strm, 6, Z_DEFLATED, GZIP, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            why = "out of memory";
+        else {
+            strm.next_in = out;
+            strm.avail_in = got;
+            strm.next_out = z;
+            strm.avail_out = zroom;
+            if (deflate(&strm, Z_FINISH) != Z_STREAM_END)
+                why = "could not recompress";
+            zlen = zroom - strm.avail_out;
+            deflateEnd(&strm);
+        }
+    }
+    for (int run = 0; why == NULL && run < RUNS; run++) {
+        size_t n;
+        double t = inflate_time(in, len, mode, again, got, &n);
+        have = run == 0 || t < have ? t : have;
+        t = inflate_time(z, zlen, GZIP, again, got, &back);
+        ref = run == 0 || t < ref ? t : ref;
+        if (back != got)
+            why = "could not recompress";
+    }
+    if (why == NULL && ref > 0) {
+        g->slow = have / ref - 1;
+        g->lost = got ? (have - ref) * ((double)g->out / got) : 0;
+    }
+    free(out);
+    free(again);
+    free(z);
+    return why;
+}
+
+static void diagnose_job(void *ctx, size_t i) {
+    diag *g = (diag *)ctx + i;
+    struct stat st;
+    int fd = open(g->name, O_RDONLY);
+    g->at = UINT64_MAX;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        g->why = "could not open";
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    size_t len = st.st_size;
+    const unsigned char *in = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (in == MAP_FAILED) {
+        g->why = "could not read";
+        return;
+    }
+    g->size = len;
+    int mode = detect_mode(in, len);
+    if (mode == PLAIN)
+        mode = RAW;
+    g->why = walk(in, len, mode, g);
+    if (g->why == NULL) {
+        g->at = UINT64_MAX;
+        g->why = measure(in, len, mode, g);
+    }
+    munmap((void *)in, len);
+}
+
+static double waste(const diag *g) {
+    double w = 0;
+    for (int k = 0; k < KINDS; k++)
+        w += g->waste[k];
+    return w;
+}
+
+static int by_lost(const void *a, const void *b) {
+    const diag *x = *(const diag *const *)a, *y = *(const diag *const *)b;
+    return x->lost < y->lost ? 1 : x->lost > y->lost ? -1 :
+           waste(x) < waste(y) ? 1 : waste(x) > waste(y) ? -1 : 0;
+}
+
+int cmd_diagnose(int argc, char **argv) {
+    int threads = 0, opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1)
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind < 1) {
+        fprintf(stderr, "usage: gzinfo diagnose [-j threads] file...\n");
+        return 1;
+    }
+    for (int i = optind; i < argc; i++)
+        if (vol_single(argv[i]) < 0)
+            return 1;
+    size_t n = argc - optind;
+    diag *g = calloc(n, sizeof(diag));
+    const diag **rank = calloc(n, sizeof(diag *));
+    if (g == NULL || rank == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        free(g);
+        free(rank);
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++)
+        g[i].name = argv[optind + i];
+    pool_run(threads, n, diagnose_job, g);
+
+    int ret = 0;
+    size_t good = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (g[i].why != NULL) {
+            fflush(stdout);
+            if (g[i].size == 0)
+                fprintf(stderr, "gzinfo: %s %s\n", g[i].why, g[i].name);
+            else if (g[i].at == UINT64_MAX)
+                fprintf(stderr, "gzinfo: %s in %s\n", g[i].why, g[i].name);
+            else
+                fprintf(stderr, "gzinfo: %s at %llu in %s\n", g[i].why,
+                        (unsigned long long)g[i].at, g[i].name);
+            ret = 1;
+            continue;
+        }
+        rank[good++] = g + i;
+        printf("%s: %s", g[i].name, humanSize(g[i].size));
+        printf(", %s uncompressed, %llu blocks in %llu member%s\n",
+               humanSize(g[i].out), (unsigned long long)g[i].blocks,
+               (unsigned long long)g[i].members, g[i].members == 1 ? "" : "s");
+        int found = 0;
+        for (int k = 0; k < KINDS; k++)
+            if (g[i].count[k]) {
+                printf("  %-20s %10llu %14s %6.1f%%\n", kinds[k],
+                       (unsigned long long)g[i].count[k],
+                       humanSize(g[i].waste[k]),
+                       100 * g[i].waste[k] / g[i].size);
+                found = 1;
+            }
+        if (!found)
+            printf("  no pathologies found\n");
+        printf("  overhead %s (%.1f%%)", humanSize(waste(g + i)),
+               100 * waste(g + i) / g[i].size);
+        printf(", decoding %.1f%% %s than one level 6 stream\n",
+               fabs(100 * g[i].slow), g[i].slow < 0 ? "faster" : "slower");
+    }
+
+    if (good > 1) {
+        qsort(rank, good, sizeof(diag *), by_lost);
+        printf("\nRanking (by decoding time lost per full read):\n");
+        printf("%4s %12s %9s %14s  %s\n", "rank", "lost ms", "slower",
+               "overhead", "file");
+        for (size_t i = 0; i < good; i++)
+            printf("%4zu %12.1f %8.1f%% %14s  %s\n", i + 1,
+                   1e3 * rank[i]->lost, 100 * rank[i]->slow,
+                   humanSize(waste(rank[i])), rank[i]->name);
+    }
+    free(g);
+    free(rank);
+    return ret;
+}
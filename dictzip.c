@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// dictzip and idzip random access. Each member header carries an "RA" extra
+// subfield: version 1, the uncompressed chunk length, the chunk count, and
+// the compressed size of every chunk. The compressor flushes at each chunk
+// boundary, so every chunk inflates on its own with no window. dictzip files
+// are one such member; idzip files are a sequence of them. The tables give
+// the layout of the whole file without inflating anything.
+
+typedef struct {
+    uint64_t coff;              // compressed offset
+    uint32_t clen;              // compressed length
+    uint64_t uoff;              // uncompressed offset
+    uint32_t ulen;              // uncompressed length
+    int last;                   // the member's last chunk
+    uLong crc;                  // found by verification
+    int ret;
+} dz_chunk;
+
+typedef struct {
+    uint64_t off, len;          // header to trailer
+    uint32_t crc, isize;        // trailer
+    size_t first, count;        // its chunks
+    unsigned chlen;
+} dz_member;
+
+struct dz {
+    int fd;
+    dz_chunk *c;
+    size_t nc, maxc;
+    dz_member *m;
+    size_t nm, maxm;
+};
+
+// Build the chunk map from the member headers. Return 0, or -1 with a message
+// in *why if the file is not all dictzip members.
+static int dz_map(struct dz *z, uint64_t size, const char **why) {
+    unsigned char *hdr = malloc(1U << 17), trl[8];
+    uint64_t off = 0, uoff = 0;
+    if (hdr == NULL) {
+        *why = "out of memory";
+        return -1;
+    }
+    *why = NULL;
+    while (off < size && *why == NULL) {
+        size_t want = size - off < (1U << 17) ? size - off : (1U << 17);
+        gz_hdr h;
+        unsigned len;
+        const unsigned char *ra;
+        if (pread_full(z->fd, hdr, want, off) < 0 ||
+            gz_header_parse(hdr, want, &h) <= 0) {
+            *why = "not a gzip member";
+            break;
+        }
+        if ((ra = gz_extra_find(&h, 'R', 'A', &len)) == NULL || len < 6 ||
+            (ra[0] | (ra[1] << 8)) != 1) {
+            *why = "no version 1 RA chunk table";
+            break;
+        }
+        unsigned chlen = ra[2] | (ra[3] << 8), count = ra[4] | (ra[5] << 8);
+        if (chlen == 0 || len < 6 + 2 * (size_t)count) {
+            *why = "malformed RA chunk table";
+            break;
+        }
+
+        // Lay out the chunks, then check that the trailer follows them.
+        uint64_t at = off + h.hdrlen;
+        for (unsigned i = 0; i < count; i++)
+            at += ra[6 + 2 * i] | (ra[7 + 2 * i] << 8);
+        if (at + 8 > size || pread_full(z->fd, trl, 8, at) < 0) {
+            *why = "chunk table runs past the end of the file";
+            break;
+        }
+        uint32_t isize = le32(trl + 4);
+        if (count == 0 ? isize != 0 : isize <= (uint64_t)(count - 1) * chlen ||
+                                      isize > (uint64_t)count * chlen) {
+            *why = "chunk table does not match the member's ISIZE";
+            break;
+        }
+        if (z->nm == z->maxm) {
+            z->maxm = z->maxm ? z->maxm << 1 : 16;
+            dz_member *more = realloc(z->m, z->maxm * sizeof(dz_member));
+            if (more == NULL) {
+                *why = "out of memory";
+                break;
+            }
+            z->m = more;
+        }
+        if (z->nc + count > z->maxc) {
+            while (z->nc + count > z->maxc)
+                z->maxc = z->maxc ? z->maxc << 1 : 1024;
+            dz_chunk *more = realloc(z->c, z->maxc * sizeof(dz_chunk));
+            if (more == NULL) {
+                *why = "out of memory";
+                break;
+            }
+            z->c = more;
+        }
+        dz_member *m = z->m + z->nm++;
+        m->off = off;
+        m->len = at + 8 - off;
+        m->crc = le32(trl);
+        m->isize = isize;
+        m->first = z->nc;
+        m->count = count;
+        m->chlen = chlen;
+        at = off + h.hdrlen;
+        for (unsigned i = 0; i < count; i++) {
+            dz_chunk *c = z->c + z->nc++;
+            c->coff = at;
+            c->clen = ra[6 + 2 * i] | (ra[7 + 2 * i] << 8);
+            c->uoff = uoff;
+            c->ulen = i + 1 < count ? chlen : isize - (count - 1) * chlen;
+            c->last = i + 1 == count;
+            c->ret = Z_OK;
+            at += c->clen;
+            uoff += c->ulen;
+        }
+        off += m->len;
+    }
+    free(hdr);
+    return *why == NULL ? 0 : -1;
+}
+
+// Inflate chunk c into out, which has room for c->ulen bytes. Return Z_OK,
+// or a zlib error if it is damaged or its length is wrong.
+static int dz_inflate(int fd, const dz_chunk *c, unsigned char *in,
+                      unsigned char *out) {
+    if (pread_full(fd, in, c->clen, c->coff) < 0)
+        return Z_ERRNO;
+    z_stream strm = {0};
+    int ret = inflateInit2(&strm, RAW);
+    if (ret != Z_OK)
+        return ret;
+    strm.next_in = in;
+    strm.avail_in = c->clen;
+    strm.next_out = out;
+    strm.avail_out = c->ulen;
+    ret = inflate(&strm, Z_SYNC_FLUSH);
+    // All but the last chunk end on a flush, the last on the final block.
+    if (c->last ? ret != Z_STREAM_END : ret != Z_OK && ret != Z_BUF_ERROR)
+        ret = ret == Z_NEED_DICT || ret >= 0 ? Z_DATA_ERROR : ret;
+    else if (strm.avail_in || strm.avail_out)
+        ret = Z_DATA_ERROR;
+    else
+        ret = Z_OK;
+    inflateEnd(&strm);
+    return ret;
+}
+
+static void dz_job(void *ctx, size_t i) {
+    struct dz *z = ctx;
+    dz_chunk *c = z->c + i;
+    unsigned char *in = malloc(65536 + (size_t)c->ulen + 1);
+    if (in == NULL) {
+        c->ret = Z_MEM_ERROR;
+        return;
+    }
+    c->ret = dz_inflate(z->fd, c, in, in + 65536);
+    c->crc = crc32(0, in + 65536, c->ulen);
+    free(in);
+}
+
+// Write the uncompressed bytes [off, off + len) to out, inflating only the
+// chunks that hold them. Return 0 or -1 on an error.
+static int dz_extract(struct dz *z, uint64_t off, uint64_t len, FILE *out) {
+    size_t lo = 0, hi = z->nc;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (z->c[mid].uoff <= off)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    uint64_t end = off + len;
+    for (size_t i = lo; i < z->nc && z->c[i].uoff < end; i++) {
+        dz_chunk *c = z->c + i;
+        if (c->ulen == 0)
+            continue;
+        unsigned char *in = malloc(65536 + (size_t)c->ulen);
+        if (in == NULL || dz_inflate(z->fd, c, in, in + 65536) != Z_OK) {
+            fprintf(stderr, "gzinfo: chunk at %llu is damaged\n",
+                    (unsigned long long)c->coff);
+            free(in);
+            return -1;
+        }
+        uint64_t a = off > c->uoff ? off - c->uoff : 0;
+        uint64_t b = end - c->uoff < c->ulen ? end - c->uoff : c->ulen;
+        size_t n = b - a;
+        if (fwrite(in + 65536 + a, 1, n, out) != n) {
+            free(in);
+            return -1;
+        }
+        free(in);
+    }
+    return 0;
+}
+
+int cmd_dictzip(int argc, char **argv) {
+    int threads = 0, map_only = 0, opt;
+    char *range = NULL, *save = NULL;
+    while ((opt = getopt(argc, argv, "nr:o:j:")) != -1)
+        switch (opt) {
+        case 'n':
+            map_only = 1;
+            break;
+        case 'r':
+            range = optarg;
+            break;
+        case 'o':
+            save = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    uint64_t roff = 0, rlen = 0;
+    char *end = range;
+    if (range != NULL) {
+        roff = strtoull(range, &end, 0);
+        if (*end == ':')
+            rlen = strtoull(end + 1, &end, 0);
+    }
+    if (argc - optind != 1 || (range != NULL && (*end || rlen == 0))) {
+        fprintf(stderr, "usage: gzinfo dictzip [-n] [-j threads] file\n"
+                        "       gzinfo dictzip -r offset:length [-o out] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    struct dz z = {open(name, O_RDONLY), NULL, 0, 0, NULL, 0, 0};
+    struct stat st;
+    if (z.fd < 0 || fstat(z.fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (z.fd >= 0)
+            close(z.fd);
+        return 1;
+    }
+    const char *why;
+    if (dz_map(&z, st.st_size, &why) < 0) {
+        fprintf(stderr, "gzinfo: %s is not dictzip or idzip: %s at member %zu\n",
+                name, why, z.nm);
+        close(z.fd);
+        free(z.c);
+        free(z.m);
+        return 1;
+    }
+    uint64_t total = z.nc ? z.c[z.nc - 1].uoff + z.c[z.nc - 1].ulen : 0;
+
+    int ret = 0;
+    if (range != NULL) {
+        FILE *out = save == NULL ? stdout : fopen(save, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "gzinfo: could not open %s for writing\n", save);
+            ret = 1;
+        }
+        else if (roff > total || rlen > total - roff) {
+            fprintf(stderr, "gzinfo: range is past the end (%llu bytes)\n",
+                    (unsigned long long)total);
+            ret = 1;
+        }
+        else if (dz_extract(&z, roff, rlen, out) < 0)
+            ret = 1;
+        if (out != NULL && out != stdout && fclose(out) != 0) {
+            fprintf(stderr, "gzinfo: write error on %s\n", save);
+            ret = 1;
+        }
+    }
+    else {
+        printf("Format: %s\n", z.nm == 1 ? "dictzip" : "idzip");
+        printf("Members: %zu\n", z.nm);
+        printf("Chunks: %zu of %s\n", z.nc, humanSize(z.nm ? z.m[0].chlen : 0));
+        printf("Compressed Size: %s\n", humanSize(st.st_size));
+        printf("Uncompressed Size: %s", humanSize(total));
+        printf(" (%llu bytes, from the chunk tables)\n", (unsigned long long)total);
+        if (!map_only) {
+            // Verify the chunks independently, then combine their CRCs into
+            // each member's for the trailer check.
+            pool_run(threads, z.nc, dz_job, &z);
+            long failed = 0;
+            for (size_t i = 0; i < z.nm; i++) {
+                dz_member *m = z.m + i;
+                uLong crc = crc32(0, NULL, 0);
+                int bad = 0;
+                for (size_t k = m->first; k < m->first + m->count; k++) {
+                    dz_chunk *c = z.c + k;
+                    if (c->ret != Z_OK) {
+                        printf("FAILED: chunk %zu at %llu: %s\n", k - m->first,
+                               (unsigned long long)c->coff,
+                               c->ret == Z_ERRNO ? "read error" : "corrupt data");
+                        bad = 1;
+                    }
+                    crc = crc32_combine(crc, c->crc, c->ulen);
+                }
+                if (!bad && crc != m->crc) {
+                    printf("FAILED: member at %llu: CRC mismatch\n",
+                           (unsigned long long)m->off);
+                    bad = 1;
+                }
+                failed += bad;
+            }
+            printf("Failed Members: %ld\n", failed);
+            ret = failed != 0;
+        }
+    }
+    close(z.fd);
+    free(z.c);
+    free(z.m);
+    return ret;
+}
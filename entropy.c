@@ -0,0 +1,345 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "gzinfo.h"
+
+// Order-0 entropy of the uncompressed data, per span and for the whole file,
+// next to the ratio deflate achieved there. Each window that comes out of
+// verify_gzip() is copied to a ring of buffers, and a second thread counts
+// the bytes from there, so that counting overlaps inflating instead of adding
+// to it. Blocks of one repeated byte are found with a vector compare and
+// counted at once, and the rest go to eight interleaved tables, so that
+// nearby equal bytes don't stall on one counter. The tables are folded
+// together at the end of each span. Where deflate does little better than the
+// entropy, it is finding few matches and a coder with more context would do
+// better. Where the entropy is near eight bits, nothing will. With one CPU the
+// bytes are counted in line, as handing them over would only cost.
+
+#define TABLES 8
+#define FOLD (1U << 30)             // bytes before the 32-bit counts fold
+#define RING 16                     // buffers between the threads
+
+struct ent {
+    uint64_t span;
+
+    // Handed from the inflating thread to the counting thread.
+    pthread_mutex_t lock;
+    pthread_cond_t more, room;
+    unsigned char (*buf)[WINSIZE];
+    size_t len[RING];
+    uint64_t head, tail;            // buffers filled and counted
+    int done, running;
+    pthread_t counter;
+
+    // Used by the counting thread only, once running.
+    uint32_t t[TABLES][256];        // counts since the last fold
+    uint64_t h[256];                // the current span
+    uint64_t all[256];              // the whole file
+    uint64_t out;                   // bytes counted
+    uint32_t pend;                  // bytes in t
+    gz_spans bits;                  // entropy of each span
+    int lost;                       // out of memory for bits
+
+    // Used by the inflating thread only.
+    uint64_t pin, pout;             // the last point, in bits and bytes
+    gz_spans in;                    // compressed bytes of each span
+    int err;
+};
+
+// Count the eight bytes in w into t, one table each.
+static inline void count8(uint32_t t[TABLES][256], uint64_t w) {
+    t[0][w & 0xff]++;
+    t[1][(w >> 8) & 0xff]++;
+    t[2][(w >> 16) & 0xff]++;
+    t[3][(w >> 24) & 0xff]++;
+    t[4][(w >> 32) & 0xff]++;
+    t[5][(w >> 40) & 0xff]++;
+    t[6][(w >> 48) & 0xff]++;
+    t[7][w >> 56]++;
+}
+
+// Count the bytes p[0..n-1] into t. A vector compare first checks whether a
+// block is one byte repeated, as in runs of zeros or spaces, which is then
+// counted with a single add. Other blocks are counted eight bytes at a time.
+static void count(uint32_t t[TABLES][256], const unsigned char *p, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(p[i])))
+            == -1) {
+            t[0][p[i]] += 32;
+            continue;
+        }
+        uint64_t w[4];
+        memcpy(w, p + i, 32);
+        count8(t, w[0]);
+        count8(t, w[1]);
+        count8(t, w[2]);
+        count8(t, w[3]);
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(p[i]))) ==
+            0xffff) {
+            t[0][p[i]] += 16;
+            continue;
+        }
+        uint64_t w[2];
+        memcpy(w, p + i, 16);
+        count8(t, w[0]);
+        count8(t, w[1]);
+    }
+#endif
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        count8(t, w);
+    }
+    for (; i < n; i++)
+        t[i & 7][p[i]]++;
+}
+
+static void fold(struct ent *e) {
+    for (int k = 0; k < 256; k++)
+        for (int j = 0; j < TABLES; j++) {
+            e->h[k] += e->t[j][k];
+            e->t[j][k] = 0;
+        }
+    e->pend = 0;
+}
+
+static double entropy(const uint64_t *h) {
+    uint64_t n = 0;
+    for (int k = 0; k < 256; k++)
+        n += h[k];
+    double bits = 0;
+    for (int k = 0; k < 256; k++)
+        if (h[k])
+            bits -= h[k] * log2((double)h[k] / n);
+    return n ? bits / n : 0;
+}
+
+// Close the span that ends at the bytes counted so far.
+static void close_span(struct ent *e) {
+    uint64_t i = (e->out - 1) / e->span;
+    fold(e);
+    if (spans_reach(&e->bits, i) == 0)
+        e->bits.v[i] = entropy(e->h);
+    else
+        e->lost = 1;
+    for (int k = 0; k < 256; k++) {
+        e->all[k] += e->h[k];
+        e->h[k] = 0;
+    }
+}
+
+static void tally(struct ent *e, const unsigned char *data, size_t len) {
+    while (len) {
+        uint64_t left = e->span - e->out % e->span;
+        size_t n = left < len ? left : len;
+        if (n > FOLD - e->pend)
+            n = FOLD - e->pend;
+        count(e->t, data, n);
+        e->pend += n;
+        e->out += n;
+        data += n;
+        len -= n;
+        if (e->out % e->span == 0)
+            close_span(e);
+        else if (e->pend == FOLD)
+            fold(e);
+    }
+}
+
+static void *counter(void *arg) {
+    struct ent *e = arg;
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (e->tail == e->head && !e->done)
+            pthread_cond_wait(&e->more, &e->lock);
+        if (e->tail == e->head)
+            break;
+        size_t k = e->tail % RING;
+        pthread_mutex_unlock(&e->lock);
+        tally(e, e->buf[k], e->len[k]);
+        pthread_mutex_lock(&e->lock);
+        e->tail++;
+        pthread_cond_signal(&e->room);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+static void ent_window(void *ctx, const unsigned char *data, size_t len) {
+    struct ent *e = ctx;
+    if (!e->running) {
+        tally(e, data, len);
+        return;
+    }
+    while (len) {
+        pthread_mutex_lock(&e->lock);
+        while (e->head - e->tail == RING)
+            pthread_cond_wait(&e->room, &e->lock);
+        pthread_mutex_unlock(&e->lock);
+        size_t k = e->head % RING, n = len < WINSIZE ? len : WINSIZE;
+        memcpy(e->buf[k], data, n);
+        e->len[k] = n;
+        pthread_mutex_lock(&e->lock);
+        e->head++;
+        pthread_cond_signal(&e->more);
+        pthread_mutex_unlock(&e->lock);
+        data += n;
+        len -= n;
+    }
+}
+
+// Share the compressed bits since the last point over the spans they made.
+static void ent_point(void *ctx, uint64_t in, int bits, uint64_t out,
+                      const unsigned char *win, unsigned pos) {
+    struct ent *e = ctx;
+    uint64_t bit = 8 * in - bits;
+    (void)win;
+    (void)pos;
+    if (spans_share(&e->in, e->span, e->pout, out, (bit - e->pin) / 8.0) < 0)
+        e->err = 1;
+    e->pin = bit;
+    e->pout = out;
+}
+
+// Wait for the counting thread to finish what it has.
+static void ent_stop(struct ent *e) {
+    if (e->running) {
+        pthread_mutex_lock(&e->lock);
+        e->done = 1;
+        pthread_cond_signal(&e->more);
+        pthread_mutex_unlock(&e->lock);
+        pthread_join(e->counter, NULL);
+        e->running = 0;
+    }
+    pthread_mutex_destroy(&e->lock);
+    pthread_cond_destroy(&e->more);
+    pthread_cond_destroy(&e->room);
+}
+
+static void ent_free(struct ent *e) {
+    free(e->buf);
+    free(e->bits.v);
+    free(e->in.v);
+    free(e);
+}
+
+int cmd_entropy(int argc, char **argv) {
+    int csv = 0, opt;
+    uint64_t span = SPAN;
+    while ((opt = getopt(argc, argv, "s:c")) != -1)
+        switch (opt) {
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            csv = 1;
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1 || span == 0) {
+        fprintf(stderr, "usage: gzinfo entropy [-s span] [-c] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    struct ent *e = calloc(1, sizeof(struct ent));
+    if (e == NULL || (e->buf = malloc(RING * sizeof(*e->buf))) == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        free(e);
+        return 1;
+    }
+    e->span = span;
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->more, NULL);
+    pthread_cond_init(&e->room, NULL);
+    e->running = pool_threads(0) > 1 &&
+                 pthread_create(&e->counter, NULL, counter, e) == 0;
+    verify_hooks hooks = {ent_window, ent_point, e};
+    int ret = verify_gzip(name, &hooks);
+    ent_stop(e);
+    if (ret == Z_OK) {
+        // The last block of each stream and the trailer come after the last
+        // point, and the last span may be short.
+        ent_point(e, compressed_size, 0, uncompressed_size, NULL, 0);
+        if (e->out % span)
+            close_span(e);
+        if (e->in.n && spans_reach(&e->bits, e->in.n - 1) < 0)
+            e->lost = 1;
+        if (e->err || e->lost) {
+            fprintf(stderr, "gzinfo: out of memory\n");
+            ret = Z_MEM_ERROR;
+        }
+    }
+    if (ret != Z_OK) {
+        ent_free(e);
+        return 1;
+    }
+
+    size_t n = e->in.n;
+    if (csv) {
+        printf("offset,uncompressed,compressed,ratio,entropy\n");
+        for (size_t i = 0; i < n; i++) {
+            uint64_t u = i + 1 < n ? span : uncompressed_size - i * span;
+            printf("%llu,%llu,%.0f,%.4f,%.4f\n",
+                   (unsigned long long)(i * span), (unsigned long long)u,
+                   e->in.v[i], u ? e->in.v[i] / u : 0.0, e->bits.v[i]);
+        }
+        ent_free(e);
+        return 0;
+    }
+
+    print_gzip_info();
+    double bits = entropy(e->all);
+    double ratio = uncompressed_size ? (double)compressed_size /
+                                       uncompressed_size : 0;
+    int distinct = 0;
+    for (int k = 0; k < 256; k++)
+        distinct += e->all[k] != 0;
+    printf("\nByte Entropy: %.3f bits per byte (order-0 bound %.1f%%)\n", bits,
+           100 * bits / 8);
+    printf("Deflate Ratio: %.1f%% (%.3f bits per byte)\n", 100 * ratio,
+           8 * ratio);
+    printf("Distinct Byte Values: %d\n", distinct);
+    printf("Most Frequent Bytes:");
+    unsigned char seen[256] = {0};
+    for (int j = 0; j < 8; j++) {
+        int best = -1;
+        for (int k = 0; k < 256; k++)
+            if (!seen[k] && e->all[k] &&
+                (best < 0 || e->all[k] > e->all[best]))
+                best = k;
+        if (best < 0)
+            break;
+        seen[best] = 1;
+        double p = uncompressed_size ? 100.0 * e->all[best] /
+                                       uncompressed_size : 0;
+        if (best > ' ' && best < 127)
+            printf(" '%c' %.1f%%", best, p);
+        else
+            printf(" 0x%02x %.1f%%", best, p);
+    }
+    printf("\n\nSpans of %s:\n", humanSize(span));
+    printf("%14s %9s %9s %9s\n", "offset", "entropy", "order-0", "deflate");
+    for (size_t i = 0; i < n; i++) {
+        uint64_t u = i + 1 < n ? span : uncompressed_size - i * span;
+        printf("%14llu %9.3f %8.1f%% %8.1f%%\n",
+               (unsigned long long)(i * span), e->bits.v[i],
+               100 * e->bits.v[i] / 8, u ? 100 * e->in.v[i] / u : 0.0);
+    }
+    ent_free(e);
+    return 0;
+}
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Uncompressed size estimation for files too large to decompress. The
+// deflate payload is split into equal strata and a random point is picked in
+// each. From there the block-start finder locates the next deflate block,
+// and whole blocks are decoded without the preceding window -- back-references
+// into the unknown past still produce the right number of bytes. The ratio of
+// uncompressed to compressed bytes over the samples gives the estimate, and
+// its spread across samples gives a confidence interval.
+
+#define SEARCH (256U << 10)     // how far to look for a block start
+#define SLACK (256U << 10)      // room for the block that straddles the end
+
+// Two-sided 95% Student t quantiles for 1..30 degrees of freedom.
+static const double t95[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+
+struct sample {
+    uint64_t off;               // where the search started
+    uint64_t c;                 // compressed bits in whole decoded blocks
+    uint64_t u;                 // uncompressed bytes from those blocks
+    uint64_t unknown;           // of which copied from before the sample
+    uint64_t read;              // bytes read
+    int ok;
+};
+
+struct estimate {
+    int fd;
+    uint64_t end;               // end of the deflate payload
+    size_t want;                // compressed bytes to decode per sample
+    struct sample *s;
+};
+
+static void sample_job(void *ctx, size_t i) {
+    struct estimate *e = ctx;
+    struct sample *s = e->s + i;
+    size_t len = SEARCH + e->want + SLACK;
+    if (len > e->end - s->off)
+        len = e->end - s->off;
+    unsigned char *buf = malloc(len);
+    if (buf == NULL || pread_full(e->fd, buf, len, s->off) < 0) {
+        free(buf);
+        return;
+    }
+    s->read = len;
+
+    int64_t start = dfl_find_block(buf, len, 0, 8 * (uint64_t)SEARCH);
+    dfl d;
+    if (start >= 0 && dfl_init(&d, buf, len, start, NULL, 0, 1) == 0) {
+        // Count only whole blocks, stopping once enough has been decoded.
+        int ret;
+        while (d.pos - start < 8 * (uint64_t)e->want &&
+               (ret = dfl_block(&d)) >= 0) {
+            s->c = d.pos - start;
+            s->u = d.total;
+            s->unknown = d.unknown;
+            if (ret == DFL_END)
+                break;
+        }
+        s->ok = s->c > 0;
+        dfl_free(&d);
+    }
+    free(buf);
+}
+
+// Estimate from pairs (c_i bits, u_i bytes) with the ratio estimator. Set
+// *ratio to uncompressed bytes per compressed byte and return the 95%
+// half-width of the ratio, or -1 if there are too few samples.
+static double ratio_bound(const struct sample *s, size_t n, double *ratio) {
+    double sc = 0, su = 0, ss = 0;
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++)
+        if (s[i].ok) {
+            sc += s[i].c / 8.0;
+            su += s[i].u;
+            k++;
+        }
+    *ratio = sc > 0 ? su / sc : 0;
+    if (k < 2)
+        return -1;
+    for (size_t i = 0; i < n; i++)
+        if (s[i].ok) {
+            double r = s[i].u - *ratio * (s[i].c / 8.0);
+            ss += r * r;
+        }
+    double se = sqrt(ss / (k - 1) / k) / (sc / k);
+    return (k - 1 <= 30 ? t95[k - 2] : 1.96) * se;
+}
+
+static void print_estimate(uint64_t csize, uint64_t payload, double ratio,
+                           double bound, int have_isize, uint32_t isize) {
+    double est = ratio * payload, err = bound * payload;
+    printf("Compressed Size: %s\n", humanSize(csize));
+    printf("Estimated Uncompressed Size: %s", humanSize(est));
+    printf(" (%.0f bytes)\n", est);
+    if (bound < 0)
+        printf("Error Bound: unknown (too few samples)\n");
+    else {
+        printf("Error Bound (95%%): +/- %s", humanSize(err));
+        printf(" (%.2f%%)\n", est > 0 ? 100 * err / est : 0.0);
+    }
+    printf("Estimated Ratio: %.3f\n", ratio);
+
+    // The trailer's ISIZE is the size modulo 2^32. If the interval holds
+    // only one such value, that is the exact size.
+    if (have_isize && bound >= 0) {
+        double lo = est - err, hi = est + err;
+        uint64_t k = lo < isize ? 0 : (uint64_t)((lo - isize) / 4294967296.0);
+        uint64_t hit = 0;
+        int hits = 0;
+        for (uint64_t v = isize + (k << 32); v <= hi; v += 1ULL << 32)
+            if (v >= lo) {
+                hit = v;
+                hits++;
+            }
+        if (hits == 1)
+            printf("ISIZE-Consistent Size: %llu bytes\n", (unsigned long long)hit);
+    }
+}
+
+// Prefix-only estimate: decompress the first prefix compressed bytes and
+// treat each deflate block there as a sample. Faster to converge on a
+// uniform file, but blind to anything that changes after the prefix.
+static int estimate_prefix(const char *name, int mode, uint64_t start,
+                           uint64_t payload, uint64_t csize, uint64_t prefix,
+                           int have_isize, uint32_t isize) {
+    FILE *in = fopen(name, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        return 1;
+    }
+    z_stream strm = {0};
+    unsigned char buf[CHUNK], win[WINSIZE];
+    int ret = inflateInit2(&strm, mode);
+    size_t n = 0, max = 0;
+    struct sample *s = NULL;
+    uint64_t totin = 0, totout = 0, lastin = start, lastout = 0;
+    while (ret == Z_OK && totin - strm.avail_in < start + prefix) {
+        if (strm.avail_in == 0) {
+            strm.avail_in = fread(buf, 1, sizeof(buf), in);
+            strm.next_in = buf;
+            totin += strm.avail_in;
+            if (strm.avail_in == 0) {
+                ret = Z_BUF_ERROR;
+                break;
+            }
+        }
+        strm.avail_out = sizeof(win);
+        strm.next_out = win;
+        ret = inflate(&strm, Z_BLOCK);
+        totout += sizeof(win) - strm.avail_out;
+        if ((strm.data_type & 0x80) || ret == Z_STREAM_END) {
+            uint64_t at = totin - strm.avail_in;
+            if (totout > lastout) {
+                if (n == max) {
+                    max = max ? max << 1 : 256;
+                    struct sample *more = realloc(s, max * sizeof(*s));
+                    if (more == NULL) {
+                        ret = Z_MEM_ERROR;
+                        break;
+                    }
+                    s = more;
+                }
+                s[n].c = 8 * (at - lastin);
+                s[n].u = totout - lastout;
+                s[n].ok = 1;
+                n++;
+            }
+            lastin = at;
+            lastout = totout;
+        }
+    }
+    inflateEnd(&strm);
+    fclose(in);
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+        fprintf(stderr, "gzinfo: compressed data error in %s\n", name);
+        free(s);
+        return 1;
+    }
+
+    double ratio, bound = ratio_bound(s, n, &ratio);
+    printf("Method: prefix (%zu blocks in the first %s)\n", n,
+           humanSize(lastin - start));
+    print_estimate(csize, payload, ratio, bound, have_isize, isize);
+    free(s);
+    return 0;
+}
+
+int cmd_estimate(int argc, char **argv) {
+    int threads = 0, samples = 32, opt;
+    size_t want = 256U << 10;
+    uint64_t seed = 1, prefix = 0;
+    while ((opt = getopt(argc, argv, "n:b:s:p:j:")) != -1)
+        switch (opt) {
+        case 'n':
+            samples = atoi(optarg);
+            break;
+        case 'b':
+            want = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            prefix = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1 || samples < 2 || want < 4096) {
+        fprintf(stderr, "usage: gzinfo estimate [-n samples] [-b bytes] "
+                        "[-s seed] [-p prefix] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    unsigned char head[CHUNK];
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    uint64_t csize = st.st_size;
+    size_t got = csize < sizeof(head) ? csize : sizeof(head);
+    if (pread_full(fd, head, got, 0) < 0) {
+        fprintf(stderr, "gzinfo: read error on %s\n", name);
+        close(fd);
+        return 1;
+    }
+
+    // Locate the deflate payload.
+    int mode = detect_mode(head, got), have_isize = 0;
+    uint64_t start = 0, end = csize;
+    uint32_t isize = 0;
+    gz_hdr h;
+    if (mode == GZIP && gz_header_parse(head, got, &h) > 0 && csize >= h.hdrlen + 8) {
+        unsigned char trl[8];
+        start = h.hdrlen;
+        end = csize - 8;
+        if (pread_full(fd, trl, 8, end) == 0) {
+            isize = le32(trl + 4);
+            have_isize = 1;
+        }
+    }
+    else if (mode == ZLIB && csize >= 6) {
+        start = 2;
+        end = csize - 4;
+    }
+    else {
+        printf("%s is not gzip or zlib compressed\n", name);
+        close(fd);
+        return 1;
+    }
+    uint64_t payload = end - start;
+
+    if (prefix) {
+        close(fd);
+        return estimate_prefix(name, mode, start, payload, csize, prefix,
+                               have_isize, isize);
+    }
+
+    // Sampling only pays when it reads a small part of the file.
+    if (payload < 4 * (uint64_t)samples * (SEARCH + want + SLACK)) {
+        close(fd);
+        if (verify_gzip(name, NULL) != Z_OK)
+            return 1;
+        printf("Method: exact (file is small enough to decompress)\n");
+        printf("Compressed Size: %s\n", humanSize(csize));
+        printf("Uncompressed Size: %s", humanSize(uncompressed_size));
+        printf(" (%llu bytes)\n", (unsigned long long)uncompressed_size);
+        printf("Error Bound: 0\n");
+        return 0;
+    }
+
+    struct sample *s = calloc(samples, sizeof(struct sample));
+    if (s == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        close(fd);
+        return 1;
+    }
+    uint64_t x = seed;
+    for (int i = 0; i < samples; i++) {
+        // A reproducible point within each stratum.
+        uint64_t z = splitmix(&x);
+        double u = (i + (z >> 11) * 0x1p-53) / samples;
+        s[i].off = start + (uint64_t)(u * payload);
+    }
+    struct estimate e = {fd, end, want, s};
+    pool_run(threads, samples, sample_job, &e);
+    close(fd);
+
+    uint64_t read = 0, u = 0, unknown = 0;
+    int ok = 0;
+    for (int i = 0; i < samples; i++) {
+        read += s[i].read;
+        ok += s[i].ok;
+        u += s[i].u;
+        unknown += s[i].unknown;
+    }
+    double ratio, bound = ratio_bound(s, samples, &ratio);
+    printf("Method: sampled (%d of %d samples of %s, seed %llu)\n", ok, samples,
+           humanSize(want), (unsigned long long)seed);
+    printf("Bytes Read: %s", humanSize(read));
+    printf(" (%.3f%% of file)\n", 100.0 * read / csize);
+    if (ok == 0) {
+        printf("No deflate blocks found\n");
+        free(s);
+        return 1;
+    }
+    print_estimate(csize, payload, ratio, bound, have_isize, isize);
+    printf("Unresolved Back-Reference Bytes: %.1f%%\n",
+           u ? 100.0 * unknown / u : 0.0);
+    free(s);
+    return 0;
+}
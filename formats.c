@@ -0,0 +1,686 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#endif
+#ifdef HAVE_LZMA
+#  include <lzma.h>
+#endif
+#ifdef HAVE_BZ2
+#  include <bzlib.h>
+#endif
+
+// zstd, xz and bzip2 files, told apart from deflate by their magic bytes. Each
+// format's own metadata gives the sizes without decompressing: the frame
+// headers, or the seek table of a seekable zstd file, the index at the end of
+// each xz stream, and the block signatures and CRCs of bzip2. Those are read
+// without any library. If the format's library was found at build time, the
+// data is then verified in parallel, a zstd frame, an xz block or a bzip2
+// block to each job, which all three allow. A bzip2 block is cut out and
+// given a stream header and trailer of its own to decode it alone.
+
+#define ZSTD_MAGIC 0xfd2fb528
+#define SEEK_MAGIC 0x8f92eab1
+#define SKIP_MAGIC 0x184d2a50       // to 0x184d2a5f
+#define BZ_BLOCK 0x314159265359ULL
+#define BZ_END 0x177245385090ULL
+
+typedef struct {
+    uint64_t off, len;              // compressed bytes
+    uint64_t out;                   // uncompressed size, or UINT64_MAX
+    uint32_t crc;                   // bzip2 block CRC
+    int check;                      // xz check ID
+} unit;
+
+typedef struct {
+    const char *format;
+    const unsigned char *data;
+    uint64_t size;
+    unit *u;
+    size_t n, room;
+    uint64_t streams;
+    uint64_t length;                // total uncompressed, or UINT64_MAX
+    const char *check;              // integrity check, or NULL
+    const char *source;             // where the sizes came from
+    const char *bad;                // what is wrong, or NULL
+    uint64_t bad_at;
+    int verified;                   // -1 no library, 0 failed, 1 passed
+    uint64_t decoded;               // uncompressed bytes seen in verifying
+} info;
+
+static uint64_t le_n(const unsigned char *p, int n) {
+    uint64_t v = 0;
+    while (n--)
+        v = v << 8 | p[n];
+    return v;
+}
+
+// Return the name of the format that p[0..n-1] starts, or NULL if it is none
+// of zstd, xz or bzip2.
+const char *other_format(const unsigned char *p, size_t n) {
+    if (n >= 4 && le32(p) == ZSTD_MAGIC)
+        return "zstd";
+    if (n >= 4 && (le32(p) & 0xfffffff0) == SKIP_MAGIC)
+        return "zstd";
+    if (n >= 6 && memcmp(p, "\xfd" "7zXZ\0", 6) == 0)
+        return "xz";
+    if (n >= 4 && memcmp(p, "BZh", 3) == 0 && p[3] >= '1' && p[3] <= '9')
+        return "bzip2";
+    return NULL;
+}
+
+static int add_unit(info *f, uint64_t off, uint64_t len, uint64_t out) {
+    if (f->n == f->room) {
+        size_t room = f->room ? 2 * f->room : 64;
+        unit *u = realloc(f->u, room * sizeof(unit));
+        if (u == NULL)
+            return -1;
+        f->u = u;
+        f->room = room;
+    }
+    f->u[f->n++] = (unit){off, len, out, 0, 0};
+    return 0;
+}
+
+static void damaged(info *f, const char *why, uint64_t at) {
+    if (f->bad == NULL) {
+        f->bad = why;
+        f->bad_at = at;
+    }
+}
+
+// zstd: use the seek table if there is one, else hop over the frames by
+// their block headers. Frames without a content size leave the total unknown.
+static void zstd_meta(info *f) {
+    const unsigned char *p = f->data;
+    uint64_t size = f->size;
+    f->length = 0;
+    f->source = "frame headers";
+    if (size >= 17 && le32(p + size - 4) == SEEK_MAGIC &&
+        (p[size - 5] & 0x7c) == 0) {
+        uint64_t frames = le32(p + size - 9);
+        int each = p[size - 5] & 0x80 ? 12 : 8;
+        uint64_t table = frames * each + 9;
+        if (table + 8 <= size && le32(p + size - table - 8) == SKIP_MAGIC + 0xe &&
+            le32(p + size - table - 4) == table) {
+            const unsigned char *e = p + size - table;
+            uint64_t off = 0;
+            for (uint64_t i = 0; i < frames; i++, e += each) {
+                if (add_unit(f, off, le32(e), le32(e + 4)) < 0) {
+                    damaged(f, "out of memory", 0);
+                    return;
+                }
+                off += le32(e);
+                f->length += le32(e + 4);
+            }
+            f->streams = frames;
+            f->source = "seek table";
+            if (off + table + 8 != size)
+                damaged(f, "seek table does not match the frames", off);
+            return;
+        }
+    }
+
+    uint64_t at = 0;
+    while (at < size && f->bad == NULL) {
+        if (size - at < 8) {
+            damaged(f, "truncated frame", at);
+            break;
+        }
+        uint32_t magic = le32(p + at);
+        if ((magic & 0xfffffff0) == SKIP_MAGIC) {
+            uint64_t len = le32(p + at + 4);
+            if (len > size - at - 8)
+                damaged(f, "truncated skippable frame", at);
+            at += 8 + len;
+            continue;
+        }
+        if (magic != ZSTD_MAGIC) {
+            damaged(f, "not a zstd frame", at);
+            break;
+        }
+        int fhd = p[at + 4], fcs = fhd >> 6, single = (fhd >> 5) & 1;
+        static const int dsize[] = {0, 1, 2, 4}, fsize[] = {0, 2, 4, 8};
+        int fn = fcs == 0 ? single : fsize[fcs];
+        uint64_t pos = at + 5 + !single + dsize[fhd & 3];
+        if (fhd & 8 || pos + fn > size) {
+            damaged(f, "bad frame header", at);
+            break;
+        }
+        uint64_t out = fn == 0 ? UINT64_MAX : le_n(p + pos, fn) + (fn == 2 ? 256 : 0);
+        pos += fn;
+
+        // The blocks. Raw and RLE blocks give their sizes, compressed blocks
+        // only their compressed size.
+        uint64_t known = 0;
+        int sized = 1, last = 0;
+        while (!last) {
+            if (pos + 3 > size) {
+                damaged(f, "truncated block", pos);
+                break;
+            }
+            uint32_t h = le_n(p + pos, 3);
+            uint64_t bsize = h >> 3;
+            int type = (h >> 1) & 3;
+            last = h & 1;
+            pos += 3;
+            if (type == 3 || pos + (type == 1 ? 1 : bsize) > size) {
+                damaged(f, "bad block", pos - 3);
+                break;
+            }
+            pos += type == 1 ? 1 : bsize;
+            if (type == 2)
+                sized = 0;
+            else
+                known += bsize;
+        }
+        if (fhd & 4)
+            pos += 4;
+        if (f->bad != NULL || pos > size) {
+            damaged(f, "truncated frame", at);
+            break;
+        }
+        if (out == UINT64_MAX && sized)
+            out = known;
+        if (add_unit(f, at, pos - at, out) < 0) {
+            damaged(f, "out of memory", at);
+            break;
+        }
+        if (out == UINT64_MAX || f->length == UINT64_MAX)
+            f->length = UINT64_MAX;
+        else
+            f->length += out;
+        f->streams++;
+        if (fhd & 4)
+            f->check = "XXH64";
+        at = pos;
+    }
+}
+
+static int by_off(const void *a, const void *b) {
+    uint64_t x = ((const unit *)a)->off, y = ((const unit *)b)->off;
+    return x < y ? -1 : x > y;
+}
+
+// Read a multibyte integer as xz writes them. Return its length, or 0.
+static int xz_vli(const unsigned char *p, uint64_t left, uint64_t *v) {
+    *v = 0;
+    for (int i = 0; i < 9 && (uint64_t)i < left; i++) {
+        *v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if ((p[i] & 0x80) == 0)
+            return i + 1;
+    }
+    return 0;
+}
+
+// xz: walk back over the streams from the end of the file, reading the index
+// of each. The blocks are listed in the index with their sizes.
+static void xz_meta(info *f) {
+    static const char *checks[] = {"none", "CRC32", NULL, NULL, "CRC64",
+                                   NULL, NULL, NULL, NULL, NULL, "SHA-256"};
+    const unsigned char *p = f->data;
+    uint64_t end = f->size;
+    f->length = 0;
+    f->source = "stream indexes";
+    while (end > 0 && f->bad == NULL) {
+        while (end >= 4 && le32(p + end - 4) == 0)
+            end -= 4;                   // stream padding
+        const unsigned char *foot = p + end - 12;
+        if (end < 24 || end % 4 || memcmp(foot + 10, "YZ", 2) ||
+            crc32(0, foot + 4, 6) != le32(foot)) {
+            damaged(f, "bad stream footer", end < 12 ? 0 : end - 12);
+            break;
+        }
+        uint64_t back = ((uint64_t)le32(foot + 4) + 1) * 4;
+        int check = foot[9] & 0xf;
+        if (back > end - 24) {
+            damaged(f, "bad stream footer", end - 12);
+            break;
+        }
+        uint64_t index = end - 12 - back, count, pos;
+        const unsigned char *x = p + index;
+        int k = xz_vli(x + 1, back - 1, &count);
+        if (x[0] != 0 || k == 0 || crc32(0, x, back - 4) != le32(x + back - 4)) {
+            damaged(f, "bad index", index);
+            break;
+        }
+        pos = 1 + k;
+
+        // The blocks before this stream's, as units, are moved up after it.
+        size_t at = f->n;
+        uint64_t blocks = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t unpadded, out;
+            int a = xz_vli(x + pos, back - pos, &unpadded);
+            int b = a ? xz_vli(x + pos + a, back - pos - a, &out) : 0;
+            if (b == 0 || add_unit(f, blocks, unpadded, out) < 0) {
+                damaged(f, "bad index", index + pos);
+                break;
+            }
+            f->u[f->n - 1].check = check;
+            blocks += (unpadded + 3) & ~(uint64_t)3;
+            f->length += out;
+            pos += a + b;
+        }
+        if (f->bad != NULL)
+            break;
+        if (blocks + 12 > index ||
+            memcmp(p + index - blocks - 12, "\xfd" "7zXZ\0", 6) ||
+            memcmp(p + index - blocks - 6, foot + 8, 2)) {
+            damaged(f, "bad stream header", index < blocks + 12 ? 0 :
+                                             index - blocks - 12);
+            break;
+        }
+        uint64_t start = index - blocks - 12;
+        for (size_t i = at; i < f->n; i++)
+            f->u[i].off += start + 12;
+        f->check = check < 11 && checks[check] != NULL ? checks[check] : "other";
+        f->streams++;
+        end = start;
+    }
+
+    // Put the units in file order: each stream's were appended after those
+    // of the streams following it.
+    qsort(f->u, f->n, sizeof(unit), by_off);
+}
+
+// Bit offsets of the bzip2 block and end of stream signatures.
+struct bz_scan {
+    const unsigned char *data;
+    uint64_t size;
+    uint64_t seg;                   // bytes per job
+    uint64_t **hit;                 // each job's offsets, end marks odd
+    size_t *nhit;
+    int err;
+};
+
+static void bz_scan_job(void *ctx, size_t i) {
+    struct bz_scan *s = ctx;
+    uint64_t from = i * s->seg, to = from + s->seg < s->size ? from + s->seg :
+                                                                s->size;
+    uint64_t reg = 0;
+    size_t room = 0;
+    // Fill the register with the six bytes before from, so that signatures
+    // ending in this segment are all found here.
+    uint64_t at = from >= 6 ? from - 6 : 0;
+    for (; at < from; at++)
+        reg = reg << 8 | s->data[at];
+    for (; at < to; at++) {
+        reg = reg << 8 | s->data[at];
+        for (int sh = 7; sh >= 0; sh--) {
+            uint64_t v = (reg >> sh) & 0xffffffffffffULL;
+            if ((v == BZ_BLOCK || v == BZ_END) && (at + 1) * 8 - sh >= 48) {
+                if (s->nhit[i] == room) {
+                    room = room ? 2 * room : 64;
+                    uint64_t *h = realloc(s->hit[i], room * sizeof(uint64_t));
+                    if (h == NULL) {
+                        s->err = 1;
+                        return;
+                    }
+                    s->hit[i] = h;
+                }
+                uint64_t bit = (at + 1) * 8 - sh - 48;
+                s->hit[i][s->nhit[i]++] = bit << 1 | (v == BZ_END);
+            }
+        }
+    }
+}
+
+static uint32_t bz_bits(const unsigned char *p, uint64_t size, uint64_t bit,
+                        int n) {
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++, bit++)
+        v = v << 1 | (bit / 8 < size ? (p[bit / 8] >> (7 - bit % 8)) & 1 : 0);
+    return v;
+}
+
+// bzip2: find the signatures, and check each stream's combined CRC against
+// those of its blocks. The uncompressed sizes are not recorded anywhere.
+static void bz_meta(info *f, int threads) {
+    struct bz_scan s = {f->data, f->size, 1 << 22, NULL, NULL, 0};
+    size_t jobs = (f->size + s.seg - 1) / s.seg;
+    s.hit = calloc(jobs ? jobs : 1, sizeof(uint64_t *));
+    s.nhit = calloc(jobs ? jobs : 1, sizeof(size_t));
+    f->length = UINT64_MAX;
+    f->source = "block signatures";
+    f->check = "CRC32";
+    if (s.hit == NULL || s.nhit == NULL)
+        damaged(f, "out of memory", 0);
+    else {
+        pool_run(threads, jobs, bz_scan_job, &s);
+        if (s.err)
+            damaged(f, "out of memory", 0);
+    }
+
+    // Each block runs to the next signature. A stream ends with its end
+    // mark, its combined CRC, and padding to a byte.
+    uint64_t block = UINT64_MAX, next = 0;
+    uint32_t combined = 0;
+    for (size_t j = 0; f->bad == NULL && j < jobs; j++)
+        for (size_t k = 0; f->bad == NULL && k < s.nhit[j]; k++) {
+            uint64_t bit = s.hit[j][k] >> 1;
+            int end = s.hit[j][k] & 1;
+            if (bit < next)
+                continue;
+            if (block == UINT64_MAX &&
+                (bit != next + 32 || memcmp(f->data + next / 8, "BZh", 3))) {
+                // A stream must start here, with its header.
+                damaged(f, "bad stream header", next / 8);
+                break;
+            }
+            if (block != UINT64_MAX) {
+                uint32_t crc = bz_bits(f->data, f->size, block + 48, 32);
+                if (add_unit(f, block, bit - block, UINT64_MAX) < 0) {
+                    damaged(f, "out of memory", block / 8);
+                    break;
+                }
+                f->u[f->n - 1].crc = crc;
+                combined = (combined << 1 | combined >> 31) ^ crc;
+            }
+            block = bit;
+            if (end) {
+                if (bz_bits(f->data, f->size, bit + 48, 32) != combined)
+                    damaged(f, "stream CRC does not match its blocks", bit / 8);
+                next = (bit + 80 + 7) & ~(uint64_t)7;
+                block = UINT64_MAX;
+                combined = 0;
+                f->streams++;
+            }
+        }
+    if (f->bad == NULL && (block != UINT64_MAX || next / 8 != f->size))
+        damaged(f, "truncated stream", block != UINT64_MAX ? f->size : next / 8);
+    for (size_t j = 0; s.hit != NULL && j < jobs; j++)
+        free(s.hit[j]);
+    free(s.hit);
+    free(s.nhit);
+}
+
+// Parallel verification, one unit to a job.
+struct check {
+    info *f;
+    uint64_t *out;
+    int *ok;
+};
+
+#ifdef HAVE_ZSTD
+static int zstd_unit(const info *f, const unit *u, uint64_t *out) {
+    unsigned char buf[1 << 16];
+    ZSTD_DCtx *d = ZSTD_createDCtx();
+    ZSTD_inBuffer in = {f->data + u->off, u->len, 0};
+    size_t ret = 1;
+    *out = 0;
+    while (d != NULL && ret != 0 && !ZSTD_isError(ret)) {
+        ZSTD_outBuffer o = {buf, sizeof(buf), 0};
+        ret = ZSTD_decompressStream(d, &o, &in);
+        *out += o.pos;
+        if (in.pos == in.size && o.pos < o.size && ret != 0)
+            break;                      // the frame ended early
+    }
+    ZSTD_freeDCtx(d);
+    return d != NULL && ret == 0 && in.pos == in.size ? 0 : -1;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static int xz_unit(const info *f, const unit *u, uint64_t *out) {
+    unsigned char buf[1 << 16];
+    const unsigned char *p = f->data + u->off;
+    uint64_t len = (u->len + 3) & ~(uint64_t)3;
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block b;
+    lzma_stream s = LZMA_STREAM_INIT;
+    *out = 0;
+    if (len > f->size - u->off)
+        return -1;
+    memset(&b, 0, sizeof(b));
+    b.version = 0;
+    b.check = u->check;
+    b.filters = filters;
+    b.header_size = lzma_block_header_size_decode(p[0]);
+    if (b.header_size > len || lzma_block_header_decode(&b, NULL, p) != LZMA_OK)
+        return -1;
+    lzma_ret ret = lzma_block_compressed_size(&b, u->len);
+    if (ret == LZMA_OK) {
+        b.uncompressed_size = u->out;
+        ret = lzma_block_decoder(&s, &b);
+    }
+    s.next_in = p + b.header_size;
+    s.avail_in = len - b.header_size;
+    while (ret == LZMA_OK) {
+        s.next_out = buf;
+        s.avail_out = sizeof(buf);
+        ret = lzma_code(&s, LZMA_FINISH);
+        *out += sizeof(buf) - s.avail_out;
+    }
+    lzma_end(&s);
+    for (int i = 0; filters[i].id != LZMA_VLI_UNKNOWN; i++)
+        free(filters[i].options);
+    return ret == LZMA_STREAM_END && *out == u->out ? 0 : -1;
+}
+#endif
+
+#ifdef HAVE_BZ2
+// Write n bits of v at bit offset *at of p, which is zeroed.
+static void put_bits(unsigned char *p, uint64_t *at, uint64_t v, int n) {
+    while (n--) {
+        p[*at / 8] |= ((v >> n) & 1) << (7 - *at % 8);
+        (*at)++;
+    }
+}
+
+static int bz_unit(const info *f, const unit *u, uint64_t *out) {
+    char buf[1 << 16];
+    uint64_t bytes = (u->len + 7) / 8, b = u->off / 8, at = 32;
+    int sh = u->off % 8;
+    unsigned char *one = calloc(bytes + 16, 1);
+    *out = 0;
+    if (one == NULL)
+        return -1;
+
+    // The block, shifted to follow a header, then an end mark with the
+    // block's CRC as the stream's.
+    memcpy(one, "BZh9", 4);
+    for (uint64_t i = 0; i < bytes; i++) {
+        unsigned v = f->data[b + i] << sh;
+        if (sh && b + i + 1 < f->size)
+            v |= f->data[b + i + 1] >> (8 - sh);
+        one[4 + i] = v;
+    }
+    at += u->len;
+    if (u->len % 8)
+        one[at / 8] &= 0xff00 >> (u->len % 8);
+    memset(one + at / 8 + 1, 0, bytes + 16 - at / 8 - 1);
+    put_bits(one, &at, BZ_END, 48);
+    put_bits(one, &at, u->crc, 32);
+
+    bz_stream s;
+    memset(&s, 0, sizeof(s));
+    int ret = BZ2_bzDecompressInit(&s, 0, 0);
+    s.next_in = (char *)one;
+    s.avail_in = (at + 7) / 8;
+    while (ret == BZ_OK) {
+        s.next_out = buf;
+        s.avail_out = sizeof(buf);
+        ret = BZ2_bzDecompress(&s);
+        *out += sizeof(buf) - s.avail_out;
+        if (ret == BZ_OK && s.avail_in == 0 && s.avail_out)
+            ret = BZ_UNEXPECTED_EOF;
+    }
+    BZ2_bzDecompressEnd(&s);
+    free(one);
+    return ret == BZ_STREAM_END ? 0 : -1;
+}
+#endif
+
+static void check_job(void *ctx, size_t i) {
+    struct check *c = ctx;
+    const info *f = c->f;
+    int ret = -1;
+    (void)f;
+#ifdef HAVE_ZSTD
+    if (strcmp(f->format, "zstd") == 0)
+        ret = zstd_unit(f, f->u + i, c->out + i);
+#endif
+#ifdef HAVE_LZMA
+    if (strcmp(f->format, "xz") == 0)
+        ret = xz_unit(f, f->u + i, c->out + i);
+#endif
+#ifdef HAVE_BZ2
+    if (strcmp(f->format, "bzip2") == 0)
+        ret = bz_unit(f, f->u + i, c->out + i);
+#endif
+    c->ok[i] = ret == 0;
+}
+
+static int can_verify(const char *format) {
+    (void)format;
+#ifdef HAVE_ZSTD
+    if (strcmp(format, "zstd") == 0)
+        return 1;
+#endif
+#ifdef HAVE_LZMA
+    if (strcmp(format, "xz") == 0)
+        return 1;
+#endif
+#ifdef HAVE_BZ2
+    if (strcmp(format, "bzip2") == 0)
+        return 1;
+#endif
+    return 0;
+}
+
+static void verify(info *f, int threads) {
+    struct check c = {f, calloc(f->n ? f->n : 1, sizeof(uint64_t)),
+                      calloc(f->n ? f->n : 1, sizeof(int))};
+    if (c.out == NULL || c.ok == NULL)
+        damaged(f, "out of memory", 0);
+    else {
+        pool_run(threads, f->n, check_job, &c);
+        f->verified = 1;
+        for (size_t i = 0; i < f->n; i++) {
+            f->decoded += c.out[i];
+            if (!c.ok[i] ||
+                (f->u[i].out != UINT64_MAX && f->u[i].out != c.out[i])) {
+                damaged(f, "compressed data error", f->u[i].off /
+                        (strcmp(f->format, "bzip2") == 0 ? 8 : 1));
+                f->verified = 0;
+                break;
+            }
+        }
+    }
+    free(c.out);
+    free(c.ok);
+}
+
+// Print what the metadata of the zstd, xz or bzip2 file name says, and verify
+// it if its library is present and check is true. Return 0, or 1 on error.
+int other_info(const char *name, int check, int threads) {
+    struct stat st;
+    info f;
+    memset(&f, 0, sizeof(f));
+    f.verified = -1;
+    int fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    f.size = st.st_size;
+    void *map = mmap(NULL, f.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "gzinfo: read error on %s\n", name);
+        return 1;
+    }
+    f.data = map;
+    f.format = other_format(f.data, f.size);
+    if (f.format == NULL) {
+        fprintf(stderr, "gzinfo: %s is not zstd, xz or bzip2\n", name);
+        munmap(map, f.size);
+        return 1;
+    }
+    threads = pool_threads(threads);
+    if (strcmp(f.format, "zstd") == 0)
+        zstd_meta(&f);
+    else if (strcmp(f.format, "xz") == 0)
+        xz_meta(&f);
+    else
+        bz_meta(&f, threads);
+    if (f.bad != NULL)
+        f.length = UINT64_MAX;          // the metadata is damaged
+    else if (check && can_verify(f.format))
+        verify(&f, threads);
+    if (f.length == UINT64_MAX && f.verified == 1)
+        f.length = f.decoded;
+
+    printf("%s File Information:\n", f.format);
+    printf("Compressed Size: %s\n", humanSize(f.size));
+    if (f.length != UINT64_MAX)
+        printf("Uncompressed Size: %s (from the %s)\n", humanSize(f.length),
+               f.verified == 1 ? "decoded data" : f.source);
+    else
+        printf("Uncompressed Size: unknown%s\n",
+               f.bad == NULL ? " without decoding" : "");
+    printf("Number of %s: %llu\n", strcmp(f.format, "zstd") ? "Streams" :
+           "Frames", (unsigned long long)f.streams);
+    if (strcmp(f.format, "zstd"))
+        printf("Number of Blocks: %zu\n", f.n);
+    if (f.check != NULL)
+        printf("Integrity Check: %s\n", f.check);
+    if (f.verified == 1)
+        printf("Verified: all %zu %s, %d threads\n", f.n,
+               strcmp(f.format, "zstd") ? "blocks" : "frames", threads);
+    else if (f.bad == NULL)
+        printf("Verified: no (%s)\n", check ? "built without its library" :
+                                              "not asked to");
+    int ret = 0;
+    if (f.bad != NULL) {
+        fflush(stdout);
+        fprintf(stderr, "gzinfo: %s at %llu in %s\n", f.bad,
+                (unsigned long long)f.bad_at, name);
+        ret = 1;
+    }
+    free(f.u);
+    munmap(map, f.size);
+    return ret;
+}
+
+int cmd_info(int argc, char **argv) {
+    int threads = 0, check = 1, opt;
+    while ((opt = getopt(argc, argv, "nj:")) != -1)
+        switch (opt) {
+        case 'n':
+            check = 0;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo info [-n] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    unsigned char head[6] = {0};
+    FILE *in = fopen(name, "rb");
+    size_t got = in == NULL ? 0 : fread(head, 1, sizeof(head), in);
+    if (in != NULL)
+        fclose(in);
+    if (other_format(head, got) != NULL)
+        return other_info(name, check, threads);
+
+    // deflate: there is nothing to go on without decoding it all.
+    int ret = verify_gzip(name, NULL);
+    if (ret != Z_OK)
+        return 1;
+    print_gzip_info();
+    return 0;
+}
@@ -3,23 +3,16 @@
 #include <stdint.h>
 #include <string.h>
 #include <limits.h>
-#include "zlib.h"
-
-#define WINSIZE 32768U      // sliding window size
-#define CHUNK 16384         // file input buffer size
-
-// Decompression modes. These are the inflateInit2() windowBits parameter.
-#define RAW -15
-#define ZLIB 15
-#define GZIP 31
+#include "gzinfo.h"
 
 uint64_t deflate_blocks = 0;
 uint64_t gzip_members = 0;
 uint64_t uncompressed_size = 0;
 uint64_t compressed_size = 0;
 int header_present = 0;
+gz_volumes volume_set;          // the input of the last verify_gzip()
 
-static const char *humanSize(uint64_t bytes)
+const char *humanSize(uint64_t bytes)
 {
     char *suffix[] = {"B", "KB", "MB", "GB", "TB"};
     char length = sizeof(suffix) / sizeof(suffix[0]);
@@ -37,12 +30,16 @@ static const char *humanSize(uint64_t bytes)
     return output;
 }
 
-int verify_gzip(char *filename) {
-    FILE *in = fopen(filename, "rb");
-    if (in == NULL) {
+int verify_gzip(char *filename, const verify_hooks *hooks) {
+    // Open the input, which may be a set of split volumes.
+    gz_volumes *in = &volume_set;
+    vol_close(in);
+    if (vol_open(in, filename) < 0) {
         fprintf(stderr, "gzinfo: could not open %s for reading\n", filename);
         return 1;
     }
+    deflate_blocks = 0;
+    gzip_members = 0;
 
     // Set up inflation state.
     z_stream strm = {0};        // inflate engine (gets fired up later)
@@ -58,14 +55,21 @@ int verify_gzip(char *filename) {
     do {
         // Assure available input, at least until reaching EOF.
         if (strm.avail_in == 0) {
-            strm.avail_in = fread(buf, 1, sizeof(buf), in);
+            strm.avail_in = vol_read(in, buf, sizeof(buf));
             totin += strm.avail_in;
             strm.next_in = buf;
-            if (strm.avail_in < sizeof(buf) && ferror(in)) {
+            if (in->err) {
                 ret = Z_ERRNO;
                 break;
             }
 
+            if (mode == 0 && other_format(buf, strm.avail_in) != NULL) {
+                // Not deflate at all -- see other_info().
+                fprintf(stderr, "gzinfo: %s is %s data, not deflate\n",
+                        filename, other_format(buf, strm.avail_in));
+                vol_stop(in);
+                return Z_DATA_ERROR;
+            }
             if (mode == 0) {
                 // At the start of the input -- determine the type. Assume raw
                 // if it is neither zlib nor gzip. This could in theory result
@@ -80,6 +84,7 @@ int verify_gzip(char *filename) {
                 // Check if the header indicates a valid gzip file
                 if ((strm.next_in[0] != 0x1F || strm.next_in[1] != 0x8B || strm.next_in[2] != 8) && (mode == GZIP)) {
                     fprintf(stderr, "Invalid GZIP header!\n");
+                    vol_stop(in);
                     return Z_DATA_ERROR;
                 } else {
                     header_present = 1;
@@ -88,6 +93,13 @@ int verify_gzip(char *filename) {
                 ret = inflateInit2(&strm, mode);
                 if (ret != Z_OK)
                     break;
+                if (mode == RAW) {
+                    // There is no header to mark the start of raw deflate
+                    // data, so count an access point there.
+                    deflate_blocks++;
+                    if (hooks != NULL && hooks->point != NULL)
+                        hooks->point(hooks->ctx, 0, 0, 0, win, 0);
+                }
             }
         }
 
@@ -98,17 +110,14 @@ int verify_gzip(char *filename) {
             strm.next_out = win;
         }
 
-        if (mode == RAW)
-            // We skip the inflate() call at the start of raw deflate data in
-            // order generate an access point there. Set data_type to imitate
-            // the end of a header.
-            strm.data_type = 0x80;
-        else {
-            // Inflate and update the number of uncompressed bytes.
-            unsigned before = strm.avail_out;
-            ret = inflate(&strm, Z_BLOCK);
-            totout += before - strm.avail_out;
-        }
+        // Inflate and update the number of uncompressed bytes.
+        unsigned before = strm.avail_out;
+        ret = inflate(&strm, Z_BLOCK);
+        totout += before - strm.avail_out;
+        in->out[in->at] += before - strm.avail_out;
+        if (hooks != NULL && hooks->window != NULL && before != strm.avail_out)
+            hooks->window(hooks->ctx, strm.next_out - (before - strm.avail_out),
+                          before - strm.avail_out);
 
         if ((strm.data_type & 0xc0) == 0x80) {
             // We are at the end of a header or a non-last deflate block, so we
@@ -118,10 +127,14 @@ int verify_gzip(char *filename) {
             // to add an access point here.
             deflate_blocks++;
             last = totout;
+            if (hooks != NULL && hooks->point != NULL)
+                hooks->point(hooks->ctx, totin - strm.avail_in,
+                             strm.data_type & 7, totout, win,
+                             sizeof(win) - strm.avail_out);
         }
 
         if (ret == Z_STREAM_END && mode == GZIP &&
-            (strm.avail_in || ungetc(getc(in), in) != EOF)) {
+            (strm.avail_in || vol_more(in))) {
             // There is more input after the end of a gzip member. Reset the
             // inflate state to read another gzip member. On success, this will
             // set ret to Z_OK to continue decompressing.
@@ -137,13 +150,14 @@ int verify_gzip(char *filename) {
     if (ret != Z_STREAM_END) {
         // An error was encountered. Return a negative
         fprintf(stderr, "gzinfo: compressed data error at %ld in %s\n", totin, filename);
+        vol_stop(in);
         return ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
     }
 
     compressed_size = totin;
     uncompressed_size = totout;
 
-    fclose(in);
+    vol_stop(in);
     return Z_OK;
 }
 
@@ -155,16 +169,72 @@ void print_gzip_info(void) {
     printf("Uncompressed Size: %s\n", humanSize(uncompressed_size));
     printf("Number of Deflate Blocks: %ld\n", deflate_blocks);
     printf("Number of GZIP Members: %ld\n", gzip_members);
+    if (volume_set.n > 1)
+        printf("Number of Volumes: %d\n", volume_set.n);
+}
+
+// Subcommands, selected by the first argument. Anything else is taken as a
+// file name for the default summary.
+static const struct command {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *args;
+} commands[] = {
+    {"cmp", cmd_cmp, "[-t] [-j threads] a b"},
+    {"diff", cmd_cmp, "[-t] [-j threads] a b"},
+    {"cdc", cmd_cdc, "[-a avg] [-v] file..."},
+    {"dedup", cmd_dedup, "[-j threads] file..."},
+    {"sample", cmd_sample, "[-b bytes | -p percent] [-r rate] [-s seed] [-j threads] file"},
+    {"recover", cmd_recover, "[-o salvage] [-j threads] file"},
+    {"carve", cmd_carve, "[-g | -z] [-j threads] file"},
+    {"zip", cmd_zip, "[-q] [-j threads] file"},
+    {"dictzip", cmd_dictzip, "[-n] [-r offset:length] [-o out] [-j threads] file"},
+    {"index", cmd_index, "[-s span] [-f format] [-o out] [-j threads] build|convert|verify|extract file [index] [offset:length]"},
+    {"lines", cmd_lines, "[-s span] [-i index] [-o out] first[-last]|index file"},
+    {"range", cmd_range, "[-t format] [-c column] [-s span] [-j threads] [-o out] from to file|directory..."},
+    {"read", cmd_read, "[-i index] [-s span] [-m cache] [-j threads] [-n reads] [-b bytes] file [offset:length...]"},
+    {"chunks", cmd_chunks, "[-c chunk] [-j threads] [-s seed] [-d delay] file"},
+    {"info", cmd_info, "[-n] [-j threads] file"},
+    {"symbols", cmd_symbols, "[-b] file"},
+    {"advise", cmd_advise, "[-n samples] [-b bytes] [-j threads] file"},
+    {"timeline", cmd_timeline, "[-s span] [-c] file"},
+    {"entropy", cmd_entropy, "[-s span] [-c] file"},
+    {"diagnose", cmd_diagnose, "[-j threads] file..."},
+    {"plan", cmd_plan, "[-n] [-q] [-j threads] file"},
+    {"volumes", cmd_volumes, "[-j threads] file.gz.001"},
+    {"pack", cmd_pack, "[-j threads] file.pack|file.idx"},
+    {"tar", cmd_tar, "[-r] [-s span] [-i index] [-o out] list|index|extract file [path]"},
+    {"estimate", cmd_estimate, "[-n samples] [-b bytes] [-s seed] [-p prefix] [-j threads] file"},
+};
+
+static void usage(void) {
+    fprintf(stderr, "usage: gzinfo file.raw\n");
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+        fprintf(stderr, "       gzinfo %s %s\n", commands[i].name, commands[i].args);
 }
 
 int main(int argc, char **argv) {
+    if (argc >= 2)
+        for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+            if (strcmp(argv[1], commands[i].name) == 0)
+                return commands[i].run(argc - 1, argv + 1);
+
     // Open the input file.
     if (argc < 2 || argc > 3) {
-        fprintf(stderr, "usage: gzinfo file.raw\n");
+        usage();
         return 1;
     }
 
-    int retval = verify_gzip(argv[1]);
+    // zstd, xz and bzip2 have their own ways to get at the sizes.
+    unsigned char head[6];
+    FILE *f = fopen(argv[1], "rb");
+    size_t got = f == NULL ? 0 : fread(head, 1, sizeof(head), f);
+    if (f != NULL)
+        fclose(f);
+    if (other_format(head, got) != NULL)
+        return other_info(argv[1], 1, 0);
+
+    int retval = verify_gzip(argv[1], NULL);
     if (retval < 0) {
         switch (retval) {
         case Z_MEM_ERROR:
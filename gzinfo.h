@@ -0,0 +1,325 @@
+#ifndef GZINFO_H
+#define GZINFO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "zlib.h"
+
+#define WINSIZE 32768U      // sliding window size
+#define CHUNK 16384         // file input buffer size
+
+// Decompression modes. These are the inflateInit2() windowBits parameter,
+// except PLAIN, which marks input that is not compressed at all.
+#define RAW -15
+#define ZLIB 15
+#define GZIP 31
+#define PLAIN 1
+
+// gzip header flags (RFC 1952).
+#define FHCRC 0x02
+#define FEXTRA 0x04
+#define FNAME 0x08
+#define FCOMMENT 0x10
+
+// Parsed gzip member header. The pointers refer into the buffer that was
+// parsed and are only valid while it is.
+typedef struct {
+    int flags;
+    uint32_t mtime;
+    int xfl;
+    int os;
+    const unsigned char *extra;     // FEXTRA payload, or NULL
+    unsigned xlen;
+    const char *name;               // FNAME, or NULL
+    const char *comment;            // FCOMMENT, or NULL
+    size_t hdrlen;                  // total header length in bytes
+    uint32_t bsize;                 // BGZF total member size, or 0
+} gz_hdr;
+
+// One gzip member located without inflating it.
+typedef struct {
+    uint64_t off;                   // compressed offset of the header
+    uint64_t len;                   // compressed length, header to trailer
+    uint32_t crc;                   // trailer CRC-32
+    uint32_t isize;                 // trailer ISIZE
+} gz_member;
+
+// Callbacks made by verify_gzip() as it decompresses. Any may be NULL.
+typedef struct {
+    // Each new run of uncompressed output, in order. The data lives in the
+    // sliding window and is only valid for the duration of the call.
+    void (*window)(void *ctx, const unsigned char *data, size_t len);
+    // Each access point: the start of the data, and the end of each header
+    // and of each non-last deflate block. Decompression can be restarted at
+    // bit offset 8*in-bits with out bytes produced so far, given the last
+    // WINSIZE bytes of output. Those are in the circular window win, the
+    // oldest at win[pos].
+    void (*point)(void *ctx, uint64_t in, int bits, uint64_t out,
+                  const unsigned char *win, unsigned pos);
+    void *ctx;
+} verify_hooks;
+
+// A set of split volumes read as one input (volume.c).
+typedef struct {
+    int n;                          // number of volumes
+    char **name;
+    uint64_t *size;                 // compressed bytes in each
+    uint64_t *out;                  // uncompressed bytes from each
+    int cur;                        // volume being read
+    int at;                         // volume of the last vol_read() data
+    FILE *f;
+    int err;
+} gz_volumes;
+
+int vol_open(gz_volumes *v, const char *name);
+int vol_count(const char *name);
+int vol_single(const char *name);
+size_t vol_read(gz_volumes *v, void *buf, size_t len);
+int vol_more(gz_volumes *v);
+void vol_stop(gz_volumes *v);
+void vol_close(gz_volumes *v);
+
+// gzinfo.c
+extern uint64_t deflate_blocks;
+extern uint64_t gzip_members;
+extern uint64_t uncompressed_size;
+extern uint64_t compressed_size;
+extern int header_present;
+extern gz_volumes volume_set;
+const char *humanSize(uint64_t bytes);
+int verify_gzip(char *filename, const verify_hooks *hooks);
+void print_gzip_info(void);
+
+// member.c
+long gz_header_parse(const unsigned char *p, size_t n, gz_hdr *h);
+int gz_header_plausible(const unsigned char *p, size_t n);
+const unsigned char *gz_extra_find(const gz_hdr *h, int si1, int si2,
+                                   unsigned *len);
+long gz_hop_members(int fd, gz_member **list);
+int gz_inflate_member(const unsigned char *in, size_t len,
+                      unsigned char *out, size_t outlen, size_t *got);
+int pread_full(int fd, void *buf, size_t len, uint64_t off);
+uint32_t le32(const unsigned char *p);
+uint64_t splitmix(uint64_t *x);
+double wall_now(void);
+double cpu_now(void);
+int inflate_at(int fd, int mode, uint64_t off, uint64_t cap, uint64_t *used,
+               uint64_t *out, uLong *crc);
+int gz_verify_member(int fd, uint64_t off, uint64_t cap, uint64_t *used,
+                     uint64_t *out);
+
+// In-tree deflate decoder (deflate.c).
+#define DFL_OK 0
+#define DFL_END 1                   // the last block was decoded
+#define DFL_EOF -1                  // the input ended mid-stream
+#define DFL_BAD -2                  // invalid deflate data
+#define DFL_FAST 10                 // bits resolved by one table lookup
+
+typedef struct {
+    uint16_t count[16];             // number of codes of each length
+    uint16_t symbol[288];           // symbols ordered by code
+    uint16_t fast[1 << DFL_FAST];   // symbol << 4 | length, 0 if longer
+} dfl_huff;
+
+typedef struct {
+    uint64_t literals;              // literal bytes, stored blocks included
+    uint64_t matches;               // back-references
+    uint64_t match_bytes;           // bytes produced by back-references
+    uint64_t rle;                   // back-references at distance 1
+} dfl_stats;
+
+typedef struct {
+    uint64_t lit[256];              // literal bytes, not in stored blocks
+    uint64_t len[259];              // matches of each length, 3..258
+    uint64_t dist[30];              // matches of each distance code
+    uint64_t type[3];               // stored, fixed and dynamic blocks
+    uint64_t header_bits;           // in the headers of dynamic blocks
+} dfl_hist;
+
+typedef struct {
+    const unsigned char *in;
+    size_t len;
+    uint64_t pos;                   // next input bit
+    uint64_t block;                 // bit offset of the current block
+    uint64_t header_bits;           // length of the current block header
+    int final, type;                // current block's BFINAL and BTYPE
+    uint64_t blocks;                // blocks decoded
+    const char *msg;                // what went wrong, on DFL_BAD
+    unsigned char *win;             // window followed by new output
+    unsigned char *unk;             // per-byte unknown flags, or NULL
+    size_t have, flushed, size;
+    uint64_t total;                 // bytes produced
+    uint64_t unknown;               // of those, copied from before the start
+    unsigned char *used;            // if not NULL, set for each byte of the
+                                    // starting window that is copied from
+    dfl_stats stats;
+    dfl_hist *hist;                 // if not NULL, symbols are counted here
+    void (*sink)(void *ctx, const unsigned char *data, size_t len);
+    void *ctx;
+    dfl_huff lencode, distcode;
+} dfl;
+
+int dfl_init(dfl *d, const unsigned char *in, size_t len, uint64_t bit,
+             const unsigned char *window, size_t wlen, int unknown);
+void dfl_free(dfl *d);
+int dfl_block(dfl *d);
+int64_t dfl_find_block(const unsigned char *in, size_t len, uint64_t from,
+                       uint64_t to);
+
+// Pull-style decompressor that hands out successive output windows. Used
+// where more than one stream has to be driven at a time.
+typedef struct {
+    gz_volumes in;                  // the file, or a set of split volumes
+    z_stream strm;
+    int mode;                       // GZIP, ZLIB, or PLAIN
+    int ret;                        // sticky zlib status
+    uint64_t totin;                 // compressed bytes read
+    uint64_t totout;                // uncompressed bytes delivered
+    uint64_t members;               // completed gzip/zlib streams
+    unsigned char buf[CHUNK];
+    unsigned char win[WINSIZE];
+} gz_scan;
+
+// scan.c
+int detect_mode(const unsigned char *p, size_t n);
+int scan_open(gz_scan *s, const char *path);
+long scan_read(gz_scan *s, const unsigned char **data);
+void scan_close(gz_scan *s);
+
+// cmp.c
+int cmp_serial(const char *a, const char *b, uint64_t *off);
+
+// cdc.c
+uint64_t hash64(const unsigned char *p, size_t n, uint64_t seed);
+
+// pool.c
+int pool_threads(int requested);
+void pool_run(int threads, size_t n, void (*job)(void *ctx, size_t i),
+              void *ctx);
+
+// Random access index (index.c): access points at which decompression can
+// restart, in the manner of zran.
+#define SPAN 1048576U               // default uncompressed bytes between points
+
+typedef struct {
+    uint64_t out;                   // uncompressed offset
+    uint64_t in;                    // compressed offset of the next full byte
+    int bits;                       // bits of the byte before in to use, 0..7
+    unsigned char *window;          // the WINSIZE bytes before out, or NULL
+                                    // at a member start, which needs none
+} gz_point;
+
+typedef struct {
+    int mode;                       // GZIP, ZLIB or RAW
+    uint64_t span;                  // minimum distance between points
+    uint64_t length;                // total uncompressed size
+    uint64_t csize, mtime;          // the indexed file, to detect changes
+    size_t have, size;
+    gz_point *list;
+} gz_index;
+
+int gz_index_build(char *name, gz_index *x, uint64_t span,
+                   const verify_hooks *hooks);
+int gz_point_start(int fd, const gz_point *p, z_stream *strm);
+int gz_index_read(const gz_index *x, int fd, uint64_t off, uint64_t len,
+                  int (*sink)(void *ctx, const unsigned char *data, size_t len),
+                  void *ctx);
+int gz_point_read(const gz_point *p, int mode, int fd, uint64_t off,
+                  uint64_t len,
+                  int (*sink)(void *ctx, const unsigned char *data, size_t len),
+                  void *ctx);
+int gz_index_save(FILE *out, const gz_index *x);
+int gz_index_load(FILE *in, gz_index *x);
+int gz_index_stale(const gz_index *x, int fd);
+void gz_index_free(gz_index *x);
+void put_le(FILE *out, uint64_t v, int n);
+int get_le(FILE *in, int n, uint64_t *v);
+
+// Load an index in any of the formats idxfmt.c reads (idxfmt.c).
+int gz_index_open(const char *path, int fd, gz_index *x);
+
+// Random-access reader (reader.c), safe to share between threads. Spans of
+// output between access points are decoded on demand into a shared cache.
+typedef struct gz_reader gz_reader;
+
+gz_reader *gz_reader_open(char *path, const char *index, uint64_t span,
+                          size_t cache);
+long gz_pread(gz_reader *r, void *buf, size_t len, uint64_t off);
+uint64_t gz_reader_length(const gz_reader *r);
+void gz_reader_stats(gz_reader *r, uint64_t *hits, uint64_t *misses);
+void gz_reader_close(gz_reader *r);
+
+// zstd, xz and bzip2 files (formats.c).
+const char *other_format(const unsigned char *p, size_t n);
+int other_info(const char *name, int check, int threads);
+
+// Verification of a file that arrives in pieces in any order (chunks.c).
+typedef struct gz_chunks gz_chunks;
+
+gz_chunks *gz_chunks_open(uint64_t size);
+int gz_chunks_add(gz_chunks *c, uint64_t off, const void *data, size_t len);
+int gz_chunks_result(gz_chunks *c, uint64_t *members, uint64_t *out,
+                     uint64_t *bad);
+void gz_chunks_close(gz_chunks *c);
+
+// Compact index (compact.c), used in place from a memory map. Each window is
+// cut down to the bytes that the data after its point copies from, and
+// compressed. Offsets are searched in Eytzinger order.
+typedef struct {
+    unsigned char *map;
+    size_t len;
+    int mode;
+    uint64_t span, length, csize, mtime;
+    size_t n;                       // access points
+    const uint64_t *eytz;           // their offsets, in Eytzinger order from 1
+    const uint32_t *rank;           // the point at each of those
+    const unsigned char *point;     // fixed-size point records
+} gz_compact;
+
+int gz_compact_save(const char *path, const gz_index *x, int fd, int threads);
+int gz_compact_open(const char *path, gz_compact *c);
+size_t gz_compact_find(const gz_compact *c, uint64_t off);
+int gz_compact_point(const gz_compact *c, size_t i, gz_point *p,
+                     unsigned char *window);
+int gz_compact_expand(const gz_compact *c, gz_index *x);
+void gz_compact_close(gz_compact *c);
+
+// A value for each fixed span of uncompressed output, grown as the output
+// comes (timeline.c).
+typedef struct {
+    double *v;
+    size_t n, room;
+} gz_spans;
+
+int spans_reach(gz_spans *s, uint64_t i);
+int spans_share(gz_spans *s, uint64_t span, uint64_t from, uint64_t to,
+                double v);
+
+// Subcommands. Each takes its own argv with argv[0] set to the command name.
+int cmd_cmp(int argc, char **argv);
+int cmd_cdc(int argc, char **argv);
+int cmd_dedup(int argc, char **argv);
+int cmd_estimate(int argc, char **argv);
+int cmd_sample(int argc, char **argv);
+int cmd_recover(int argc, char **argv);
+int cmd_carve(int argc, char **argv);
+int cmd_zip(int argc, char **argv);
+int cmd_tar(int argc, char **argv);
+int cmd_pack(int argc, char **argv);
+int cmd_volumes(int argc, char **argv);
+int cmd_dictzip(int argc, char **argv);
+int cmd_index(int argc, char **argv);
+int cmd_lines(int argc, char **argv);
+int cmd_range(int argc, char **argv);
+int cmd_read(int argc, char **argv);
+int cmd_chunks(int argc, char **argv);
+int cmd_info(int argc, char **argv);
+int cmd_symbols(int argc, char **argv);
+int cmd_advise(int argc, char **argv);
+int cmd_timeline(int argc, char **argv);
+int cmd_entropy(int argc, char **argv);
+int cmd_diagnose(int argc, char **argv);
+int cmd_plan(int argc, char **argv);
+
+#endif
@@ -0,0 +1,644 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Index files from other tools, read and written alongside gzinfo's own.
+// bgzip -i writes a .gzi: a count, then the compressed and uncompressed
+// offsets of every BGZF block after the first, as 64-bit little-endian
+// integers. indexed_gzip writes GZIDX files of zran access points with their
+// windows, which rapidgzip can also export. Conversion between the formats
+// reads at most member headers and trailers, and never decompresses, except
+// to the compact format (compact.c), which decodes a little after each point
+// to learn which window bytes are used. Any of them can then drive parallel
+// verification and range extraction.
+
+enum { GZX, GZI, GZIDX, GZXC };
+static const char *fmt_name[] = {"gzx", "gzi", "gzidx", "gzxc"};
+
+// Return the length of the member header at off, or -1 if there isn't one.
+// Set *bsize to its BGZF block size, or 0.
+static long header_at(int fd, uint64_t off, uint64_t size, uint64_t *bsize) {
+    unsigned char hdr[1024];
+    gz_hdr h;
+    if (off >= size)
+        return -1;
+    size_t want = size - off < sizeof(hdr) ? size - off : sizeof(hdr);
+    if (pread_full(fd, hdr, want, off) < 0 || gz_header_parse(hdr, want, &h) <= 0)
+        return -1;
+    *bsize = h.bsize;
+    return h.hdrlen;
+}
+
+// Append a point to x, taking ownership of window. Return 0 or -1.
+static int add_point(gz_index *x, uint64_t out, uint64_t in, int bits,
+                     unsigned char *window) {
+    if (x->have == x->size) {
+        size_t size = x->size ? x->size << 1 : 16;
+        gz_point *more = realloc(x->list, size * sizeof(gz_point));
+        if (more == NULL) {
+            free(window);
+            return -1;
+        }
+        x->list = more;
+        x->size = size;
+    }
+    gz_point *p = x->list + x->have++;
+    p->out = out;
+    p->in = in;
+    p->bits = bits;
+    p->window = window;
+    return 0;
+}
+
+// Load a .gzi for the BGZF file open on fd. Each block start becomes a point
+// just past its header that needs no window. Return 0, or -1 with *why set.
+static int gzi_load(FILE *f, int fd, gz_index *x, const char **why) {
+    struct stat st;
+    uint64_t n, c = 0, u = 0, coff = 0, uoff = 0, bsize;
+    *why = "not a .gzi file";
+    if (fstat(fd, &st) < 0 || get_le(f, 8, &n) ||
+        n > (uint64_t)st.st_size / 28 + 1)      // 28: an empty BGZF block
+        return -1;
+    x->mode = GZIP;
+    x->csize = st.st_size;
+    x->mtime = st.st_mtime;
+    x->span = UINT64_MAX;
+    for (uint64_t i = 0; i <= n; i++) {
+        // The first block, at 0 and 0, is not listed.
+        if (i && (get_le(f, 8, &c) || get_le(f, 8, &u) || c <= coff || u < uoff))
+            return -1;
+        if (c == x->csize)                  // the end of the last block
+            break;
+        long len = header_at(fd, c, x->csize, &bsize);
+        if (len < 0) {
+            *why = "offset is not at a member header";
+            return -1;
+        }
+        if (add_point(x, u, c + len, 0, NULL) < 0) {
+            *why = "out of memory";
+            return -1;
+        }
+        if (i && u - uoff < x->span)
+            x->span = u - uoff;
+        coff = c;
+        uoff = u;
+    }
+
+    // The total is the last point's offset plus the sizes of the blocks from
+    // there on, from their trailers.
+    x->length = uoff;
+    while (coff < x->csize) {
+        unsigned char trl[4];
+        long len = header_at(fd, coff, x->csize, &bsize);
+        if (len < 0 || bsize < (uint64_t)len + 8 || bsize > x->csize - coff ||
+            pread_full(fd, trl, 4, coff + bsize - 4) < 0) {
+            *why = "the file is not BGZF";
+            return -1;
+        }
+        x->length += le32(trl);
+        coff += bsize;
+    }
+    if (x->have < 2)
+        x->span = x->length;
+    *why = NULL;
+    return 0;
+}
+
+// Write a .gzi for the n BGZF blocks m, as found from their headers and
+// trailers.
+static int gzi_save(FILE *f, const gz_member *m, long n) {
+    uint64_t uoff = 0;
+    put_le(f, n ? n - 1 : 0, 8);
+    for (long i = 1; i < n; i++) {
+        uoff += m[i - 1].isize;
+        put_le(f, m[i].off, 8);
+        put_le(f, uoff, 8);
+    }
+    return ferror(f) ? -1 : 0;
+}
+
+// Load an indexed_gzip GZIDX file, version 0 or 1, for the file open on fd.
+// Version 0 has a window for every point but the first, version 1 a flag per
+// point. A point without a window at a member header, such as indexed_gzip's
+// first at offset 0, is moved past it. Return 0, or -1 with *why set.
+static int gzidx_load(FILE *f, int fd, gz_index *x, const char **why) {
+    char magic[5];
+    uint64_t v[8];
+    struct stat st;
+    unsigned char head = 0;
+    *why = "not a GZIDX file";
+    if (fread(magic, 1, 5, f) != 5 || memcmp(magic, "GZIDX", 5) ||
+        get_le(f, 1, v) || v[0] > 1 || get_le(f, 1, v + 1) ||
+        get_le(f, 8, v + 2) || get_le(f, 8, v + 3) || get_le(f, 4, v + 4) ||
+        get_le(f, 4, v + 5) || get_le(f, 4, v + 6))
+        return -1;
+    if (fstat(fd, &st) < 0 || v[2] != (uint64_t)st.st_size) {
+        *why = "it was built from a different file";
+        return -1;
+    }
+    if (v[5] != WINSIZE) {
+        *why = "its window size is not 32K";
+        return -1;
+    }
+    if (v[3] == 0) {
+        *why = "it is incomplete (no uncompressed size)";
+        return -1;
+    }
+    // The same rule verify_gzip() uses to choose the mode.
+    x->mode = pread(fd, &head, 1, 0) == 1 && (head & 0xf) == 8 ? ZLIB :
+              head == 0x1f ? GZIP : RAW;
+    x->csize = v[2];
+    x->length = v[3];
+    x->span = v[4];
+    x->mtime = st.st_mtime;
+    if (v[6] > x->csize + 1)
+        return -1;
+    for (uint64_t i = 0; i < v[6]; i++) {
+        unsigned char *window = NULL;
+        v[7] = i > 0;
+        if (get_le(f, 8, v + 1) || get_le(f, 8, v + 2) || get_le(f, 1, v + 3) ||
+            (v[0] > 0 && get_le(f, 1, v + 7)) || v[3] > 7)
+            return -1;
+        if (v[7] && (window = malloc(WINSIZE)) == NULL) {
+            *why = "out of memory";
+            return -1;
+        }
+        if (add_point(x, v[2], v[1], v[3], window) < 0) {
+            *why = "out of memory";
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < x->have; i++) {
+        gz_point *p = x->list + i;
+        uint64_t bsize;
+        long len;
+        if (p->window != NULL) {
+            if (fread(p->window, 1, WINSIZE, f) != WINSIZE)
+                return -1;
+        }
+        else if (p->bits == 0 && x->mode == GZIP &&
+                 (len = header_at(fd, p->in, x->csize, &bsize)) > 0)
+            p->in += len;
+        else if (p->bits == 0 && x->mode == ZLIB && p->in == 0)
+            p->in = 2;
+    }
+    *why = NULL;
+    return 0;
+}
+
+// Write x as a version 1 GZIDX file. A point at the very start is written as
+// indexed_gzip writes its own, at offset 0 with no window. Other points that
+// need no window are member starts, and get a window of zeros, which they
+// never refer to.
+static int gzidx_save(FILE *f, const gz_index *x) {
+    static const unsigned char zeros[WINSIZE];
+    fwrite("GZIDX", 1, 5, f);
+    put_le(f, 1, 1);
+    put_le(f, 0, 1);
+    put_le(f, x->csize, 8);
+    put_le(f, x->length, 8);
+    put_le(f, x->span < UINT32_MAX ? x->span : UINT32_MAX, 4);
+    put_le(f, WINSIZE, 4);
+    put_le(f, x->have, 4);
+    for (size_t i = 0; i < x->have; i++) {
+        const gz_point *p = x->list + i;
+        int start = p->out == 0 && i == 0;
+        put_le(f, start ? 0 : p->in, 8);
+        put_le(f, p->out, 8);
+        put_le(f, start ? 0 : p->bits, 1);
+        put_le(f, !start, 1);
+    }
+    for (size_t i = 0; i < x->have; i++)
+        if (x->list[i].out || i)
+            fwrite(x->list[i].window != NULL ? x->list[i].window : zeros, 1,
+                   WINSIZE, f);
+    return ferror(f) ? -1 : 0;
+}
+
+// Return the format named by s, or by the extension of the file name s, or -1.
+static int format(const char *s, int by_name) {
+    const char *dot = strrchr(s, '.');
+    if (by_name)
+        s = dot == NULL ? "" : dot + 1;
+    for (int i = 0; i < 4; i++)
+        if (strcmp(s, fmt_name[i]) == 0)
+            return i;
+    return by_name ? GZX : -1;
+}
+
+// Load the index in path, in whichever format it is, for the file open on fd.
+// Return the format, or -1 after a message.
+int gz_index_open(const char *path, int fd, gz_index *x) {
+    FILE *f = fopen(path, "rb");
+    char magic[5] = {0};
+    const char *why = "not a complete index";
+    memset(x, 0, sizeof(gz_index));
+    if (f == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", path);
+        return -1;
+    }
+    size_t got = fread(magic, 1, 5, f);
+    rewind(f);
+    int fmt = got >= 4 && memcmp(magic, "GZIX", 4) == 0 ? GZX :
+              got >= 4 && memcmp(magic, "GZXC", 4) == 0 ? GZXC :
+              got == 5 && memcmp(magic, "GZIDX", 5) == 0 ? GZIDX : GZI;
+    gz_compact c;
+    int ret = fmt == GZX ? gz_index_load(f, x) :
+              fmt == GZIDX ? gzidx_load(f, fd, x, &why) :
+              fmt == GZI ? gzi_load(f, fd, x, &why) :
+              gz_compact_open(path, &c) < 0 ? -1 : gz_compact_expand(&c, x);
+    fclose(f);
+    if (fmt == GZXC)
+        gz_compact_close(&c);
+    if (ret == 0 && (fmt == GZX || fmt == GZXC) && gz_index_stale(x, fd)) {
+        why = "it was built from a different file";
+        ret = -1;
+    }
+    if (ret == 0 && x->have == 0) {
+        why = "it has no access points";
+        ret = -1;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "gzinfo: cannot use %s as a %s index: %s\n", path,
+                fmt_name[fmt], why);
+        gz_index_free(x);
+        return -1;
+    }
+    return fmt;
+}
+
+// Save x to path in format fmt. Return 0, or -1 after a message.
+static int save_as(const char *path, int fmt, const gz_index *x, int fd,
+                   int threads) {
+    if (fmt == GZXC)
+        return gz_compact_save(path, x, fd, threads);
+    gz_member *m = NULL;
+    long n = fmt == GZI ? gz_hop_members(fd, &m) : 0;
+    if (n < 0) {
+        fprintf(stderr, "gzinfo: a .gzi can only describe a BGZF file\n");
+        return -1;
+    }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for writing\n", path);
+        free(m);
+        return -1;
+    }
+    int ret = fmt == GZX ? gz_index_save(f, x) :
+              fmt == GZIDX ? gzidx_save(f, x) : gzi_save(f, m, n);
+    free(m);
+    if (fclose(f) != 0 || ret < 0) {
+        fprintf(stderr, "gzinfo: write error on %s\n", path);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+// Parallel verification, one job per access point, decoding up to the next.
+// A member usually spans several of them, so each job returns the check
+// value of the output up to the first member end and of the output after the
+// last, and the trailer it found. Members that start and end within one job
+// are checked by zlib.
+typedef struct {
+    int ret;                        // Z_OK or an error
+    uint64_t head;                  // bytes up to the first member end, or all
+    uLong hsum;                     // their check value
+    int ended;                      // a member ended in the segment
+    unsigned char trailer[8];       // the trailer of that member
+    uint64_t tail;                  // bytes after the last member end
+    uLong tsum;
+    uint64_t members;               // other members ended in the segment
+} segment;
+
+struct verify {
+    const gz_index *x;
+    int fd;
+    segment *seg;
+};
+
+static uLong sum(int mode, uLong v, const unsigned char *p, size_t n) {
+    return mode == ZLIB ? adler32(v, p, n) : crc32(v, p, n);
+}
+
+// Take n bytes from the input of strm, refilling it as needed.
+static int take(int fd, z_stream *strm, unsigned char *buf, uint64_t *at,
+                unsigned char *dst, unsigned n) {
+    while (n) {
+        if (strm->avail_in == 0) {
+            ssize_t got = pread(fd, buf, CHUNK, (off_t)*at);
+            if (got <= 0)
+                return -1;
+            strm->next_in = buf;
+            strm->avail_in = got;
+            *at += got;
+        }
+        unsigned k = n < strm->avail_in ? n : strm->avail_in;
+        memcpy(dst, strm->next_in, k);
+        strm->next_in += k;
+        strm->avail_in -= k;
+        dst += k;
+        n -= k;
+    }
+    return 0;
+}
+
+static void verify_job(void *ctx, size_t i) {
+    struct verify *v = ctx;
+    const gz_index *x = v->x;
+    segment *s = v->seg + i;
+    uint64_t end = i + 1 < x->have ? x->list[i + 1].out : x->length;
+    uint64_t at = x->list[i].in, pos = x->list[i].out;
+    unsigned char *buf = malloc(CHUNK + WINSIZE), *win = buf + CHUNK;
+    z_stream strm = {0};
+    s->hsum = s->tsum = sum(x->mode, 0, NULL, 0);
+    s->ret = buf == NULL ? Z_MEM_ERROR : gz_point_start(v->fd, x->list + i, &strm);
+    if (s->ret != Z_OK) {
+        free(buf);
+        return;
+    }
+
+    // Decode up to the next point, then once more with no room for output,
+    // which finishes a member that ends exactly there. Errors in that last
+    // call belong to the next segment.
+    int ret = Z_OK, eof = 0;
+    for (;;) {
+        int last = pos == end;
+        if (strm.avail_in == 0 && !eof) {
+            ssize_t got = pread(v->fd, buf, CHUNK, (off_t)at);
+            if (got < 0 || (got == 0 && !last)) {
+                ret = got < 0 ? Z_ERRNO : Z_BUF_ERROR;
+                break;
+            }
+            eof = got == 0;
+            strm.next_in = buf;
+            strm.avail_in = got;
+            at += got;
+        }
+        strm.next_out = win;
+        strm.avail_out = last ? 0 : end - pos < WINSIZE ? end - pos : WINSIZE;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        size_t got = (size_t)(strm.next_out - win);
+        if (s->ended) {
+            s->tsum = sum(x->mode, s->tsum, win, got);
+            s->tail += got;
+        }
+        else {
+            s->hsum = sum(x->mode, s->hsum, win, got);
+            s->head += got;
+        }
+        pos += got;
+        if (ret == Z_STREAM_END) {
+            ret = Z_OK;
+            if (s->ended) {
+                s->members++;
+                s->tail = 0;
+                s->tsum = sum(x->mode, 0, NULL, 0);
+            }
+            else {
+                // The member began at or before this point, so its check
+                // is left for later, when all of its segments are in.
+                s->ended = 1;
+                if (x->mode == RAW)
+                    break;
+                if (take(v->fd, &strm, buf, &at, s->trailer,
+                         x->mode == GZIP ? 8 : 4) < 0) {
+                    ret = Z_BUF_ERROR;
+                    break;
+                }
+                if (x->mode == ZLIB)
+                    break;
+            }
+            // A member that starts at the next point is the next segment's.
+            if (pos == end)
+                break;
+            inflateReset2(&strm, GZIP);
+            continue;
+        }
+        if (last) {
+            // Input ran out before the member could end: it may straddle it.
+            if (strm.avail_in == 0 && !eof && ret != Z_DATA_ERROR)
+                continue;
+            ret = Z_OK;
+            break;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            ret = ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
+            break;
+        }
+        ret = Z_OK;
+    }
+    if (ret == Z_OK && pos < end)
+        ret = Z_BUF_ERROR;
+    s->ret = ret;
+    inflateEnd(&strm);
+    free(buf);
+}
+
+// Verify the file open on fd with the index x. Return the number of failures.
+static long verify(const gz_index *x, int fd, int threads, uint64_t *members) {
+    segment *seg = calloc(x->have, sizeof(segment));
+    if (seg == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        return 1;
+    }
+    struct verify v = {x, fd, seg};
+    pool_run(threads, x->have, verify_job, &v);
+
+    // Piece each member's check value together from its segments and compare
+    // it with the trailer. After a failed segment, the member it was in can't
+    // be checked, and checking picks up again at the next member.
+    uLong check = sum(x->mode, 0, NULL, 0);
+    uint64_t len = 0;
+    long failed = 0;
+    int broken = 0;
+    *members = 0;
+    for (size_t i = 0; i < x->have; i++) {
+        segment *s = seg + i;
+        if (s->ret != Z_OK) {
+            printf("FAILED: segment %zu at %llu: %s\n", i,
+                   (unsigned long long)x->list[i].in,
+                   s->ret == Z_ERRNO ? "read error" : s->ret == Z_BUF_ERROR ?
+                   "unexpected end of data" : "corrupt data");
+            failed++;
+            broken = 1;
+            continue;
+        }
+        check = x->mode == ZLIB ? adler32_combine(check, s->hsum, s->head) :
+                crc32_combine(check, s->hsum, s->head);
+        len += s->head;
+        if (!s->ended)
+            continue;
+        uint32_t want = x->mode == ZLIB ?
+            ((uint32_t)s->trailer[0] << 24) | (s->trailer[1] << 16) |
+            (s->trailer[2] << 8) | s->trailer[3] : le32(s->trailer);
+        if (!broken && x->mode != RAW && (want != check ||
+            (x->mode == GZIP && le32(s->trailer + 4) != (uint32_t)len))) {
+            printf("FAILED: member ending in segment %zu: %s mismatch\n", i,
+                   want != check ? "check value" : "length");
+            failed++;
+        }
+        broken = 0;
+        *members += 1 + s->members;
+        check = s->tsum;
+        len = s->tail;
+    }
+    if (!broken && (len || *members == 0)) {
+        printf("FAILED: the last member is incomplete\n");
+        failed++;
+    }
+    free(seg);
+    return failed;
+}
+
+static int write_sink(void *ctx, const unsigned char *data, size_t len) {
+    return fwrite(data, 1, len, ctx) != len;
+}
+
+static int compact_read(const gz_compact *c, int fd, uint64_t off,
+                        uint64_t len, FILE *out) {
+    unsigned char window[WINSIZE];
+    gz_point p;
+    if (gz_compact_point(c, gz_compact_find(c, off), &p, window) < 0)
+        return Z_DATA_ERROR;
+    return gz_point_read(&p, c->mode, fd, off, len, write_sink, out);
+}
+
+int cmd_index(int argc, char **argv) {
+    int threads = 0, fmt = -1, bad = 0, opt;
+    uint64_t span = 0;
+    char *save = NULL;
+    while ((opt = getopt(argc, argv, "s:f:o:j:")) != -1)
+        switch (opt) {
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            bad |= (fmt = format(optarg, 0)) < 0;
+            break;
+        case 'o':
+            save = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    int args = argc - optind;
+    char *op = args ? argv[optind] : "", *end = "";
+    uint64_t roff = 0, rlen = 0;
+    if (args == 4 && strcmp(op, "extract") == 0) {
+        roff = strtoull(argv[optind + 3], &end, 0);
+        if (*end == ':')
+            rlen = strtoull(end + 1, &end, 0);
+    }
+    if (bad || !((args == 2 && strcmp(op, "build") == 0) ||
+                 (args == 3 && strcmp(op, "convert") == 0 && save != NULL) ||
+                 (args == 3 && strcmp(op, "verify") == 0) ||
+                 (args == 4 && strcmp(op, "extract") == 0 && !*end && rlen))) {
+        fprintf(stderr, "usage: gzinfo index [-s span] [-f format] [-o out] [-j threads] build file\n"
+                        "       gzinfo index [-f format] [-j threads] -o out convert file index\n"
+                        "       gzinfo index [-j threads] verify file index\n"
+                        "       gzinfo index [-o out] extract file index offset:length\n"
+                        "formats: gzx (gzinfo), gzxc (gzinfo, compact), gzi (bgzip),\n"
+                        "         gzidx (indexed_gzip)\n");
+        return 1;
+    }
+    char *name = argv[optind + 1], path[4096];
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        return 1;
+    }
+
+    gz_index x;
+    gz_compact c = {0};
+    int ret = 0, from = GZX;
+    memset(&x, 0, sizeof(x));
+    if (strcmp(op, "extract") == 0 && gz_compact_open(argv[optind + 2], &c) == 0) {
+        // Used in place: only the one window needed is expanded.
+        gz_index h = {.csize = c.csize, .mtime = c.mtime};
+        if (gz_index_stale(&h, fd)) {
+            fprintf(stderr, "gzinfo: cannot use %s as a gzxc index: it was "
+                            "built from a different file\n", argv[optind + 2]);
+            gz_compact_close(&c);
+            close(fd);
+            return 1;
+        }
+        x.mode = c.mode;
+        x.length = c.length;
+    }
+    else if (strcmp(op, "build") == 0) {
+        if (fmt < 0)
+            fmt = save == NULL ? GZX : format(save, 1);
+        if (save == NULL) {
+            snprintf(path, sizeof(path), "%s.%s", name, fmt_name[fmt]);
+            save = path;
+        }
+        if (gz_index_build(name, &x, span, NULL) != Z_OK) {
+            close(fd);
+            return 1;
+        }
+    }
+    else if ((from = gz_index_open(argv[optind + 2], fd, &x)) < 0) {
+        close(fd);
+        return 1;
+    }
+
+    if (strcmp(op, "build") == 0 || strcmp(op, "convert") == 0) {
+        if (fmt < 0)
+            fmt = format(save, 1);
+        struct stat st;
+        if (save_as(save, fmt, &x, fd, threads) < 0)
+            ret = 1;
+        else if (strcmp(op, "build") == 0)
+            printf("Indexed %zu access points %s apart, in %s (%s)\n", x.have,
+                   humanSize(x.span), save, fmt_name[fmt]);
+        else
+            printf("Converted %s index of %zu access points to %s (%s)\n",
+                   fmt_name[from], x.have, save, fmt_name[fmt]);
+        if (ret == 0 && stat(save, &st) == 0)
+            printf("Index Size: %s (%.2f%% of the compressed data)\n",
+                   humanSize(st.st_size), x.csize ?
+                   100.0 * st.st_size / x.csize : 0.0);
+    }
+    else if (strcmp(op, "verify") == 0) {
+        uint64_t members = 0;
+        long failed = verify(&x, fd, threads, &members);
+        printf("Index: %s, %zu access points\n", fmt_name[from], x.have);
+        printf("Uncompressed Size: %s\n", humanSize(x.length));
+        if (x.mode == GZIP)
+            printf("Number of GZIP Members: %llu\n", (unsigned long long)members);
+        printf("Failed: %ld\n", failed);
+        ret = failed != 0;
+    }
+    else {
+        FILE *out = save == NULL ? stdout : fopen(save, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "gzinfo: could not open %s for writing\n", save);
+            ret = 1;
+        }
+        else if (roff > x.length || rlen > x.length - roff) {
+            fprintf(stderr, "gzinfo: range is past the end (%llu bytes)\n",
+                    (unsigned long long)x.length);
+            ret = 1;
+        }
+        else if ((c.map != NULL ? compact_read(&c, fd, roff, rlen, out) :
+                  gz_index_read(&x, fd, roff, rlen, write_sink, out)) != Z_OK) {
+            fprintf(stderr, "gzinfo: could not extract the range\n");
+            ret = 1;
+        }
+        if (out != NULL && out != stdout && fclose(out) != 0) {
+            fprintf(stderr, "gzinfo: write error on %s\n", save);
+            ret = 1;
+        }
+    }
+    close(fd);
+    gz_index_free(&x);
+    gz_compact_close(&c);
+    return ret;
+}
@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Random access index. The access points reported by verify_gzip() are kept
+// at least span uncompressed bytes apart, each with the window needed to
+// restart decompression there. A range is then read by raw inflating from the
+// last point before it, which costs at most span bytes of decompression
+// beyond the range itself.
+
+#define MAGIC "GZIX"
+#define VERSION 2               // 1 had no window flags
+
+struct builder {
+    gz_index *x;
+    const verify_hooks *hooks;      // the caller's, passed along
+    int err;
+};
+
+static void build_window(void *ctx, const unsigned char *data, size_t len) {
+    struct builder *b = ctx;
+    if (b->hooks != NULL && b->hooks->window != NULL)
+        b->hooks->window(b->hooks->ctx, data, len);
+}
+
+static void build_point(void *ctx, uint64_t in, int bits, uint64_t out,
+                        const unsigned char *win, unsigned pos) {
+    struct builder *b = ctx;
+    gz_index *x = b->x;
+    if (b->hooks != NULL && b->hooks->point != NULL)
+        b->hooks->point(b->hooks->ctx, in, bits, out, win, pos);
+    if (b->err || (x->have && out - x->list[x->have - 1].out < x->span))
+        return;
+    if (x->have == x->size) {
+        size_t size = x->size ? x->size << 1 : 16;
+        gz_point *more = realloc(x->list, size * sizeof(gz_point));
+        if (more == NULL) {
+            b->err = 1;
+            return;
+        }
+        x->list = more;
+        x->size = size;
+    }
+    gz_point *p = x->list + x->have;
+    p->window = malloc(WINSIZE);
+    if (p->window == NULL) {
+        b->err = 1;
+        return;
+    }
+    p->out = out;
+    p->in = in;
+    p->bits = bits;
+    if (pos > WINSIZE)
+        pos = WINSIZE;
+    memcpy(p->window, win + pos, WINSIZE - pos);
+    memcpy(p->window + WINSIZE - pos, win, pos);
+    x->have++;
+}
+
+// Decompress the file name, building an index into *x with points at least
+// span bytes apart. hooks, if not NULL, see the same calls as the index.
+// Return Z_OK or an error as from verify_gzip().
+int gz_index_build(char *name, gz_index *x, uint64_t span,
+                   const verify_hooks *hooks) {
+    memset(x, 0, sizeof(gz_index));
+    x->span = span ? span : SPAN;
+    if (vol_single(name) < 0)
+        return Z_DATA_ERROR;
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    unsigned char head = 0;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return Z_ERRNO;
+    }
+    // The same rule verify_gzip() uses to choose the mode.
+    x->mode = pread(fd, &head, 1, 0) == 1 && (head & 0xf) == 8 ? ZLIB :
+              head == 0x1f ? GZIP : RAW;
+    x->csize = st.st_size;
+    x->mtime = st.st_mtime;
+    close(fd);
+
+    struct builder b = {x, hooks, 0};
+    verify_hooks mine = {build_window, build_point, &b};
+    int ret = verify_gzip(name, &mine);
+    x->length = uncompressed_size;
+    if (ret == Z_OK && b.err) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        ret = Z_MEM_ERROR;
+    }
+    if (ret != Z_OK)
+        gz_index_free(x);
+    return ret;
+}
+
+// Start a raw inflate in *strm at the access point p of the file open on fd.
+// Return Z_OK or a zlib error, in which case there is nothing to end.
+int gz_point_start(int fd, const gz_point *p, z_stream *strm) {
+    int ret = inflateInit2(strm, RAW);
+    if (ret != Z_OK)
+        return ret;
+    if (p->bits) {
+        unsigned char c;
+        if (pread_full(fd, &c, 1, p->in - 1) < 0) {
+            inflateEnd(strm);
+            return Z_ERRNO;
+        }
+        inflatePrime(strm, p->bits, c >> (8 - p->bits));
+    }
+    if (p->window != NULL && p->out)
+        inflateSetDictionary(strm, p->window, WINSIZE);
+    return Z_OK;
+}
+
+// Decompress len bytes at uncompressed offset off of the file open on fd,
+// indexed by x, passing them to sink in order. sink returns non-zero to stop
+// early. Return Z_OK, Z_BUF_ERROR if the data ends first, or a zlib error.
+int gz_index_read(const gz_index *x, int fd, uint64_t off, uint64_t len,
+                  int (*sink)(void *ctx, const unsigned char *data, size_t len),
+                  void *ctx) {
+    if (x->have == 0)
+        return Z_DATA_ERROR;
+
+    // Find the last access point at or before off.
+    size_t lo = 0, hi = x->have;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (x->list[mid].out <= off)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return gz_point_read(x->list + lo, x->mode, fd, off, len, sink, ctx);
+}
+
+// The same, decompressing from the access point p at or before off in a
+// stream of the given mode.
+int gz_point_read(const gz_point *p, int mode, int fd, uint64_t off,
+                  uint64_t len,
+                  int (*sink)(void *ctx, const unsigned char *data, size_t len),
+                  void *ctx) {
+    if (len == 0)
+        return Z_OK;
+    unsigned char *buf = malloc(CHUNK + WINSIZE), *win = buf + CHUNK;
+    z_stream strm = {0};
+    int ret = buf == NULL ? Z_MEM_ERROR : gz_point_start(fd, p, &strm);
+    if (ret != Z_OK) {
+        free(buf);
+        return ret;
+    }
+
+    // Members after the first are started from their headers, so that zlib
+    // checks them. The first is raw, and its trailer is skipped over.
+    uint64_t at = p->in, pos = p->out, end = off + len;
+    int raw = 1;
+    size_t skip = 0;
+    while (pos < end) {
+        if (strm.avail_in == 0) {
+            ssize_t got = pread(fd, buf, CHUNK, (off_t)at);
+            if (got <= 0) {
+                ret = got < 0 ? Z_ERRNO : Z_BUF_ERROR;
+                break;
+            }
+            strm.next_in = buf;
+            strm.avail_in = got;
+            at += got;
+        }
+        if (skip) {
+            size_t n = skip < strm.avail_in ? skip : strm.avail_in;
+            strm.next_in += n;
+            strm.avail_in -= n;
+            if ((skip -= n) == 0)
+                inflateReset2(&strm, GZIP);
+            continue;
+        }
+        strm.next_out = win;
+        strm.avail_out = WINSIZE;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR ||
+            ret == Z_STREAM_ERROR) {
+            ret = ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
+            break;
+        }
+        size_t got = WINSIZE - strm.avail_out;
+        if (pos + got > off) {
+            size_t a = off > pos ? off - pos : 0;
+            size_t b = end - pos < got ? end - pos : got;
+            if (b > a && sink(ctx, win + a, b - a)) {
+                pos = end;
+                ret = Z_OK;
+                break;
+            }
+        }
+        pos += got;
+        if (ret == Z_STREAM_END) {
+            if (mode != GZIP) {
+                ret = Z_OK;
+                break;
+            }
+            if (raw) {
+                raw = 0;
+                skip = 8;
+            }
+            else
+                inflateReset2(&strm, GZIP);
+        }
+        ret = Z_OK;
+    }
+    if (ret == Z_OK && pos < end)
+        ret = Z_BUF_ERROR;
+    inflateEnd(&strm);
+    free(buf);
+    return ret;
+}
+
+// Write integers in little-endian order. get_le() returns -1 at end of file.
+void put_le(FILE *out, uint64_t v, int n) {
+    for (int i = 0; i < n; i++, v >>= 8)
+        putc(v & 0xff, out);
+}
+
+int get_le(FILE *in, int n, uint64_t *v) {
+    *v = 0;
+    for (int i = 0; i < n; i++) {
+        int c = getc(in);
+        if (c == EOF)
+            return -1;
+        *v |= (uint64_t)c << (8 * i);
+    }
+    return 0;
+}
+
+// Save the index to out. Return 0, or -1 on a write error.
+int gz_index_save(FILE *out, const gz_index *x) {
+    fwrite(MAGIC, 1, 4, out);
+    put_le(out, VERSION, 1);
+    put_le(out, (uint32_t)x->mode, 4);
+    put_le(out, x->span, 8);
+    put_le(out, x->length, 8);
+    put_le(out, x->csize, 8);
+    put_le(out, x->mtime, 8);
+    put_le(out, x->have, 8);
+    for (size_t i = 0; i < x->have; i++) {
+        put_le(out, x->list[i].out, 8);
+        put_le(out, x->list[i].in, 8);
+        put_le(out, x->list[i].bits, 1);
+        put_le(out, x->list[i].window != NULL, 1);
+        if (x->list[i].window != NULL)
+            fwrite(x->list[i].window, 1, WINSIZE, out);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+// Load an index saved by gz_index_save(). Return 0, or -1 if it is not one
+// or is incomplete.
+int gz_index_load(FILE *in, gz_index *x) {
+    char magic[4];
+    uint64_t v[8];
+    memset(x, 0, sizeof(gz_index));
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, MAGIC, 4) ||
+        get_le(in, 1, v + 7) || v[7] < 1 || v[7] > VERSION || get_le(in, 4, v))
+        return -1;
+    int version = v[7];
+    x->mode = (int32_t)v[0];
+    for (int i = 1; i < 6; i++)
+        if (get_le(in, 8, v + i))
+            return -1;
+    x->span = v[1];
+    x->length = v[2];
+    x->csize = v[3];
+    x->mtime = v[4];
+    if (v[5] > x->csize + 1 || (x->list = calloc(v[5] ? v[5] : 1,
+                                                sizeof(gz_point))) == NULL)
+        return -1;
+    x->size = v[5];
+    for (; x->have < x->size; x->have++) {
+        gz_point *p = x->list + x->have;
+        v[7] = 1;
+        if (get_le(in, 8, &p->out) || get_le(in, 8, &p->in) ||
+            get_le(in, 1, v + 6) || (version > 1 && get_le(in, 1, v + 7)) ||
+            (v[7] && ((p->window = malloc(WINSIZE)) == NULL ||
+                      fread(p->window, 1, WINSIZE, in) != WINSIZE))) {
+            if (p->window != NULL)
+                x->have++;
+            gz_index_free(x);
+            return -1;
+        }
+        p->bits = v[6];
+    }
+    return 0;
+}
+
+// Return true if the file open on fd is not the one x was built from.
+int gz_index_stale(const gz_index *x, int fd) {
+    struct stat st;
+    return fstat(fd, &st) < 0 || (uint64_t)st.st_size != x->csize ||
+           (uint64_t)st.st_mtime != x->mtime;
+}
+
+void gz_index_free(gz_index *x) {
+    for (size_t i = 0; i < x->have; i++)
+        free(x->list[i].window);
+    free(x->list);
+    x->list = NULL;
+    x->have = x->size = 0;
+}
@@ -0,0 +1,743 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Compressed logs, addressed by line number or by time.
+//
+// For line numbers, the newlines in each run of output are counted while the
+// access-point index is built, and the count at every access point is kept
+// with it in a sidecar. Line N then starts in the span after the last point
+// with fewer than N - 1 newlines before it, so reading a few lines decodes
+// one span or little more.
+//
+// For time, each access point is stamped with the time of the first line
+// after it that starts with a timestamp, which takes decoding only a little
+// past each point. Assuming the log is in time order, lines from a given
+// time on start after the last point stamped earlier than that.
+
+#define LINX "GZLX"
+#define TIMX "GZTM"
+#define PREFIX 256                  // longest line start searched for a time
+#define NOTIME INT64_MIN
+
+typedef struct {
+    gz_index x;
+    uint64_t *nl;                   // newlines before each point
+    uint64_t lines;                 // lines in the file
+} line_index;
+
+struct counter {
+    uint64_t nl;                    // newlines so far
+    int last;                       // the last byte, or -1
+    uint64_t *out, *at;             // offsets and counts at every point seen
+    size_t have, size;
+    int err;
+};
+
+static void count_window(void *ctx, const unsigned char *data, size_t len) {
+    struct counter *c = ctx;
+    uint64_t n = 0;
+    for (size_t i = 0; i < len; i++)
+        n += data[i] == '\n';
+    c->nl += n;
+    c->last = data[len - 1];
+}
+
+static void count_point(void *ctx, uint64_t in, int bits, uint64_t out,
+                        const unsigned char *win, unsigned pos) {
+    struct counter *c = ctx;
+    (void)in, (void)bits, (void)win, (void)pos;
+    if (c->err)
+        return;
+    if (c->have == c->size) {
+        size_t size = c->size ? c->size << 1 : 256;
+        uint64_t *o = realloc(c->out, size * sizeof(uint64_t));
+        uint64_t *a = realloc(c->at, size * sizeof(uint64_t));
+        c->out = o != NULL ? o : c->out;
+        c->at = a != NULL ? a : c->at;
+        if (o == NULL || a == NULL) {
+            c->err = 1;
+            return;
+        }
+        c->size = size;
+    }
+    c->out[c->have] = out;
+    c->at[c->have++] = c->nl;
+}
+
+static void lines_free(line_index *l) {
+    gz_index_free(&l->x);
+    free(l->nl);
+    l->nl = NULL;
+}
+
+static int save_sidecar(const char *path, const line_index *l) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        return -1;
+    fwrite(LINX, 1, 4, out);
+    gz_index_save(out, &l->x);
+    put_le(out, l->lines, 8);
+    for (size_t i = 0; i < l->x.have; i++)
+        put_le(out, l->nl[i], 8);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static int load_sidecar(const char *path, line_index *l) {
+    FILE *in = fopen(path, "rb");
+    char magic[4];
+    memset(l, 0, sizeof(line_index));
+    if (in == NULL)
+        return -1;
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, LINX, 4) ||
+        gz_index_load(in, &l->x) < 0) {
+        fclose(in);
+        return -1;
+    }
+    int bad = get_le(in, 8, &l->lines) ||
+              (l->nl = malloc((l->x.have ? l->x.have : 1) * sizeof(uint64_t))) == NULL;
+    for (size_t i = 0; !bad && i < l->x.have; i++)
+        bad = get_le(in, 8, l->nl + i) || (i && l->nl[i] < l->nl[i - 1]);
+    fclose(in);
+    if (bad) {
+        lines_free(l);
+        return -1;
+    }
+    return 0;
+}
+
+// Build the index with line counts for name, and save it in side.
+static int build(char *name, const char *side, uint64_t span, line_index *l) {
+    struct counter c = {0, -1, NULL, NULL, 0, 0, 0};
+    verify_hooks hooks = {count_window, count_point, &c};
+    memset(l, 0, sizeof(line_index));
+    int ret = gz_index_build(name, &l->x, span, &hooks);
+    if (ret == Z_OK && (c.err || (l->nl = malloc((l->x.have ? l->x.have : 1) *
+                                                 sizeof(uint64_t))) == NULL)) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        gz_index_free(&l->x);
+        ret = Z_MEM_ERROR;
+    }
+    if (ret == Z_OK) {
+        // The index keeps a subset of the points seen, in the same order.
+        size_t k = 0;
+        for (size_t i = 0; i < l->x.have; i++) {
+            while (k < c.have && c.out[k] < l->x.list[i].out)
+                k++;
+            l->nl[i] = k < c.have ? c.at[k] : c.nl;
+        }
+        l->lines = c.nl + (c.last != -1 && c.last != '\n');
+    }
+    free(c.out);
+    free(c.at);
+    if (ret != Z_OK)
+        return -1;
+    if (save_sidecar(side, l) < 0)
+        fprintf(stderr, "gzinfo: could not write the index to %s\n", side);
+    return 0;
+}
+
+// Copy lines first..last, counted from 1, as they go by.
+struct emit {
+    uint64_t nl;                    // newlines passed
+    uint64_t first, last;
+    FILE *out;
+    int err;
+};
+
+static int emit_sink(void *ctx, const unsigned char *data, size_t len) {
+    struct emit *e = ctx;
+    const unsigned char *p = data, *end = data + len;
+    while (p < end) {
+        const unsigned char *nl = memchr(p, '\n', end - p);
+        const unsigned char *stop = nl != NULL ? nl + 1 : end;
+        if (e->nl + 1 >= e->first &&
+            fwrite(p, 1, stop - p, e->out) != (size_t)(stop - p)) {
+            e->err = 1;
+            return 1;
+        }
+        p = stop;
+        if (nl != NULL && ++e->nl >= e->last)
+            return 1;
+    }
+    return 0;
+}
+
+// Write lines first..last of the file open on fd to out. Return Z_OK or an
+// error.
+static int read_lines(const line_index *l, int fd, uint64_t first,
+                      uint64_t last, FILE *out) {
+    // The last point with fewer than first - 1 newlines before it, so that
+    // the newline ending the line before first comes after it.
+    size_t lo = 0, hi = l->x.have;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (l->nl[mid] + 1 < first)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const gz_point *p = l->x.list + lo;
+    struct emit e = {l->nl[lo], first, last, out, 0};
+    int ret = gz_point_read(p, l->x.mode, fd, p->out, l->x.length - p->out,
+                            emit_sink, &e);
+    return e.err ? Z_ERRNO : ret;
+}
+
+int cmd_lines(int argc, char **argv) {
+    int opt;
+    uint64_t span = 0;
+    char *side = NULL, *save = NULL;
+    while ((opt = getopt(argc, argv, "s:i:o:")) != -1)
+        switch (opt) {
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            side = optarg;
+            break;
+        case 'o':
+            save = optarg;
+            break;
+        default:
+            optind = argc;
+        }
+    int args = argc - optind;
+    char *op = args ? argv[optind] : "", *end = op;
+    uint64_t first = 0, last = 0;
+    if (args == 2 && strcmp(op, "index")) {
+        first = last = strtoull(op, &end, 10);
+        if (*end == '-')
+            last = strtoull(end + 1, &end, 10);
+    }
+    if (args != 2 || (strcmp(op, "index") && (*end || first == 0 ||
+                                              last < first))) {
+        fprintf(stderr, "usage: gzinfo lines [-s span] [-i index] [-o out] first[-last] file\n"
+                        "       gzinfo lines [-s span] [-i index] index file\n");
+        return 1;
+    }
+    char *name = argv[optind + 1], path[4096];
+    if (side == NULL) {
+        snprintf(path, sizeof(path), "%s.lidx", name);
+        side = path;
+    }
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        return 1;
+    }
+
+    // Use the sidecar if it is there and still matches, else build it.
+    line_index l;
+    memset(&l, 0, sizeof(l));
+    if (strcmp(op, "index") == 0 || load_sidecar(side, &l) < 0 ||
+        gz_index_stale(&l.x, fd)) {
+        lines_free(&l);
+        if (build(name, side, span, &l) < 0) {
+            close(fd);
+            return 1;
+        }
+    }
+
+    int ret = 0;
+    if (strcmp(op, "index") == 0)
+        printf("Indexed %llu lines, %zu access points %s apart, in %s\n",
+               (unsigned long long)l.lines, l.x.have, humanSize(l.x.span), side);
+    else if (first > l.lines) {
+        fprintf(stderr, "gzinfo: %s has only %llu lines\n", name,
+                (unsigned long long)l.lines);
+        ret = 1;
+    }
+    else {
+        FILE *out = save == NULL ? stdout : fopen(save, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "gzinfo: could not open %s for writing\n", save);
+            ret = 1;
+        }
+        else if (read_lines(&l, fd, first, last, out) != Z_OK) {
+            fprintf(stderr, "gzinfo: could not read lines %llu-%llu\n",
+                    (unsigned long long)first, (unsigned long long)last);
+            ret = 1;
+        }
+        if (out != NULL && out != stdout && fclose(out) != 0) {
+            fprintf(stderr, "gzinfo: write error on %s\n", save);
+            ret = 1;
+        }
+    }
+    close(fd);
+    lines_free(&l);
+    return ret;
+}
+
+// Feed decompressed data in pieces, calling head() with the start of each
+// line, up to PREFIX bytes, and then body() with all of that line's bytes.
+struct splitter {
+    int skip;                       // in a line that began before the start
+    unsigned char pre[PREFIX];
+    size_t fill;
+    int open;                       // collecting the current line's start
+    int (*head)(void *ctx, const unsigned char *pre, size_t len);
+    int (*body)(void *ctx, const unsigned char *data, size_t len);
+    void *ctx;
+};
+
+// Pass on the collected start of a line. Return non-zero to stop.
+static int split_head(struct splitter *s) {
+    s->open = 0;
+    return s->head(s->ctx, s->pre, s->fill) ||
+           (s->body != NULL && s->body(s->ctx, s->pre, s->fill));
+}
+
+static int split_feed(struct splitter *s, const unsigned char *data,
+                      size_t len) {
+    const unsigned char *p = data, *end = data + len;
+    while (p < end) {
+        const unsigned char *nl = memchr(p, '\n', end - p);
+        const unsigned char *stop = nl != NULL ? nl + 1 : end;
+        if (s->skip) {
+            s->skip = nl == NULL;
+            p = stop;
+            continue;
+        }
+        if (s->open) {
+            size_t n = stop - p < (ptrdiff_t)(PREFIX - s->fill) ?
+                       (size_t)(stop - p) : PREFIX - s->fill;
+            memcpy(s->pre + s->fill, p, n);
+            s->fill += n;
+            p += n;
+            if (s->fill < PREFIX && p != stop)
+                continue;
+            if (split_head(s))
+                return 1;
+        }
+        else {
+            if (s->body != NULL && s->body(s->ctx, p, stop - p))
+                return 1;
+            p = stop;
+        }
+        if (p == stop && nl != NULL) {
+            s->open = 1;
+            s->fill = 0;
+        }
+    }
+    return 0;
+}
+
+// Finish a last line with no newline.
+static int split_end(struct splitter *s) {
+    return s->open && s->fill && !s->skip ? split_head(s) : 0;
+}
+
+// Timestamps: a strptime() format found at a column of each line.
+typedef struct {
+    const char *fmt;
+    size_t col;
+} stamp_fmt;
+
+// Days from 1970-01-01 to the given date, proleptic Gregorian.
+static int64_t days(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+// Return the time at the start of the text, in seconds, or NOTIME. Fields
+// missing from the format are zero, the same for every line.
+static int64_t stamp(const stamp_fmt *f, const unsigned char *line,
+                     size_t len) {
+    char buf[PREFIX + 1];
+    struct tm tm;
+    if (len <= f->col)
+        return NOTIME;
+    len -= f->col;
+    memcpy(buf, line + f->col, len);
+    buf[len] = 0;
+    memset(&tm, 0, sizeof(tm));
+    if (strptime(buf, f->fmt, &tm) == NULL)
+        return NOTIME;
+    return days(tm.tm_year + 1900LL, tm.tm_mon + 1, tm.tm_mday) * 86400 +
+           tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+}
+
+typedef struct {
+    gz_index x;
+    int64_t *t;                     // time of the first stamped line after
+                                    // each point, or NOTIME
+    int64_t first, last;            // of the first and last stamped lines
+} time_index;
+
+// Stamp each access point, in parallel. The job for the last point also
+// goes on to the end for the time of the last line.
+struct stamping {
+    const time_index *ti;
+    int64_t *t;
+    const stamp_fmt *f;
+    int fd;
+    int64_t last;
+};
+
+struct stamper {
+    const stamp_fmt *f;
+    int64_t first, last;            // stamps seen
+    int to_end;                     // keep going after the first
+};
+
+static int stamp_head(void *ctx, const unsigned char *pre, size_t len) {
+    struct stamper *s = ctx;
+    int64_t t = stamp(s->f, pre, len);
+    if (t == NOTIME)
+        return 0;
+    if (s->first == NOTIME)
+        s->first = t;
+    s->last = t;
+    return !s->to_end;
+}
+
+static int stamp_sink(void *ctx, const unsigned char *data, size_t len) {
+    return split_feed(ctx, data, len);
+}
+
+static void stamp_job(void *ctx, size_t i) {
+    struct stamping *g = ctx;
+    const gz_index *x = &g->ti->x;
+    const gz_point *p = x->list + i;
+    int end = i + 1 == x->have;
+
+    // Look no further than a little into the next span.
+    uint64_t len = x->length - p->out;
+    if (!end && x->list[i + 1].out - p->out + WINSIZE < len)
+        len = x->list[i + 1].out - p->out + WINSIZE;
+    struct stamper st = {g->f, NOTIME, NOTIME, end};
+    struct splitter sp = {p->out != 0, {0}, 0, p->out == 0, stamp_head, NULL,
+                          &st};
+    gz_point_read(p, x->mode, g->fd, p->out, len, stamp_sink, &sp);
+    split_end(&sp);
+    g->t[i] = st.first;
+    if (end)
+        g->last = st.last;
+}
+
+static void times_free(time_index *ti) {
+    gz_index_free(&ti->x);
+    free(ti->t);
+    ti->t = NULL;
+}
+
+static int save_times(const char *path, const time_index *ti,
+                      const stamp_fmt *f) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        return -1;
+    size_t n = strlen(f->fmt);
+    fwrite(TIMX, 1, 4, out);
+    put_le(out, f->col, 4);
+    put_le(out, n, 4);
+    fwrite(f->fmt, 1, n, out);
+    gz_index_save(out, &ti->x);
+    put_le(out, ti->first, 8);
+    put_le(out, ti->last, 8);
+    for (size_t i = 0; i < ti->x.have; i++)
+        put_le(out, ti->t[i], 8);
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Load the time index in path, if it was made with the same format.
+static int load_times(const char *path, time_index *ti, const stamp_fmt *f) {
+    FILE *in = fopen(path, "rb");
+    char magic[4], fmt[256];
+    uint64_t v[2];
+    memset(ti, 0, sizeof(time_index));
+    if (in == NULL)
+        return -1;
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, TIMX, 4) ||
+        get_le(in, 4, v) || get_le(in, 4, v + 1) || v[0] != f->col ||
+        v[1] != strlen(f->fmt) || v[1] >= sizeof(fmt) ||
+        fread(fmt, 1, v[1], in) != v[1] || memcmp(fmt, f->fmt, v[1]) ||
+        gz_index_load(in, &ti->x) < 0) {
+        fclose(in);
+        return -1;
+    }
+    int bad = get_le(in, 8, v) || get_le(in, 8, v + 1) ||
+              (ti->t = malloc((ti->x.have ? ti->x.have : 1) * sizeof(int64_t))) == NULL;
+    ti->first = v[0];
+    ti->last = v[1];
+    for (size_t i = 0; !bad && i < ti->x.have; i++) {
+        bad = get_le(in, 8, v);
+        ti->t[i] = v[0];
+    }
+    fclose(in);
+    if (bad) {
+        times_free(ti);
+        return -1;
+    }
+    return 0;
+}
+
+// Build the time index for name, and save it in side.
+static int build_times(char *name, int fd, const char *side, uint64_t span,
+                       int threads, const stamp_fmt *f, time_index *ti) {
+    memset(ti, 0, sizeof(time_index));
+    if (gz_index_build(name, &ti->x, span, NULL) != Z_OK)
+        return -1;
+    size_t n = ti->x.have;
+    if ((ti->t = malloc((n ? n : 1) * sizeof(int64_t))) == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        times_free(ti);
+        return -1;
+    }
+    struct stamping g = {ti, ti->t, f, fd, NOTIME};
+    pool_run(threads, n, stamp_job, &g);
+
+    // A point with no stamp before the next point has the next one's, and
+    // points with none after them at all are never a place to start.
+    ti->first = ti->last = NOTIME;
+    for (size_t i = n; i-- > 0;) {
+        if (ti->t[i] == NOTIME)
+            ti->t[i] = i + 1 < n ? ti->t[i + 1] : INT64_MAX;
+        if (ti->t[i] != INT64_MAX && ti->last == NOTIME)
+            ti->last = ti->t[i];
+    }
+    if (n && ti->t[0] != INT64_MAX)
+        ti->first = ti->t[0];
+    if (g.last != NOTIME)
+        ti->last = g.last;
+    if (save_times(side, ti, f) < 0)
+        fprintf(stderr, "gzinfo: could not write the index to %s\n", side);
+    return 0;
+}
+
+// Copy the lines stamped from..to (not including to), and the unstamped
+// lines that follow them. Stop at the first line stamped to or later.
+struct ranger {
+    const stamp_fmt *f;
+    int64_t from, to;
+    int emit;
+    FILE *out;
+    int err;
+};
+
+static int range_head(void *ctx, const unsigned char *pre, size_t len) {
+    struct ranger *r = ctx;
+    int64_t t = stamp(r->f, pre, len);
+    if (t != NOTIME) {
+        if (t >= r->to)
+            return 1;
+        r->emit = t >= r->from;
+    }
+    return 0;
+}
+
+static int range_body(void *ctx, const unsigned char *data, size_t len) {
+    struct ranger *r = ctx;
+    if (r->emit && fwrite(data, 1, len, r->out) != len) {
+        r->err = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int read_range(const time_index *ti, int fd, struct ranger *r) {
+    // The last point whose first stamp is before from.
+    size_t lo = 0, hi = ti->x.have;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ti->t[mid] < r->from)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const gz_point *p = ti->x.list + lo;
+    struct splitter sp = {p->out != 0, {0}, 0, p->out == 0, range_head,
+                          range_body, r};
+    r->emit = 0;
+    int ret = gz_point_read(p, ti->x.mode, fd, p->out, ti->x.length - p->out,
+                            stamp_sink, &sp);
+    if (ret == Z_OK)
+        split_end(&sp);
+    return r->err ? Z_ERRNO : ret;
+}
+
+// Parse a range end, in the log's format or as an ISO 8601 date and time.
+static int64_t when(const stamp_fmt *f, const char *s) {
+    static const char *iso[] = {"%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S",
+                                "%Y-%m-%dT%H:%M", "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+    size_t len = strlen(s) < PREFIX ? strlen(s) : PREFIX;
+    stamp_fmt own = {f->fmt, 0};
+    int64_t t = stamp(&own, (const unsigned char *)s, len);
+    for (size_t i = 0; t == NOTIME && i < sizeof(iso) / sizeof(iso[0]); i++) {
+        own.fmt = iso[i];
+        t = stamp(&own, (const unsigned char *)s, len);
+    }
+    return t;
+}
+
+typedef struct {
+    char *name;
+    time_index ti;
+} log_file;
+
+static int by_first(const void *a, const void *b) {
+    int64_t x = ((const log_file *)a)->ti.first;
+    int64_t y = ((const log_file *)b)->ti.first;
+    return x < y ? -1 : x > y;
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Append name to the list, taking ownership of it. Return 0, or -1 after a
+// message if name is NULL or the list can't grow.
+static int add_name(char ***names, size_t *n, char *name) {
+    char **more = name == NULL ? NULL :
+                  realloc(*names, (*n + 1) * sizeof(char *));
+    if (more == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        free(name);
+        return -1;
+    }
+    *names = more;
+    (*names)[(*n)++] = name;
+    return 0;
+}
+
+// Add path to the list, or the .gz files in it if it is a directory.
+static int add_path(const char *path, char ***names, size_t *n) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return add_name(names, n, strdup(path));
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", path);
+        return -1;
+    }
+    struct dirent *e;
+    int ret = 0;
+    while (ret == 0 && (e = readdir(dir)) != NULL) {
+        size_t len = strlen(e->d_name);
+        char *name = malloc(strlen(path) + len + 2);
+        if (name != NULL) {
+            sprintf(name, "%s/%s", path, e->d_name);
+            if (len <= 3 || strcmp(e->d_name + len - 3, ".gz") != 0 ||
+                stat(name, &st) < 0 || !S_ISREG(st.st_mode)) {
+                free(name);
+                continue;
+            }
+        }
+        ret = add_name(names, n, name);
+    }
+    closedir(dir);
+    return ret;
+}
+
+int cmd_range(int argc, char **argv) {
+    int threads = 0, opt;
+    uint64_t span = 0;
+    stamp_fmt f = {"%Y-%m-%dT%H:%M:%S", 0};
+    char *save = NULL;
+    while ((opt = getopt(argc, argv, "t:c:s:j:o:")) != -1)
+        switch (opt) {
+        case 't':
+            f.fmt = optarg;
+            break;
+        case 'c':
+            f.col = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'o':
+            save = optarg;
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind < 3 || strlen(f.fmt) >= 256 || f.col >= PREFIX) {
+        fprintf(stderr, "usage: gzinfo range [-t format] [-c column] [-s span] "
+                        "[-j threads] [-o out] from to file|directory...\n");
+        return 1;
+    }
+    int64_t from = when(&f, argv[optind]), to = when(&f, argv[optind + 1]);
+    if (from == NOTIME || to == NOTIME) {
+        fprintf(stderr, "gzinfo: could not read the time %s\n",
+                argv[from == NOTIME ? optind : optind + 1]);
+        return 1;
+    }
+
+    char **names = NULL;
+    size_t n = 0;
+    int ret = 0;
+    for (int i = optind + 2; i < argc; i++)
+        ret |= add_path(argv[i], &names, &n) < 0;
+    qsort(names, n, sizeof(char *), by_name);
+
+    // Index each file, or load its index, and keep those that overlap.
+    log_file *logs = calloc(n ? n : 1, sizeof(log_file));
+    size_t k = 0;
+    for (size_t i = 0; logs != NULL && i < n; i++) {
+        char side[4096];
+        int fd = open(names[i], O_RDONLY);
+        log_file *l = logs + k;
+        snprintf(side, sizeof(side), "%s.tmidx", names[i]);
+        if (fd < 0) {
+            fprintf(stderr, "gzinfo: could not open %s for reading\n", names[i]);
+            ret = 1;
+            continue;
+        }
+        if (load_times(side, &l->ti, &f) < 0 || gz_index_stale(&l->ti.x, fd)) {
+            times_free(&l->ti);
+            if (build_times(names[i], fd, side, span, threads, &f, &l->ti) < 0) {
+                close(fd);
+                ret = 1;
+                continue;
+            }
+        }
+        close(fd);
+        if (l->ti.first == NOTIME || l->ti.last < from || l->ti.first >= to)
+            times_free(&l->ti);
+        else
+            logs[k++].name = names[i];
+    }
+    qsort(logs, k, sizeof(log_file), by_first);
+
+    FILE *out = save == NULL ? stdout : fopen(save, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for writing\n", save);
+        ret = 1;
+    }
+    for (size_t i = 0; i < k; i++) {
+        int fd = out == NULL ? -1 : open(logs[i].name, O_RDONLY);
+        struct ranger r = {&f, from, to, 0, out, 0};
+        if (fd >= 0 && read_range(&logs[i].ti, fd, &r) != Z_OK) {
+            fprintf(stderr, "gzinfo: could not read %s\n", logs[i].name);
+            ret = 1;
+        }
+        if (fd >= 0)
+            close(fd);
+        times_free(&logs[i].ti);
+    }
+    if (out != NULL && out != stdout && fclose(out) != 0) {
+        fprintf(stderr, "gzinfo: write error on %s\n", save);
+        ret = 1;
+    }
+    for (size_t i = 0; i < n; i++)
+        free(names[i]);
+    free(names);
+    free(logs);
+    return ret;
+}
@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Read exactly len bytes at offset off. Return 0 on success, -1 on a read
+// error or a short file.
+int pread_full(int fd, void *buf, size_t len, uint64_t off) {
+    unsigned char *p = buf;
+    while (len) {
+        ssize_t got = pread(fd, p, len, (off_t)off);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return -1;
+        p += got;
+        off += got;
+        len -= got;
+    }
+    return 0;
+}
+
+// Return the little-endian 32-bit integer at p.
+uint32_t le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Return the next splitmix64 value from the state *x, for reproducible
+// random draws.
+uint64_t splitmix(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Return the wall clock time in seconds.
+double wall_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Return the CPU time used by the calling thread in seconds.
+double cpu_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Parse the gzip member header at p[0..n-1]. Return the header length, 0 if
+// more than n bytes are needed to tell, or -1 if this is not a gzip header.
+long gz_header_parse(const unsigned char *p, size_t n, gz_hdr *h) {
+    if (n < 10)
+        return 0;
+    if (p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || (p[3] & 0xe0))
+        return -1;
+
+    memset(h, 0, sizeof(*h));
+    h->flags = p[3];
+    h->mtime = le32(p + 4);
+    h->xfl = p[8];
+    h->os = p[9];
+    size_t pos = 10;
+
+    if (h->flags & FEXTRA) {
+        if (n < pos + 2)
+            return 0;
+        h->xlen = p[pos] | (p[pos + 1] << 8);
+        pos += 2;
+        if (n < pos + h->xlen)
+            return 0;
+        h->extra = p + pos;
+        pos += h->xlen;
+    }
+    if (h->flags & FNAME) {
+        const unsigned char *end = memchr(p + pos, 0, n - pos);
+        if (end == NULL)
+            return 0;
+        h->name = (const char *)p + pos;
+        pos = end - p + 1;
+    }
+    if (h->flags & FCOMMENT) {
+        const unsigned char *end = memchr(p + pos, 0, n - pos);
+        if (end == NULL)
+            return 0;
+        h->comment = (const char *)p + pos;
+        pos = end - p + 1;
+    }
+    if (h->flags & FHCRC) {
+        pos += 2;
+        if (n < pos)
+            return 0;
+    }
+    h->hdrlen = pos;
+
+    // BGZF stores the total member size less one in a "BC" subfield.
+    unsigned len;
+    const unsigned char *bc = gz_extra_find(h, 'B', 'C', &len);
+    if (bc != NULL && len == 2)
+        h->bsize = (bc[0] | (bc[1] << 8)) + 1;
+    return pos;
+}
+
+// Return true if p[0..n-1] starts with a plausible gzip member header: the
+// signature, no reserved flags, and the XFL and OS values compressors write.
+// Inside compressed data that happens about once in 2^37 bytes.
+int gz_header_plausible(const unsigned char *p, size_t n) {
+    gz_hdr h;
+    return gz_header_parse(p, n, &h) > 0 &&
+           (h.xfl == 0 || h.xfl == 2 || h.xfl == 4) &&
+           (h.os <= 13 || h.os == 255);
+}
+
+// Find the FEXTRA subfield with identifier si1, si2. Return its payload and
+// set *len, or return NULL if it is absent or the extra field is malformed.
+const unsigned char *gz_extra_find(const gz_hdr *h, int si1, int si2,
+                                   unsigned *len) {
+    const unsigned char *p = h->extra;
+    unsigned left = h->xlen;
+    while (p != NULL && left >= 4) {
+        unsigned sub = p[2] | (p[3] << 8);
+        if (sub > left - 4)
+            break;
+        if (p[0] == si1 && p[1] == si2) {
+            *len = sub;
+            return p + 4;
+        }
+        p += 4 + sub;
+        left -= 4 + sub;
+    }
+    return NULL;
+}
+
+// List the members of a file whose headers carry their own size (BGZF and
+// compatible), by hopping from header to header and reading each trailer.
+// Nothing is inflated. Return the member count with *list allocated, or -1
+// if the file is not laid out that way or cannot be read.
+long gz_hop_members(int fd, gz_member **list) {
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        return -1;
+    uint64_t size = st.st_size, off = 0;
+    size_t have = 0, max = 0;
+    gz_member *mem = NULL;
+    unsigned char hdr[1024], trl[8];
+
+    while (off < size) {
+        size_t want = size - off < sizeof(hdr) ? size - off : sizeof(hdr);
+        gz_hdr h;
+        if (pread_full(fd, hdr, want, off) < 0 ||
+            gz_header_parse(hdr, want, &h) <= 0 || h.bsize == 0 ||
+            h.bsize < h.hdrlen + 8 || h.bsize > size - off ||
+            pread_full(fd, trl, 8, off + h.bsize - 8) < 0) {
+            free(mem);
+            return -1;
+        }
+        if (have == max) {
+            max = max ? max << 1 : 256;
+            gz_member *more = realloc(mem, max * sizeof(*mem));
+            if (more == NULL) {
+                free(mem);
+                return -1;
+            }
+            mem = more;
+        }
+        mem[have].off = off;
+        mem[have].len = h.bsize;
+        mem[have].crc = le32(trl);
+        mem[have].isize = le32(trl + 4);
+        have++;
+        off += h.bsize;
+    }
+    *list = mem;
+    return have;
+}
+
+// Inflate the single gzip member in[0..len-1] into out[0..outlen-1], which
+// zlib checks against the member's CRC-32 and ISIZE. Set *got to the number
+// of bytes produced. Return Z_OK or a zlib error.
+int gz_inflate_member(const unsigned char *in, size_t len,
+                      unsigned char *out, size_t outlen, size_t *got) {
+    z_stream strm = {0};
+    int ret = inflateInit2(&strm, GZIP);
+    if (ret != Z_OK)
+        return ret;
+    strm.next_in = (unsigned char *)in;
+    strm.avail_in = len;
+    strm.next_out = out;
+    strm.avail_out = outlen;
+    ret = inflate(&strm, Z_FINISH);
+    *got = outlen - strm.avail_out;
+    inflateEnd(&strm);
+    if (ret == Z_STREAM_END)
+        return Z_OK;
+    return ret == Z_NEED_DICT || ret == Z_OK ? Z_DATA_ERROR : ret;
+}
+
+// Decompress the stream of the given mode at offset off of the file open on
+// fd, reading at most cap compressed bytes, and discard the output. PLAIN
+// data is taken to be exactly cap bytes long. If crc is not NULL, set *crc to
+// the CRC-32 of the output -- zlib only checks it itself for GZIP. Set *used
+// to the compressed bytes consumed and *out to the uncompressed size. Return
+// Z_OK, Z_BUF_ERROR if the stream did not end within cap bytes, or another
+// zlib error.
+int inflate_at(int fd, int mode, uint64_t off, uint64_t cap, uint64_t *used,
+               uint64_t *out, uLong *crc) {
+    unsigned char *buf = malloc(CHUNK + WINSIZE), *win = buf + CHUNK;
+    z_stream strm = {0};
+    uint64_t in = 0;
+    *out = 0;
+    if (crc != NULL)
+        *crc = crc32(0, NULL, 0);
+    int ret = buf == NULL ? Z_MEM_ERROR :
+              mode == PLAIN ? Z_OK : inflateInit2(&strm, mode);
+    if (ret != Z_OK) {
+        free(buf);
+        return ret;
+    }
+    if (mode == PLAIN) {
+        while (in < cap) {
+            size_t want = cap - in < CHUNK ? cap - in : CHUNK;
+            ssize_t got = pread(fd, buf, want, (off_t)(off + in));
+            if (got <= 0) {
+                ret = got < 0 ? Z_ERRNO : Z_BUF_ERROR;
+                break;
+            }
+            if (crc != NULL)
+                *crc = crc32(*crc, buf, got);
+            in += got;
+        }
+        *used = *out = in;
+        free(buf);
+        return ret;
+    }
+    do {
+        if (strm.avail_in == 0) {
+            size_t want = cap - in < CHUNK ? cap - in : CHUNK;
+            ssize_t got = want ? pread(fd, buf, want, (off_t)(off + in)) : 0;
+            if (got < 0) {
+                ret = Z_ERRNO;
+                break;
+            }
+            if (got == 0) {
+                ret = Z_BUF_ERROR;
+                break;
+            }
+            strm.next_in = buf;
+            strm.avail_in = got;
+            in += got;
+        }
+        strm.next_out = win;
+        strm.avail_out = WINSIZE;
+        ret = inflate(&strm, Z_NO_FLUSH);
+        *out += WINSIZE - strm.avail_out;
+        if (crc != NULL)
+            *crc = crc32(*crc, win, WINSIZE - strm.avail_out);
+    } while (ret == Z_OK);
+    *used = in - strm.avail_in;
+    inflateEnd(&strm);
+    free(buf);
+    if (ret == Z_STREAM_END)
+        return Z_OK;
+    return ret == Z_NEED_DICT ? Z_DATA_ERROR : ret;
+}
+
+// Inflate the gzip member at offset off of the file open on fd, reading at
+// most cap compressed bytes, and discard the output. zlib checks the member
+// against its trailer. Set *used to the compressed bytes consumed and *out to
+// the uncompressed size. Return Z_OK, Z_BUF_ERROR if the member did not end
+// within cap bytes, or another zlib error.
+int gz_verify_member(int fd, uint64_t off, uint64_t cap, uint64_t *used,
+                     uint64_t *out) {
+    return inflate_at(fd, GZIP, off, cap, used, out, NULL);
+}
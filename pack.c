@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Parallel zlib integrity check of git packfiles. The object offsets come
+// from the version 2 .idx file. Sorted, each offset also bounds the previous
+// object, so every object is a known byte range. Each is checked against
+// the CRC-32 that the index records for its raw bytes. Its zlib stream is
+// inflated and must end exactly at the range's end with the size given in
+// the object header. Deltas are not resolved.
+
+#define BATCH 64                // objects per job
+
+static const char *type_name[8] = {
+    "invalid", "commit", "tree", "blob", "tag", "reserved", "ofs-delta",
+    "ref-delta"};
+
+struct object {
+    uint64_t off, len;          // raw bytes in the pack, header included
+    uint32_t crc;               // of those bytes, from the index
+    int type;
+    uint64_t size;              // inflated size, from the object header
+    uint64_t out;               // inflated size, as found
+    const char *err;            // or NULL
+};
+
+struct pack {
+    int fd;
+    int hash;                   // object id length, 20 or 32
+    struct object *obj;         // sorted by offset
+    size_t n;
+};
+
+static uint32_t get4(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int by_offset(const void *a, const void *b) {
+    uint64_t x = ((const struct object *)a)->off;
+    uint64_t y = ((const struct object *)b)->off;
+    return x < y ? -1 : x > y;
+}
+
+static void check(struct pack *k, struct object *o) {
+    unsigned char buf[CHUNK], win[WINSIZE];
+    z_stream strm = {0};
+    uLong crc = crc32(0, NULL, 0);
+    uint64_t at = 0;
+    int ret = Z_OK, started = 0;
+    while (at < o->len) {
+        size_t want = o->len - at < CHUNK ? o->len - at : CHUNK;
+        if (pread_full(k->fd, buf, want, o->off + at) < 0) {
+            o->err = "read error";
+            break;
+        }
+        crc = crc32(crc, buf, want);
+        size_t skip = 0;
+        if (!started) {
+            // Object header: type and size, then for deltas the base.
+            unsigned char c = buf[0];
+            int shift = 4;
+            o->type = (c >> 4) & 7;
+            o->size = c & 15;
+            while ((c & 0x80) && ++skip < want && shift < 64) {
+                c = buf[skip];
+                o->size |= (uint64_t)(c & 0x7f) << shift;
+                shift += 7;
+            }
+            skip++;
+            if (o->type == 6)
+                while (skip < want && (buf[skip++] & 0x80))
+                    ;
+            else if (o->type == 7)
+                skip += k->hash;
+            if (skip >= want || o->type == 0 || o->type == 5) {
+                o->err = "bad object header";
+                break;
+            }
+            if (inflateInit2(&strm, ZLIB) != Z_OK) {
+                o->err = "out of memory";
+                break;
+            }
+            started = 1;
+        }
+        at += want;
+        strm.next_in = buf + skip;
+        strm.avail_in = want - skip;
+        while (strm.avail_in && ret == Z_OK) {
+            strm.next_out = win;
+            strm.avail_out = sizeof(win);
+            ret = inflate(&strm, Z_NO_FLUSH);
+            o->out += sizeof(win) - strm.avail_out;
+        }
+        if (ret != Z_OK)
+            break;
+    }
+    if (started)
+        inflateEnd(&strm);
+    if (o->err != NULL)
+        return;
+    if (crc != o->crc)
+        o->err = "CRC mismatch";
+    else if (ret == Z_OK || ret == Z_BUF_ERROR)
+        o->err = "truncated";
+    else if (ret != Z_STREAM_END)
+        o->err = "corrupt data";
+    else if (strm.avail_in || at < o->len)
+        o->err = "data after zlib stream";
+    else if (o->out != o->size)
+        o->err = "size mismatch";
+}
+
+static void pack_job(void *ctx, size_t i) {
+    struct pack *k = ctx;
+    for (size_t j = i * BATCH; j < k->n && j < (i + 1) * BATCH; j++)
+        check(k, k->obj + j);
+}
+
+int cmd_pack(int argc, char **argv) {
+    int threads = 0, opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1)
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo pack [-j threads] file.pack|file.idx\n");
+        return 1;
+    }
+
+    // Either name will do: the other differs only in its suffix.
+    char *name = argv[optind], idx[4096], pk[4096];
+    size_t n = strlen(name);
+    if (n >= sizeof(idx) || (n >= 5 && (strcmp(name + n - 5, ".pack") == 0 ||
+                                        strcmp(name + n - 4, ".idx") == 0)) == 0) {
+        fprintf(stderr, "gzinfo: %s is not a .pack or .idx file\n", name);
+        return 1;
+    }
+    n -= name[n - 1] == 'k' ? 5 : 4;
+    snprintf(idx, sizeof(idx), "%.*s.idx", (int)n, name);
+    snprintf(pk, sizeof(pk), "%.*s.pack", (int)n, name);
+
+    int ifd = open(idx, O_RDONLY), fd = open(pk, O_RDONLY);
+    struct stat ist, st;
+    if (ifd < 0 || fd < 0 || fstat(ifd, &ist) < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n",
+                ifd < 0 ? idx : pk);
+        if (ifd >= 0)
+            close(ifd);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    size_t ilen = ist.st_size;
+    const unsigned char *in = ilen ? mmap(NULL, ilen, PROT_READ, MAP_PRIVATE,
+                                          ifd, 0) : NULL;
+    close(ifd);
+    unsigned char head[12];
+    if (ilen < 8 + 1024 || in == MAP_FAILED || memcmp(in, "\377tOc", 4) ||
+        get4(in + 4) != 2) {
+        fprintf(stderr, "gzinfo: %s is not a version 2 pack index\n", idx);
+        if (ilen && in != MAP_FAILED)
+            munmap((void *)in, ilen);
+        close(fd);
+        return 1;
+    }
+    if (pread_full(fd, head, 12, 0) < 0 || memcmp(head, "PACK", 4)) {
+        fprintf(stderr, "gzinfo: %s is not a packfile\n", pk);
+        munmap((void *)in, ilen);
+        close(fd);
+        return 1;
+    }
+
+    // The index holds the fanout table, the object ids, their CRCs, their
+    // offsets, any 64-bit offsets, and the pack and index checksums. The id
+    // length is whichever of SHA-1 and SHA-256 makes that add up.
+    struct pack k = {fd, 0, NULL, get4(in + 8 + 1020)};
+    const unsigned char *crcs = NULL, *offs = NULL, *large = NULL;
+    size_t big = 0;
+    for (int hash = 20; hash <= 32; hash += 12) {
+        uint64_t base = 8 + 1024 + (uint64_t)k.n * hash;
+        if (base + 8 * (uint64_t)k.n + 2 * hash > ilen)
+            continue;
+        big = 0;
+        for (size_t i = 0; i < k.n; i++)
+            big += in[base + 4 * k.n + 4 * i] >> 7;
+        if (base + 8 * (uint64_t)k.n + 8 * (uint64_t)big + 2 * hash == ilen) {
+            k.hash = hash;
+            crcs = in + base;
+            offs = crcs + 4 * k.n;
+            large = offs + 4 * k.n;
+            break;
+        }
+    }
+    if (k.hash == 0 || (k.obj = calloc(k.n ? k.n : 1, sizeof(struct object))) == NULL) {
+        fprintf(stderr, k.hash ? "gzinfo: out of memory\n" :
+                "gzinfo: %s is damaged\n", idx);
+        munmap((void *)in, ilen);
+        close(fd);
+        return 1;
+    }
+    for (size_t i = 0; i < k.n; i++) {
+        struct object *o = k.obj + i;
+        uint32_t v = get4(offs + 4 * i), w = v & 0x7fffffff;
+        o->off = v == w ? v : w < big ?         // else flagged as a bad offset
+                 ((uint64_t)get4(large + 8 * w) << 32) | get4(large + 8 * w + 4) : 0;
+        o->crc = get4(crcs + 4 * i);
+    }
+    munmap((void *)in, ilen);
+
+    // Each object runs up to the next one, or to the pack's checksum.
+    qsort(k.obj, k.n, sizeof(struct object), by_offset);
+    uint64_t end = st.st_size >= k.hash ? st.st_size - k.hash : 0;
+    for (size_t i = 0; i < k.n; i++) {
+        uint64_t next = i + 1 < k.n ? k.obj[i + 1].off : end;
+        if (k.obj[i].off < 12 || next <= k.obj[i].off)
+            k.obj[i].err = "bad offset";
+        else
+            k.obj[i].len = next - k.obj[i].off;
+    }
+    if (get4(head + 8) != k.n)
+        printf("Object count mismatch: pack %u, index %zu\n", get4(head + 8),
+               k.n);
+
+    pool_run(threads, (k.n + BATCH - 1) / BATCH, pack_job, &k);
+    close(fd);
+
+    // Tally by type. Sizes of deltas are of the delta data, not the object.
+    uint64_t count[8] = {0}, zin[8] = {0}, zout[8] = {0};
+    long failed = 0;
+    for (size_t i = 0; i < k.n; i++) {
+        struct object *o = k.obj + i;
+        if (o->err != NULL) {
+            printf("FAILED: object at %llu: %s\n", (unsigned long long)o->off,
+                   o->err);
+            failed++;
+            continue;
+        }
+        count[o->type]++;
+        zin[o->type] += o->len;
+        zout[o->type] += o->out;
+    }
+    printf("%-10s %10s %14s %14s %7s\n", "type", "objects", "packed",
+           "inflated", "ratio");
+    uint64_t c = 0, in_all = 0, out_all = 0;
+    for (int t = 1; t < 8; t++) {
+        if (count[t] == 0)
+            continue;
+        printf("%-10s %10llu %14llu %14llu %7.3f\n", type_name[t],
+               (unsigned long long)count[t], (unsigned long long)zin[t],
+               (unsigned long long)zout[t], (double)zout[t] / zin[t]);
+        c += count[t];
+        in_all += zin[t];
+        out_all += zout[t];
+    }
+    printf("%-10s %10llu %14llu %14llu %7.3f\n", "total", (unsigned long long)c,
+           (unsigned long long)in_all, (unsigned long long)out_all,
+           in_all ? (double)out_all / in_all : 0.0);
+    printf("Object Hash: %s\n", k.hash == 20 ? "SHA-1" : "SHA-256");
+    printf("Failed: %ld\n", failed);
+    free(k.obj);
+    return failed || get4(head + 8) != k.n ? 1 : 0;
+}
@@ -0,0 +1,596 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Strategy planner. The first HEAD bytes and the trailer are read, and the
+// header fields (XFL, OS, MTIME, FNAME, FEXTRA) and the layout of the first
+// blocks are matched against what the common producers write. From that it
+// picks the fastest way to get a correct answer:
+//
+// - trailer only: the sizes from ISIZE, when the first member is seen to end
+//   at the trailer that ends the file, so that there is only the one (-q
+//   only);
+// - BGZF header hops: each member's size is in its header, so the members are
+//   listed without inflating, and then checked in parallel;
+// - member-parallel: each thread looks for member headers in its part of the
+//   file and checks the members that start there, and the members found
+//   must then chain from the start to the end;
+// - speculative parallel: a single member with flush points after which no
+//   block reaches back (pigz -i, dictzip) is cut at those points and each
+//   part is inflated with an empty window, the parts' CRCs combined and
+//   checked against the trailer;
+// - serial inflate: verify_gzip(), when nothing else applies.
+//
+// A parallel strategy that finds the layout was not what it looked like falls
+// back to serial inflate, which has the last word on whether the data is bad.
+
+#define HEAD (256U << 10)           // bytes read to fingerprint
+#define SPLIT (4U << 20)            // smallest file worth splitting
+#define PART (1U << 20)             // smallest part for each thread
+#define NOWRAP (0xffffffffULL / 1032)  // at most this, ISIZE can't wrap
+
+enum { TRAILER, HOPS, MEMBERS, SPECULATE, SERIAL, OTHER };
+
+static const char *strategies[] = {"trailer only", "BGZF header hops",
+                                   "member-parallel", "speculative parallel",
+                                   "serial inflate", "container metadata"};
+
+typedef struct {
+    const char *producer;
+    char seen[512];                 // the evidence for it
+    const char *format;             // zstd, xz or bzip2, or NULL
+    int mode;
+    gz_hdr h;
+    int bgzf, dictzip;
+    int multi;                      // a second member follows in the head
+    int single;                     // the first member ends the file
+    int markers;                    // empty stored blocks in the head
+    int independent;                // the block after a marker needs no window
+    int fixed;                      // the first block is a large fixed block
+    uint32_t crc, isize;            // from the trailer
+} print;
+
+static void note(print *p, const char *s) {
+    size_t n = strlen(p->seen);
+    snprintf(p->seen + n, sizeof(p->seen) - n, "%s%s", n ? "; " : "", s);
+}
+
+// Decode the first member in head[0..len-1], as far as it goes, to see the
+// block layout.
+static void layout(print *p, const unsigned char *head, size_t len,
+                   uint64_t size) {
+    dfl d;
+    uint64_t start = p->mode == GZIP ? p->h.hdrlen : p->mode == ZLIB ? 2 : 0;
+    if (dfl_init(&d, head, len, 8 * start, NULL, 0, 0) < 0)
+        return;
+    uint64_t marker = 0;
+    int ret;
+    do {
+        uint64_t made = d.total;
+        ret = dfl_block(&d);
+        if (ret < 0)
+            break;
+        if (d.blocks == 1 && d.type == 1 && d.total - made >= 16384)
+            p->fixed = 1;
+        if (d.type == 0 && d.total == made && !d.final) {
+            if (p->markers++ == 0)
+                marker = d.pos >> 3;
+        }
+    } while (ret == DFL_OK);
+    uint64_t end = (d.pos + 7) >> 3;
+    dfl_free(&d);
+    if (ret == DFL_END && p->mode == GZIP && end + 8 < size &&
+        (end + 8 >= len || gz_header_plausible(head + end + 8, len - end - 8)))
+        p->multi = 1;
+    if (ret == DFL_END && p->mode == GZIP && end + 8 == size)
+        p->single = 1;
+
+    // After the first marker, see whether the next blocks copy from before it.
+    if (marker && dfl_init(&d, head, len, 8 * marker, NULL, 0, 1) == 0) {
+        int n = 0;
+        while (n++ < 4 && (ret = dfl_block(&d)) == DFL_OK)
+            ;
+        p->independent = d.blocks > 0 && d.unknown == 0;
+        dfl_free(&d);
+    }
+}
+
+// Name the producer of the file from its head and trailer.
+static void fingerprint(print *p, const unsigned char *head, size_t len,
+                        const unsigned char *tail, uint64_t size) {
+    char buf[128];
+    p->format = other_format(head, len);
+    if (p->format != NULL) {
+        p->producer = p->format;
+        note(p, "magic number");
+        return;
+    }
+    p->mode = detect_mode(head, len);
+    if (p->mode == PLAIN)
+        p->mode = RAW;
+    if (p->mode != GZIP) {
+        p->producer = p->mode == ZLIB ? "zlib stream" : "raw deflate";
+        note(p, p->mode == ZLIB ? "zlib header" : "no header");
+        layout(p, head, len, size);
+        return;
+    }
+    if (gz_header_parse(head, len, &p->h) <= 0) {
+        p->producer = "unknown";
+        note(p, "header not readable");
+        return;
+    }
+    if (size >= 8) {
+        p->crc = le32(tail);
+        p->isize = le32(tail + 4);
+    }
+    unsigned n;
+    p->bgzf = gz_extra_find(&p->h, 'B', 'C', &n) != NULL;
+    p->dictzip = gz_extra_find(&p->h, 'R', 'A', &n) != NULL;
+    layout(p, head, len, size);
+
+    const gz_hdr *h = &p->h;
+    snprintf(buf, sizeof(buf), "OS %d, XFL %d, MTIME %s%s%s", h->os, h->xfl,
+             h->mtime ? "set" : "0", h->name != NULL ? ", FNAME" : "",
+             h->extra != NULL ? ", FEXTRA" : "");
+    note(p, buf);
+    if (p->bgzf) {
+        p->producer = "bgzip (BGZF)";
+        note(p, "BC extra subfield with the member size");
+    }
+    else if (p->dictzip) {
+        p->producer = "dictzip";
+        note(p, "RA extra subfield with the chunk table");
+    }
+    else if (p->markers && h->os == 3)
+        p->producer = p->independent ? "pigz -i" : "pigz";
+    else if (h->os == 255)
+        p->producer = h->name != NULL || h->xfl == 2 ? "Python gzip" :
+                                                      "Go compress/gzip";
+    else if (h->os == 0 && h->mtime == 0 && h->flags == 0 && h->xfl == 0)
+        p->producer = "Java GZIPOutputStream";
+    else if (h->os == 3 && h->mtime == 0 && h->flags == 0)
+        p->producer = p->fixed ? "zlib-ng" : "zlib";
+    else if (h->os == 3)
+        p->producer = "GNU gzip";
+    else
+        p->producer = "unknown";
+    if (p->markers) {
+        snprintf(buf, sizeof(buf), "%d empty stored blocks in the first %s",
+                 p->markers, humanSize(len));
+        note(p, buf);
+        note(p, p->independent ? "blocks after them use no earlier data" :
+                                 "blocks after them copy from before");
+    }
+    if (p->fixed)
+        note(p, "first block is a large fixed-code block");
+    if (p->multi)
+        note(p, "a second member follows the first");
+    else if (p->single)
+        note(p, "the first member ends the file");
+}
+
+// Choose the strategy for p, saying why in why[0..room-1].
+static int choose(const print *p, uint64_t size, int threads, int quick,
+                  char *why, size_t room) {
+    if (p->format != NULL) {
+        snprintf(why, room, "%s keeps its sizes in its own metadata",
+                 p->format);
+        return OTHER;
+    }
+    if (p->bgzf) {
+        snprintf(why, room, quick ? "each header has the member size and each "
+                                    "trailer its ISIZE, so nothing is inflated" :
+                                    "each header has the member size, so the "
+                                    "members can be checked independently");
+        return HOPS;
+    }
+    if (quick && p->mode == GZIP && p->single && size <= NOWRAP) {
+        snprintf(why, room, "the one member ends at the trailer, and at %llu "
+                 "bytes ISIZE cannot have wrapped", (unsigned long long)size);
+        return TRAILER;
+    }
+    if (p->mode != GZIP) {
+        snprintf(why, room, "a %s has no member or flush structure to split "
+                 "on", p->producer);
+        return SERIAL;
+    }
+    if (pool_threads(threads) < 2) {
+        snprintf(why, room, "with one thread, splitting only adds work");
+        return SERIAL;
+    }
+    if (size < SPLIT) {
+        snprintf(why, room, "under %s, splitting costs more than it saves",
+                 humanSize(SPLIT));
+        return SERIAL;
+    }
+    if (p->multi) {
+        snprintf(why, room, "the file is a series of members, which can be "
+                 "found by their headers and checked independently");
+        return MEMBERS;
+    }
+    if (p->markers && p->independent) {
+        snprintf(why, room, "the flush points start blocks that need no "
+                 "window, so the parts can be inflated independently");
+        return SPECULATE;
+    }
+    // The first member runs past the head, so whether others follow it is
+    // only known by looking. If none do, the scan costs little beside the
+    // thread inflating the one member from the start.
+    snprintf(why, room, "the first member runs past the first %s, so any "
+             "members after it are found by their headers", humanSize(HEAD));
+    return MEMBERS;
+}
+
+// Work shared by the parallel strategies.
+struct plan {
+    int fd;
+    uint64_t size, start;           // start of the deflate data
+    size_t n;                       // parts
+    uint64_t *cut;                  // part boundaries, n + 1 of them
+    gz_member *mem;                 // members, for HOPS
+    size_t nmem;
+    struct found {
+        uint64_t off, len, out;
+    } *got;                         // members found, for MEMBERS
+    size_t ngot, room;
+    uint64_t *out;                  // uncompressed bytes of each part
+    uLong *crc;                     // CRC-32 of each part
+    int *ret;                       // result of each part
+    const char **why;               // what went wrong with each part
+    pthread_mutex_t lock;
+};
+
+static void hop_job(void *ctx, size_t i) {
+    struct plan *w = ctx;
+    gz_member *m = w->mem + i;
+    uint64_t used, out;
+    w->ret[i] = gz_verify_member(w->fd, m->off, m->len, &used, &out);
+    if (w->ret[i] == Z_OK && (used != m->len || (uint32_t)out != m->isize))
+        w->ret[i] = Z_DATA_ERROR;
+    w->out[i] = out;
+}
+
+// Look for members that start in part i, checking each one found.
+static void member_job(void *ctx, size_t i) {
+    struct plan *w = ctx;
+    unsigned char buf[CHUNK + 1024];
+    uint64_t at = w->cut[i], end = w->cut[i + 1];
+    w->ret[i] = Z_OK;
+    while (at < end) {
+        size_t want = w->size - at < sizeof(buf) ? w->size - at : sizeof(buf);
+        if (pread_full(w->fd, buf, want, at) < 0) {
+            w->ret[i] = Z_ERRNO;
+            return;
+        }
+        size_t k = 0, lim = end - at < CHUNK ? end - at : CHUNK;
+        while (k < lim && (k + 3 > want || buf[k] != 0x1f ||
+                           buf[k + 1] != 0x8b || buf[k + 2] != 8 ||
+                           !gz_header_plausible(buf + k, want - k)))
+            k++;
+        if (k == lim) {
+            at += lim;
+            continue;
+        }
+        uint64_t used, out;
+        if (gz_verify_member(w->fd, at + k, w->size - at - k, &used,
+                             &out) != Z_OK) {
+            at += k + 1;
+            continue;
+        }
+        pthread_mutex_lock(&w->lock);
+        if (w->ngot == w->room) {
+            size_t room = w->room ? 2 * w->room : 256;
+            struct found *f = realloc(w->got, room * sizeof(struct found));
+            if (f == NULL) {
+                w->ret[i] = Z_MEM_ERROR;
+                pthread_mutex_unlock(&w->lock);
+                return;
+            }
+            w->got = f;
+            w->room = room;
+        }
+        w->got[w->ngot++] = (struct found){at + k, used, out};
+        pthread_mutex_unlock(&w->lock);
+        at += k + used;
+    }
+}
+
+// Inflate part i with an empty window. It must end exactly at the end of the
+// part on a block boundary, or for the last part at the end of the member,
+// just before the trailer.
+static void speculate_job(void *ctx, size_t i) {
+    struct plan *w = ctx;
+    unsigned char *buf = malloc(CHUNK + WINSIZE), *win = buf + CHUNK;
+    z_stream strm = {0};
+    uint64_t at = w->cut[i], end = w->cut[i + 1];
+    int last = i + 1 == w->n, ret, type = 0;
+    w->crc[i] = crc32(0, NULL, 0);
+    if (buf == NULL || inflateInit2(&strm, RAW) != Z_OK) {
+        free(buf);
+        w->ret[i] = Z_MEM_ERROR;
+        return;
+    }
+    do {
+        if (strm.avail_in == 0 && at < end) {
+            size_t want = end - at < CHUNK ? end - at : CHUNK;
+            if (pread_full(w->fd, buf, want, at) < 0) {
+                ret = Z_ERRNO;
+                break;
+            }
+            strm.next_in = buf;
+            strm.avail_in = want;
+            at += want;
+        }
+        strm.next_out = win;
+        strm.avail_out = WINSIZE;
+        ret = inflate(&strm, Z_BLOCK);
+        if (ret == Z_OK)
+            type = strm.data_type;      // a call that can't go on resets it
+        w->out[i] += WINSIZE - strm.avail_out;
+        w->crc[i] = crc32(w->crc[i], win, WINSIZE - strm.avail_out);
+    } while (ret == Z_OK);
+    if (last)
+        w->ret[i] = ret == Z_STREAM_END && at - strm.avail_in == end ?
+                    Z_OK : Z_DATA_ERROR;
+    else
+        w->ret[i] = ret == Z_BUF_ERROR && at == end && strm.avail_in == 0 &&
+                    (type & 0xc7) == 0x80 ? Z_OK : Z_DATA_ERROR;
+    if (ret == Z_DATA_ERROR)
+        w->why[i] = strm.msg;
+    else if (w->ret[i] != Z_OK)
+        w->why[i] = ret == Z_STREAM_END ? "the member ended early" :
+                                          "not on a block boundary";
+    inflateEnd(&strm);
+    free(buf);
+}
+
+// Cut [w->start, w->size - 8) just after the first flush marker found in each
+// of n equal parts.
+static void find_cuts(struct plan *w, size_t n) {
+    uint64_t from = w->start, span = (w->size - 8 - from) / n;
+    w->cut[0] = from;
+    w->n = 0;
+    unsigned char buf[CHUNK + 3];
+    for (size_t i = 1; i < n; i++) {
+        uint64_t at = from + i * span, stop = from + (i + 1) * span;
+        if (at <= w->cut[w->n])
+            continue;
+        while (at < stop) {
+            size_t want = w->size - 8 - at < sizeof(buf) ? w->size - 8 - at :
+                                                           sizeof(buf);
+            if (pread_full(w->fd, buf, want, at) < 0)
+                break;
+            void *p = NULL;
+            for (size_t k = 0; k + 4 <= want; k++)
+                if (buf[k] == 0 && buf[k + 1] == 0 && buf[k + 2] == 0xff &&
+                    buf[k + 3] == 0xff) {
+                    p = buf + k;
+                    break;
+                }
+            if (p != NULL) {
+                w->cut[++w->n] = at + ((unsigned char *)p - buf) + 4;
+                break;
+            }
+            at += CHUNK;
+        }
+    }
+    w->cut[++w->n] = w->size - 8;
+}
+
+static int by_off(const void *a, const void *b) {
+    uint64_t x = ((const struct found *)a)->off;
+    uint64_t y = ((const struct found *)b)->off;
+    return x < y ? -1 : x > y;
+}
+
+static void summary(uint64_t size, uint64_t out, uint64_t members,
+                    int exact) {
+    printf("Compressed Size: %s\n", humanSize(size));
+    printf("Uncompressed Size: %s%s\n", humanSize(out),
+           exact ? "" : " (from ISIZE, unverified)");
+    printf("Number of GZIP Members: %llu\n", (unsigned long long)members);
+}
+
+// Run the parallel strategy s. Return 0 if it verified the file, or -1 with
+// *why set if it found that the layout was not what it looked like.
+static int run_parallel(int s, struct plan *w, const print *p, int threads,
+                        const char **why) {
+    size_t parts = 4 * (size_t)pool_threads(threads);
+    if (parts > (w->size - w->start) / PART)
+        parts = (w->size - w->start) / PART;
+    if (parts < 1)
+        parts = 1;
+    if (s == HOPS) {
+        long n = gz_hop_members(w->fd, &w->mem);
+        if (n < 0) {
+            *why = "a header without a member size";
+            return -1;
+        }
+        w->nmem = parts = n;
+    }
+    w->out = calloc(parts + 1, sizeof(uint64_t));
+    w->crc = calloc(parts + 1, sizeof(uLong));
+    w->ret = calloc(parts + 1, sizeof(int));
+    w->why = calloc(parts + 1, sizeof(char *));
+    w->cut = calloc(parts + 2, sizeof(uint64_t));
+    if (w->out == NULL || w->crc == NULL || w->ret == NULL ||
+        w->why == NULL || w->cut == NULL) {
+        *why = "out of memory";
+        return -1;
+    }
+    uint64_t out = 0;
+    if (s == HOPS) {
+        pool_run(threads, parts, hop_job, w);
+        for (size_t i = 0; i < parts; i++) {
+            if (w->ret[i] != Z_OK) {
+                *why = "a member does not match its header and trailer";
+                return -1;
+            }
+            out += w->out[i];
+        }
+        summary(w->size, out, w->nmem, 1);
+        return 0;
+    }
+    if (s == MEMBERS) {
+        for (size_t i = 0; i <= parts; i++)
+            w->cut[i] = w->size / parts * i;
+        w->cut[parts] = w->size;
+        w->n = parts;
+        pool_run(threads, parts, member_job, w);
+        qsort(w->got, w->ngot, sizeof(struct found), by_off);
+        uint64_t at = 0, members = 0;
+        for (size_t i = 0; i < w->ngot && at < w->size; i++)
+            if (w->got[i].off == at) {
+                at += w->got[i].len;
+                out += w->got[i].out;
+                members++;
+            }
+        if (at != w->size) {
+            *why = "the members found do not chain to the end";
+            return -1;
+        }
+        summary(w->size, out, members, 1);
+        return 0;
+    }
+    find_cuts(w, parts);
+    pool_run(threads, w->n, speculate_job, w);
+    uLong crc = crc32(0, NULL, 0);
+    for (size_t i = 0; i < w->n; i++) {
+        if (w->ret[i] != Z_OK) {
+            *why = w->why[i] != NULL ? w->why[i] : "a part did not inflate";
+            return -1;
+        }
+        crc = crc32_combine(crc, w->crc[i], w->out[i]);
+        out += w->out[i];
+    }
+    if (crc != p->crc || (uint32_t)out != p->isize) {
+        *why = "the parts do not match the trailer";
+        return -1;
+    }
+    printf("Parts: %zu, cut at flush points\n", w->n);
+    summary(w->size, out, 1, 1);
+    return 0;
+}
+
+static void plan_free(struct plan *w) {
+    free(w->mem);
+    free(w->got);
+    free(w->out);
+    free(w->crc);
+    free(w->ret);
+    free(w->why);
+    free(w->cut);
+    pthread_mutex_destroy(&w->lock);
+}
+
+int cmd_plan(int argc, char **argv) {
+    int threads = 0, dry = 0, quick = 0, opt;
+    while ((opt = getopt(argc, argv, "nqj:")) != -1)
+        switch (opt) {
+        case 'n':
+            dry = 1;
+            break;
+        case 'q':
+            quick = 1;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo plan [-n] [-q] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    uint64_t size = st.st_size;
+    size_t len = size < HEAD ? size : HEAD;
+    unsigned char *head = malloc(len), tail[8] = {0};
+    if (head == NULL || pread_full(fd, head, len, 0) < 0 ||
+        (size >= 8 && pread_full(fd, tail, 8, size - 8) < 0)) {
+        fprintf(stderr, "gzinfo: read error on %s\n", name);
+        free(head);
+        close(fd);
+        return 1;
+    }
+
+    print p;
+    memset(&p, 0, sizeof(p));
+    fingerprint(&p, head, len, tail, size);
+    char why[256];
+    int s = choose(&p, size, threads, quick, why, sizeof(why));
+    printf("Producer: %s\n  (%s)\n", p.producer, p.seen);
+    printf("Strategy: %s\n  (%s)\n", strategies[s], why);
+    uint64_t start = p.h.hdrlen;
+    free(head);
+    if (dry) {
+        close(fd);
+        return 0;
+    }
+
+    printf("\n");
+    double t = wall_now();
+    int ret = 0;
+    struct plan w;
+    memset(&w, 0, sizeof(w));
+    w.fd = fd;
+    w.size = size;
+    w.start = start;
+    pthread_mutex_init(&w.lock, NULL);
+    if (s == OTHER)
+        ret = other_info(name, !quick, threads);
+    else if (s == TRAILER)
+        summary(size, p.isize, 1, 0);
+    else if (s == HOPS && quick) {
+        long n = gz_hop_members(fd, &w.mem);
+        uint64_t out = 0;
+        for (long i = 0; i < n; i++)
+            out += w.mem[i].isize;
+        if (n < 0) {
+            printf("No member size in some header, falling back to serial "
+                   "inflate\n\n");
+            s = SERIAL;
+        }
+        else
+            summary(size, out, n, 0);
+    }
+    else if (s != SERIAL) {
+        const char *fail;
+        if (run_parallel(s, &w, &p, threads, &fail) < 0) {
+            printf("%s failed (%s), falling back to serial inflate\n\n",
+                   strategies[s], fail);
+            s = SERIAL;
+        }
+    }
+    if (s == SERIAL) {
+        ret = verify_gzip(name, NULL);
+        if (ret == Z_OK)
+            print_gzip_info();
+        else if (ret == Z_MEM_ERROR)
+            fprintf(stderr, "gzinfo: out of memory\n");
+        else if (ret == Z_BUF_ERROR)
+            fprintf(stderr, "gzinfo: %s ended prematurely\n", name);
+        else if (ret == Z_ERRNO)
+            fprintf(stderr, "gzinfo: read error on %s\n", name);
+    }
+    if (ret == 0)
+        printf("Time: %.3f s\n", wall_now() - t);
+    plan_free(&w);
+    close(fd);
+    return ret != 0;
+}
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "gzinfo.h"
+
+// Minimal work pool: jobs 0..n-1 are handed out in order to a fixed set of
+// threads, the calling thread being one of them.
+struct pool {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t n;
+    void (*job)(void *, size_t);
+    void *ctx;
+};
+
+static void *pool_worker(void *arg) {
+    struct pool *p = arg;
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        size_t i = p->next++;
+        pthread_mutex_unlock(&p->lock);
+        if (i >= p->n)
+            break;
+        p->job(p->ctx, i);
+    }
+    return NULL;
+}
+
+// Return the number of threads to use: requested if positive, otherwise the
+// number of online processors.
+int pool_threads(int requested) {
+    if (requested > 0)
+        return requested;
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void pool_run(int threads, size_t n, void (*job)(void *ctx, size_t i),
+              void *ctx) {
+    struct pool p = {PTHREAD_MUTEX_INITIALIZER, 0, n, job, ctx};
+    size_t want = pool_threads(threads);
+    if (want > n)
+        want = n;
+    pthread_t *tid = want > 1 ? malloc((want - 1) * sizeof(pthread_t)) : NULL;
+    size_t started = 0;
+    if (tid != NULL)
+        while (started < want - 1 &&
+               pthread_create(tid + started, NULL, pool_worker, &p) == 0)
+            started++;
+    pool_worker(&p);
+    while (started)
+        pthread_join(tid[--started], NULL);
+    free(tid);
+    pthread_mutex_destroy(&p.lock);
+}
@@ -0,0 +1,460 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "gzinfo.h"
+
+// Random-access reader for concurrent pread-style use. The output between one
+// access point and the next, a span, is decoded whole on first use and kept
+// in a cache shared by all threads. The cache is split into shards, each with
+// its own lock and least-recently-used list, and consecutive spans land in
+// different shards, so threads reading different places rarely wait on each
+// other. A span being decoded is in the cache already, marked as not ready,
+// and other threads that want it wait for it rather than decode it again.
+// Entries are counted, so one can be evicted only when no read is copying from
+// it. Each shard may hold its share of the cache, and a span larger than that
+// is decoded for the reads that want it and not kept. A read that starts where
+// the last one ended has the span after it decoded ahead by a background
+// thread.
+
+#define SHARDS 16
+#define BUCKETS 64
+#define NONE ((size_t)-1)
+
+typedef struct entry {
+    size_t id;                      // point the span starts at
+    unsigned char *data;            // the span, or NULL until ready
+    size_t len;
+    int refs;
+    int err;                        // decoding failed
+    int linked;                     // in the shard's table and list
+    struct entry *prev, *next;      // most recently used first
+    struct entry *chain;            // hash bucket
+} entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    entry *head, *tail;
+    entry *hash[BUCKETS];
+    size_t bytes, cap;
+    uint64_t hits, misses;
+} shard;
+
+struct gz_reader {
+    gz_index x;
+    int fd;
+    shard shard[SHARDS];
+
+    // Read-ahead: the end of the last read, and the span wanted next.
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t ahead;
+    int running, stop;
+    uint64_t next;
+    size_t want;
+};
+
+static uint64_t span_len(const gz_reader *r, size_t id) {
+    uint64_t end = id + 1 < r->x.have ? r->x.list[id + 1].out : r->x.length;
+    return end - r->x.list[id].out;
+}
+
+static void unlink_entry(shard *s, entry *e) {
+    entry **p = s->hash + (e->id / SHARDS) % BUCKETS;
+    while (*p != e)
+        p = &(*p)->chain;
+    *p = e->chain;
+    if (e->prev != NULL)
+        e->prev->next = e->next;
+    else
+        s->head = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        s->tail = e->prev;
+    e->linked = 0;
+    if (e->data != NULL)
+        s->bytes -= e->len;
+}
+
+static void push_front(shard *s, entry *e) {
+    e->prev = NULL;
+    e->next = s->head;
+    if (s->head != NULL)
+        s->head->prev = e;
+    else
+        s->tail = e;
+    s->head = e;
+}
+
+// Drop the least recently used spans not in use until s is under its cap.
+// Spans in use are dropped when let go of, in span_put().
+static void evict(shard *s) {
+    entry *e = s->tail;
+    while (s->bytes > s->cap && e != NULL) {
+        entry *prev = e->prev;
+        if (e->refs == 0 && e->data != NULL) {
+            unlink_entry(s, e);
+            free(e->data);
+            free(e);
+        }
+        e = prev;
+    }
+}
+
+struct fill {
+    unsigned char *at;
+};
+
+static int fill_sink(void *ctx, const unsigned char *data, size_t len) {
+    struct fill *f = ctx;
+    memcpy(f->at, data, len);
+    f->at += len;
+    return 0;
+}
+
+// Return the cached span at point id, decoding it if need be, with a
+// reference held. Return NULL if it could not be decoded.
+static entry *span_get(gz_reader *r, size_t id) {
+    shard *s = r->shard + id % SHARDS;
+    pthread_mutex_lock(&s->lock);
+    entry *e = s->hash[(id / SHARDS) % BUCKETS];
+    while (e != NULL && e->id != id)
+        e = e->chain;
+    if (e != NULL) {
+        s->hits++;
+        e->refs++;
+        if (e->prev != NULL) {
+            // Move it to the front.
+            e->prev->next = e->next;
+            if (e->next != NULL)
+                e->next->prev = e->prev;
+            else
+                s->tail = e->prev;
+            push_front(s, e);
+        }
+        while (e->data == NULL && !e->err)
+            pthread_cond_wait(&s->ready, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+        return e;
+    }
+
+    // Not there: put in a placeholder and decode the span without the lock.
+    s->misses++;
+    e = calloc(1, sizeof(entry));
+    if (e == NULL) {
+        pthread_mutex_unlock(&s->lock);
+        return NULL;
+    }
+    e->id = id;
+    e->refs = 1;
+    e->linked = 1;
+    e->chain = s->hash[(id / SHARDS) % BUCKETS];
+    s->hash[(id / SHARDS) % BUCKETS] = e;
+    push_front(s, e);
+    pthread_mutex_unlock(&s->lock);
+
+    const gz_point *p = r->x.list + id;
+    size_t len = span_len(r, id);
+    unsigned char *data = malloc(len ? len : 1);
+    struct fill f = {data};
+    int ret = data == NULL ? Z_MEM_ERROR :
+              gz_point_read(p, r->x.mode, r->fd, p->out, len, fill_sink, &f);
+
+    pthread_mutex_lock(&s->lock);
+    if (ret == Z_OK && (size_t)(f.at - data) == len) {
+        if (len > s->cap)
+            unlink_entry(s, e);     // too large to keep
+        e->data = data;
+        e->len = len;
+        if (e->linked) {
+            s->bytes += len;
+            evict(s);
+        }
+    }
+    else {
+        free(data);
+        e->err = 1;
+        unlink_entry(s, e);
+    }
+    pthread_cond_broadcast(&s->ready);
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+// Let go of e, freeing it if it was dropped from the cache.
+static void span_put(gz_reader *r, entry *e) {
+    shard *s = r->shard + e->id % SHARDS;
+    pthread_mutex_lock(&s->lock);
+    int gone = --e->refs == 0 && !e->linked;
+    if (e->refs == 0 && e->linked && s->bytes > s->cap)
+        evict(s);
+    pthread_mutex_unlock(&s->lock);
+    if (gone) {
+        free(e->data);
+        free(e);
+    }
+}
+
+static void *read_ahead(void *arg) {
+    gz_reader *r = arg;
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (r->want == NONE && !r->stop)
+            pthread_cond_wait(&r->wake, &r->lock);
+        if (r->stop)
+            break;
+        size_t id = r->want;
+        r->want = NONE;
+        pthread_mutex_unlock(&r->lock);
+        entry *e = span_get(r, id);
+        if (e != NULL)
+            span_put(r, e);
+        pthread_mutex_lock(&r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+// Open the compressed file path for reading at any offset, using the index
+// in the file index if not NULL, or else building one with points every span
+// bytes. Keep up to cache bytes of decoded spans. Return NULL after a
+// message on failure.
+gz_reader *gz_reader_open(char *path, const char *index, uint64_t span,
+                          size_t cache) {
+    if (vol_single(path) < 0)
+        return NULL;
+    gz_reader *r = calloc(1, sizeof(gz_reader));
+    if (r == NULL) {
+        fprintf(stderr, "gzinfo: out of memory\n");
+        return NULL;
+    }
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", path);
+        free(r);
+        return NULL;
+    }
+    if (index != NULL ? gz_index_open(index, r->fd, &r->x) < 0 :
+                        gz_index_build(path, &r->x, span, NULL) != Z_OK) {
+        close(r->fd);
+        free(r);
+        return NULL;
+    }
+    for (int i = 0; i < SHARDS; i++) {
+        pthread_mutex_init(&r->shard[i].lock, NULL);
+        pthread_cond_init(&r->shard[i].ready, NULL);
+        r->shard[i].cap = cache / SHARDS;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    r->want = NONE;
+    r->running = pthread_create(&r->ahead, NULL, read_ahead, r) == 0;
+    return r;
+}
+
+// Read up to len bytes of uncompressed data at off into buf. Return the
+// number of bytes read, which is less than len only at the end of the data,
+// or -1 on error.
+long gz_pread(gz_reader *r, void *buf, size_t len, uint64_t off) {
+    const gz_index *x = &r->x;
+    unsigned char *to = buf;
+    size_t got = 0, id = NONE;
+    if (off >= x->length)
+        return 0;
+    if (len > x->length - off)
+        len = x->length - off;
+    while (got < len) {
+        // The last point at or before off.
+        size_t lo = 0, hi = x->have;
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (x->list[mid].out <= off)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        id = lo;
+        entry *e = span_get(r, id);
+        if (e == NULL || e->err) {
+            if (e != NULL)
+                span_put(r, e);
+            return -1;
+        }
+        size_t at = off - x->list[id].out;
+        size_t n = e->len - at < len - got ? e->len - at : len - got;
+        memcpy(to + got, e->data + at, n);
+        span_put(r, e);
+        got += n;
+        off += n;
+    }
+
+    // Read the next span ahead if this read followed on from the last.
+    pthread_mutex_lock(&r->lock);
+    if (got && r->next == off - got && id + 1 < x->have) {
+        r->want = id + 1;
+        pthread_cond_signal(&r->wake);
+    }
+    r->next = off;
+    pthread_mutex_unlock(&r->lock);
+    return got;
+}
+
+uint64_t gz_reader_length(const gz_reader *r) {
+    return r->x.length;
+}
+
+void gz_reader_stats(gz_reader *r, uint64_t *hits, uint64_t *misses) {
+    *hits = *misses = 0;
+    for (int i = 0; i < SHARDS; i++) {
+        pthread_mutex_lock(&r->shard[i].lock);
+        *hits += r->shard[i].hits;
+        *misses += r->shard[i].misses;
+        pthread_mutex_unlock(&r->shard[i].lock);
+    }
+}
+
+void gz_reader_close(gz_reader *r) {
+    if (r == NULL)
+        return;
+    if (r->running) {
+        pthread_mutex_lock(&r->lock);
+        r->stop = 1;
+        pthread_cond_signal(&r->wake);
+        pthread_mutex_unlock(&r->lock);
+        pthread_join(r->ahead, NULL);
+    }
+    for (int i = 0; i < SHARDS; i++) {
+        shard *s = r->shard + i;
+        while (s->head != NULL) {
+            entry *e = s->head;
+            s->head = e->next;
+            free(e->data);
+            free(e);
+        }
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->ready);
+    }
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->wake);
+    gz_index_free(&r->x);
+    close(r->fd);
+    free(r);
+}
+
+// Exercise the reader: copy the given ranges out, or time random reads from
+// several threads, once with the cache cold and again with it warm.
+
+struct bench {
+    gz_reader *r;
+    size_t reads, size;
+    uint64_t seed;
+    int err;
+};
+
+static void bench_job(void *ctx, size_t i) {
+    struct bench *b = ctx;
+    uint64_t x = b->seed + i, length = gz_reader_length(b->r);
+    unsigned char *buf = malloc(b->size);
+    for (size_t k = 0; buf != NULL && k < b->reads; k++) {
+        uint64_t off = (splitmix(&x) >> 11) * 0x1p-53 * length;
+        if (gz_pread(b->r, buf, b->size, off) < 0)
+            b->err = 1;
+    }
+    if (buf == NULL)
+        b->err = 1;
+    free(buf);
+}
+
+int cmd_read(int argc, char **argv) {
+    int threads = 0, opt;
+    uint64_t span = 0, seed = 1;
+    size_t cache = 64 << 20, reads = 10000, size = 4096;
+    char *index = NULL;
+    while ((opt = getopt(argc, argv, "i:s:m:j:n:b:")) != -1)
+        switch (opt) {
+        case 'i':
+            index = optarg;
+            break;
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'm':
+            cache = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            reads = strtoull(optarg, NULL, 0);
+            break;
+        case 'b':
+            size = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc;
+        }
+    if (optind >= argc || size == 0) {
+        fprintf(stderr, "usage: gzinfo read [-i index] [-s span] [-m cache] "
+                        "[-j threads] [-n reads] [-b bytes] file "
+                        "[offset:length...]\n");
+        return 1;
+    }
+    char *name = argv[optind++];
+    gz_reader *r = gz_reader_open(name, index, span, cache);
+    if (r == NULL)
+        return 1;
+
+    int ret = 0;
+    if (optind < argc) {
+        // Copy each range out in pieces, as a sequential reader would.
+        unsigned char buf[65536];
+        for (; optind < argc && ret == 0; optind++) {
+            char *end;
+            uint64_t off = strtoull(argv[optind], &end, 0), len = UINT64_MAX;
+            if (*end == ':')
+                len = strtoull(end + 1, NULL, 0);
+            while (len) {
+                long got = gz_pread(r, buf, len < sizeof(buf) ? len : sizeof(buf),
+                                    off);
+                if (got < 0) {
+                    fprintf(stderr, "gzinfo: could not read %s\n", name);
+                    ret = 1;
+                }
+                if (got <= 0)
+                    break;
+                fwrite(buf, 1, got, stdout);
+                off += got;
+                len -= got;
+            }
+        }
+        gz_reader_close(r);
+        return ret;
+    }
+
+    threads = pool_threads(threads);
+    printf("Uncompressed Size: %s\n", humanSize(gz_reader_length(r)));
+    printf("Cache: %s", humanSize(cache));
+    printf(", %d threads, %zu reads of %zu bytes each\n", threads, reads, size);
+    for (int pass = 0; pass < 2 && ret == 0; pass++) {
+        uint64_t h0, m0, h1, m1;
+        struct bench b = {r, reads / threads + 1, size, seed, 0};
+        gz_reader_stats(r, &h0, &m0);
+        double t = wall_now();
+        pool_run(threads, threads, bench_job, &b);
+        t = wall_now() - t;
+        gz_reader_stats(r, &h1, &m1);
+        if (b.err) {
+            fprintf(stderr, "gzinfo: could not read %s\n", name);
+            ret = 1;
+        }
+        double n = (double)b.reads * threads;
+        printf("%s: %.1f us per read, %.0f reads/s, %.1f%% cache hits\n",
+               pass ? "Warm" : "Cold", 1e6 * t * threads / n, n / t,
+               h1 + m1 > h0 + m0 ? 100.0 * (h1 - h0) / (h1 + m1 - h0 - m0) : 0);
+    }
+    gz_reader_close(r);
+    return ret;
+}
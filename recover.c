@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Recovery scan of damaged gzip files. Members are decoded with the in-tree
+// decoder, which reports the exact bit at which decoding failed. From there
+// the scan resynchronizes at whichever comes first: the next plausible
+// member header, or the next deflate block found by a parallel block-start
+// search. Data after a resync is decoded without its window; bytes that
+// depend on the lost data come out as zeros in the salvaged output.
+
+#define SEGMENT (64U << 10)     // bytes per block-start search job
+
+struct salvage {
+    FILE *out;
+    uLong crc;
+    int err;
+};
+
+static void salvage_sink(void *ctx, const unsigned char *data, size_t len) {
+    struct salvage *s = ctx;
+    s->crc = crc32(s->crc, data, len);
+    if (s->out != NULL && fwrite(data, 1, len, s->out) != len)
+        s->err = 1;
+}
+
+struct search {
+    const unsigned char *in;
+    size_t len;
+    uint64_t from;              // first bit of the round
+    int64_t *hit;               // per segment: block start found, or -1
+};
+
+static void search_job(void *ctx, size_t i) {
+    struct search *s = ctx;
+    uint64_t from = s->from + i * 8 * (uint64_t)SEGMENT;
+    s->hit[i] = dfl_find_block(s->in, s->len, from, from + 8 * (uint64_t)SEGMENT);
+}
+
+// Return the bit offset of the next place to resume at or after bit from:
+// a member header (*header set) or a deflate block start. Return -1 if there
+// is neither before the end.
+static int64_t resync(const unsigned char *in, size_t len, uint64_t from,
+                      int threads, int *header) {
+    // Next plausible header, which bounds the block search.
+    uint64_t at = (from + 7) >> 3, head = len;
+    while (at + 3 <= len) {
+        const unsigned char *p = memchr(in + at, 0x1f, len - at);
+        if (p == NULL)
+            break;
+        at = p - in;
+        if (gz_header_plausible(p, len - at)) {
+            head = at;
+            break;
+        }
+        at++;
+    }
+
+    int segs = 4 * pool_threads(threads);
+    int64_t hit[segs];
+    struct search s = {in, len, from, hit};
+    while (s.from < 8 * (uint64_t)head) {
+        pool_run(threads, segs, search_job, &s);
+        for (int i = 0; i < segs; i++)
+            if (hit[i] >= 0 && (uint64_t)hit[i] < 8 * (uint64_t)head) {
+                *header = 0;
+                return hit[i];
+            }
+        s.from += segs * 8 * (uint64_t)SEGMENT;
+    }
+    *header = 1;
+    return head < len ? (int64_t)(8 * head) : -1;
+}
+
+// Report damage found at bit at and find where to resume. Return the bit
+// offset to resume at, or -1 if nothing decodable follows. *lost is
+// increased by the compressed bytes skipped.
+static int64_t skip(const unsigned char *in, size_t len, uint64_t at,
+                    const char *why, int threads, int *header, uint64_t *lost) {
+    int64_t next = at < 8 * (uint64_t)len ? resync(in, len, at + 1, threads, header) : -1;
+    uint64_t stop = next < 0 ? 8 * (uint64_t)len : (uint64_t)next;
+    printf("%-27s %-27s damaged: %s at bit %llu (byte %llu), %llu bytes skipped\n",
+           "", "-", why, (unsigned long long)at, (unsigned long long)(at >> 3),
+           (unsigned long long)((stop >> 3) - (at >> 3)));
+    *lost += (stop >> 3) - (at >> 3);
+    return next;
+}
+
+int cmd_recover(int argc, char **argv) {
+    int threads = 0, opt;
+    char *save = NULL;
+    while ((opt = getopt(argc, argv, "o:j:")) != -1)
+        switch (opt) {
+        case 'o':
+            save = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo recover [-o salvage] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    size_t len = st.st_size;
+    const unsigned char *in = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (len && in == MAP_FAILED) {
+        fprintf(stderr, "gzinfo: could not map %s\n", name);
+        return 1;
+    }
+    struct salvage sv = {NULL, 0, 0};
+    if (save != NULL && (sv.out = fopen(save, "wb")) == NULL) {
+        fprintf(stderr, "gzinfo: could not open %s for writing\n", save);
+        munmap((void *)in, len);
+        return 1;
+    }
+
+    uint64_t bit = 0, out = 0, lost = 0, good = 0, partial = 0;
+    long damaged = 0;
+    int header = 1;
+    printf("%-27s %-27s %s\n", "compressed bytes", "uncompressed bytes", "status");
+    while (bit < 8 * (uint64_t)len) {
+        uint64_t start = bit >> 3;
+        gz_hdr h;
+        int member = header && gz_header_parse(in + start, len - start, &h) > 0;
+        if (header && !member) {
+            damaged++;
+            int64_t next = skip(in, len, bit, "no member header", threads,
+                                &header, &lost);
+            if (next < 0)
+                break;
+            bit = next;
+            continue;
+        }
+
+        // A BGZF member's recorded size bounds the damage to that member.
+        uint64_t limit = member && h.bsize && h.bsize >= h.hdrlen + 8 &&
+                         start + h.bsize <= len ? start + h.bsize : 0;
+        dfl d;
+        if (dfl_init(&d, in, limit ? limit - 8 : len,
+                     member ? 8 * (start + h.hdrlen) : bit, NULL, 0, !member) < 0) {
+            fprintf(stderr, "gzinfo: out of memory\n");
+            break;
+        }
+        d.sink = salvage_sink;
+        d.ctx = &sv;
+        sv.crc = crc32(0, NULL, 0);
+        int ret;
+        while ((ret = dfl_block(&d)) == DFL_OK)
+            ;
+
+        uint64_t end = d.pos < 8 * (uint64_t)len ? d.pos : 8 * (uint64_t)len;
+        const char *why = NULL;
+        if (ret == DFL_END) {
+            // Check the trailer, which follows on the next byte boundary.
+            uint64_t t = (d.pos + 7) >> 3;
+            end = 8 * (t + 8);
+            if (t + 8 > len) {
+                why = "truncated trailer";
+                end = 8 * (uint64_t)len;
+            }
+            else if (member) {
+                // A stream picked up after damage began mid-member, so its
+                // CRC and length can't be checked against the trailer.
+                uint32_t crc = le32(in + t), isize = le32(in + t + 4);
+                if (limit && t + 8 != limit)
+                    why = "member size mismatch";
+                else if (isize != (uint32_t)d.total)
+                    why = "length mismatch";
+                else if (crc != sv.crc)
+                    why = "CRC mismatch";
+            }
+        }
+
+        char cr[32], ur[32];
+        snprintf(cr, sizeof(cr), "%llu-%llu", (unsigned long long)start,
+                 (unsigned long long)((end + 7) >> 3) - 1);
+        snprintf(ur, sizeof(ur), "%llu-%llu", (unsigned long long)out,
+                 (unsigned long long)(out + d.total) - 1);
+        if (d.total == 0)
+            snprintf(ur, sizeof(ur), "-");
+        if (ret == DFL_END && why == NULL && member) {
+            printf("%-27s %-27s ok\n", cr, ur);
+            good += d.total;
+        }
+        else if (ret == DFL_END && why == NULL)
+            printf("%-27s %-27s partial member, %.1f%% unresolved, CRC not checkable\n",
+                   cr, ur, d.total ? 100.0 * d.unknown / d.total : 0.0);
+        else if (ret == DFL_END)
+            printf("%-27s %-27s damaged: %s\n", cr, ur, why);
+        else if (d.total || member)
+            printf("%-27s %-27s %s, decoded up to the damage\n", cr, ur,
+                   member ? "member" : "partial member");
+        if (!(ret == DFL_END && why == NULL && member))
+            partial += d.total;
+        out += d.total;
+        const char *msg = d.msg;
+        dfl_free(&d);
+
+        if (ret == DFL_END) {
+            bit = end;
+            header = 1;
+            if (why != NULL)
+                damaged++;
+            continue;
+        }
+        if (limit) {
+            printf("%-27s %-27s damaged: %s at bit %llu (byte %llu)\n", "", "-",
+                   ret == DFL_EOF ? "member overruns its recorded size" :
+                   msg != NULL ? msg : "invalid data",
+                   (unsigned long long)end, (unsigned long long)(end >> 3));
+            damaged++;
+            bit = 8 * limit;
+            header = 1;
+            continue;
+        }
+
+        // Decoding failed at bit end. Skip ahead to the next place to resume.
+        damaged++;
+        int64_t next = skip(in, len, end, ret == DFL_EOF ? "unexpected end of data" :
+                            msg != NULL ? msg : "invalid data",
+                            threads, &header, &lost);
+        if (next < 0)
+            break;
+        bit = next;
+    }
+
+    printf("Damaged Ranges: %ld\n", damaged);
+    printf("Compressed Bytes Skipped: %s\n", humanSize(lost));
+    printf("Verified Uncompressed: %s\n", humanSize(good));
+    printf("Unverified Uncompressed: %s\n", humanSize(partial));
+    if (sv.out != NULL && (fclose(sv.out) != 0 || sv.err)) {
+        fprintf(stderr, "gzinfo: write error on %s\n", save);
+        damaged++;
+    }
+    if (len)
+        munmap((void *)in, len);
+    return damaged ? 1 : 0;
+}
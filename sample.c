@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Sampled integrity verification within an I/O budget. When every member
+// records its own size (BGZF), the members are listed by header hops and a
+// size-weighted random subset is drawn. Otherwise random offsets are drawn,
+// and the member that holds each is found by searching back for its header.
+// Sampled members are inflated and checked against their trailers in parallel.
+
+struct unit {
+    uint64_t off;               // member offset
+    uint64_t len;               // compressed length, 0 if not known yet
+    double key;                 // weighted sampling key
+    uint64_t used, out;         // compressed and uncompressed bytes checked
+    int ret;                    // verification result
+    int done;
+};
+
+struct sampler {
+    int fd;
+    uint64_t size;
+    uint64_t cap;               // per-unit read cap when lengths are unknown
+    struct unit *u;
+    pthread_mutex_t lock;
+    uint64_t read;              // total bytes read
+};
+
+// Search back from the random offset u->off for the header of the member
+// that holds it, so that each member is drawn in proportion to its own size,
+// and verify that member. A signature that doesn't verify may be a false one
+// inside the compressed data, or a damaged member. It is the latter if it
+// starts at the start of the file, or where a good member before it ends. The
+// 1024 bytes after each block are kept for the header check of the next, so
+// no byte is read twice. Return the bytes read.
+static uint64_t find_member(struct sampler *s, struct unit *u) {
+    unsigned char buf[CHUNK + 1024];
+    uint64_t target = u->off, end = target + 1, read = 0;
+    size_t after = s->size - end < 1024 ? s->size - end : 1024;
+    struct unit *fail = NULL;           // signatures that failed, descending
+    size_t nfail = 0, room = 0;
+    uint64_t prior = UINT64_MAX;        // end of the good member before it
+    u->ret = Z_BUF_ERROR;
+    while (end && read < s->cap && prior == UINT64_MAX) {
+        uint64_t lo = end > CHUNK ? end - CHUNK : 0;
+        size_t n = end - lo;
+        if (read)
+            memmove(buf + n, buf, after);
+        if (pread_full(s->fd, buf, read ? n : n + after, lo) < 0) {
+            u->ret = Z_ERRNO;
+            break;
+        }
+        read += read ? n : n + after;
+        for (size_t k = n; k--;) {
+            if (buf[k] != 0x1f || k + 3 > n + after || buf[k + 1] != 0x8b ||
+                buf[k + 2] != 8 || !gz_header_plausible(buf + k, n + after - k))
+                continue;
+            struct unit c = {lo + k, read < s->cap ? s->cap - read : 1, 0, 0,
+                             0, 0, 1};
+            if (c.len > s->size - c.off)
+                c.len = s->size - c.off;
+            c.ret = gz_verify_member(s->fd, c.off, c.len, &c.used, &c.out);
+            read += c.used;
+            if (c.ret == Z_OK && c.off + c.used <= target) {
+                prior = c.off + c.used;     // the offset is past its end
+                break;
+            }
+            if (c.ret == Z_OK || (c.ret == Z_BUF_ERROR && c.used == c.len)) {
+                *u = c;
+                free(fail);
+                return read - c.used;
+            }
+            if (nfail == room) {
+                room = room ? 2 * room : 16;
+                struct unit *more = realloc(fail, room * sizeof(struct unit));
+                if (more == NULL)
+                    break;
+                fail = more;
+            }
+            fail[nfail++] = c;
+        }
+        after = n < 1024 ? n : 1024;
+        end = lo;
+    }
+    if (end == 0 && prior == UINT64_MAX)
+        prior = 0;
+    for (size_t i = 0; i < nfail; i++)
+        if (fail[i].off == prior) {
+            *u = fail[i];
+            read -= u->used;
+            break;
+        }
+    free(fail);
+    return read;
+}
+
+static void verify_job(void *ctx, size_t i) {
+    struct sampler *s = ctx;
+    struct unit *u = s->u + i;
+    uint64_t read;
+    if (u->len == 0)
+        read = find_member(s, u);
+    else {
+        u->ret = gz_verify_member(s->fd, u->off, u->len, &u->used, &u->out);
+        u->done = 1;
+        read = 0;
+    }
+    pthread_mutex_lock(&s->lock);
+    s->read += read + (u->done ? u->used : 0);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static int by_key(const void *a, const void *b) {
+    double x = ((const struct unit *)a)->key, y = ((const struct unit *)b)->key;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int by_offset(const void *a, const void *b) {
+    uint64_t x = ((const struct unit *)a)->off, y = ((const struct unit *)b)->off;
+    return x < y ? -1 : x > y;
+}
+
+int cmd_sample(int argc, char **argv) {
+    int threads = 0, opt;
+    uint64_t seed = 1, budget = 0;
+    double percent = 1, rate = 0.001;
+    while ((opt = getopt(argc, argv, "b:p:r:s:j:")) != -1)
+        switch (opt) {
+        case 'b':
+            budget = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            percent = atof(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1 || percent <= 0 || rate <= 0 || rate >= 1) {
+        fprintf(stderr, "usage: gzinfo sample [-b bytes | -p percent] [-r rate] "
+                        "[-s seed] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    struct sampler s = {fd, st.st_size, 0, NULL, PTHREAD_MUTEX_INITIALIZER, 0};
+    if (budget == 0)
+        budget = s.size * (percent / 100);
+    if (budget < CHUNK)
+        budget = CHUNK;
+
+    gz_member *mem = NULL;
+    long n = gz_hop_members(fd, &mem), picked = 0;
+    uint64_t x = seed, total = s.size;
+    if (n > 0) {
+        // Efraimidis-Spirakis: the largest keys u^(1/w) are a sample drawn
+        // with probability proportional to size, without replacement. The
+        // members are then taken in key order until the budget is spent.
+        s.u = calloc(n, sizeof(struct unit));
+        if (s.u == NULL) {
+            fprintf(stderr, "gzinfo: out of memory\n");
+            free(mem);
+            close(fd);
+            return 1;
+        }
+        for (long i = 0; i < n; i++) {
+            s.u[i].off = mem[i].off;
+            s.u[i].len = mem[i].len;
+            s.u[i].key = log(((splitmix(&x) >> 11) + 1) * 0x1p-53) / mem[i].len;
+        }
+        free(mem);
+        qsort(s.u, n, sizeof(struct unit), by_key);
+        uint64_t spend = 0;
+        while (picked < n && spend + s.u[picked].len <= budget)
+            spend += s.u[picked++].len;
+        if (picked == 0)
+            picked = 1;
+        printf("Members: %ld BGZF blocks located by header hops\n", n);
+    }
+    else {
+        // Members don't record their size: follow random offsets in rounds of
+        // one per thread, each getting an equal share of what is left of the
+        // budget, until it is spent.
+        long round = pool_threads(threads), max = 0;
+        printf("Members: not self-sized, searching back from random offsets\n");
+        while (s.read + CHUNK <= budget && picked < 4096) {
+            if (picked + round > max) {
+                max = max ? max << 1 : 64;
+                struct unit *more = realloc(s.u, max * sizeof(struct unit));
+                if (more == NULL) {
+                    fprintf(stderr, "gzinfo: out of memory\n");
+                    break;
+                }
+                s.u = more;
+            }
+            memset(s.u + picked, 0, round * sizeof(struct unit));
+            for (long i = picked; i < picked + round; i++)
+                s.u[i].off = (splitmix(&x) >> 11) * 0x1p-53 * s.size;
+            s.cap = (budget - s.read) / round;
+            struct sampler batch = s;
+            batch.u = s.u + picked;
+            batch.read = 0;
+            pool_run(threads, round, verify_job, &batch);
+            s.read += batch.read;
+            picked += round;
+        }
+    }
+    if (n > 0)
+        pool_run(threads, picked, verify_job, &s);
+    close(fd);
+
+    // Tally, counting a member reached from two offsets once.
+    qsort(s.u, picked, sizeof(struct unit), by_offset);
+    long checked = 0, failed = 0, incomplete = 0;
+    uint64_t bytes = 0;
+    for (long i = 0; i < picked; i++) {
+        struct unit *u = s.u + i;
+        if (!u->done || (i && u->off == s.u[i - 1].off && s.u[i - 1].done))
+            continue;
+        if (u->ret == Z_BUF_ERROR && u->used == u->len && n <= 0)
+            incomplete++;
+        else if (u->ret != Z_OK) {
+            printf("FAILED: member at %llu: %s\n", (unsigned long long)u->off,
+                   u->ret == Z_BUF_ERROR ? "truncated" :
+                   u->ret == Z_ERRNO ? "read error" : "corrupt data");
+            failed++;
+        }
+        else {
+            checked++;
+            bytes += u->used;
+        }
+    }
+
+    printf("Sampled: %ld members, %s", checked + failed, humanSize(bytes));
+    printf(" of %s (seed %llu)\n", humanSize(total), (unsigned long long)seed);
+    printf("Bytes Read: %s", humanSize(s.read));
+    printf(" (%.3f%% of file)\n", 100.0 * s.read / total);
+    if (incomplete)
+        printf("Incomplete: %ld members larger than their share of the budget\n",
+               incomplete);
+    printf("Failed: %ld\n", failed);
+
+    // With k size-weighted draws all passing, corruption touching a fraction
+    // rate of the data would have been missed with probability (1-rate)^k.
+    long k = checked + failed;
+    if (k == 0)
+        printf("No complete members sampled: raise the budget, or use a full "
+               "verify for single-member files\n");
+    else if (failed == 0) {
+        printf("Confidence: %.2f%% that less than %.4g%% of the data is corrupt\n",
+               100 * (1 - pow(1 - rate, k)), 100 * rate);
+        printf("Corruption Detectable at 95%%: %.4g%% of the data or more\n",
+               100 * (1 - pow(0.05, 1.0 / k)));
+    }
+    free(s.u);
+    pthread_mutex_destroy(&s.lock);
+    return failed ? 1 : 0;
+}
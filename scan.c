@@ -0,0 +1,94 @@
+#include <stdlib.h>
+#include <string.h>
+#include "gzinfo.h"
+
+// Determine the format from the first bytes of a file: gzip, zlib, or else
+// plain uncompressed data. Unlike verify_gzip(), which falls back to raw
+// deflate, a zlib header has to pass its check bits here since there is no
+// raw deflate to fall back on.
+int detect_mode(const unsigned char *p, size_t n) {
+    if (n >= 3 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8)
+        return GZIP;
+    if (n >= 2 && (p[0] & 0xf) == 8 && (p[0] >> 4) <= 7 &&
+        ((p[0] << 8) | p[1]) % 31 == 0 && (p[1] & 0x20) == 0)
+        return ZLIB;
+    return PLAIN;
+}
+
+// Refill the input buffer. Return the number of bytes now available.
+static unsigned scan_fill(gz_scan *s) {
+    s->strm.avail_in = vol_read(&s->in, s->buf, sizeof(s->buf));
+    s->strm.next_in = s->buf;
+    s->totin += s->strm.avail_in;
+    return s->strm.avail_in;
+}
+
+// Open path for scan_read(). A path that starts a set of split volumes
+// (see vol_open()) is read as the whole set.
+int scan_open(gz_scan *s, const char *path) {
+    memset(s, 0, sizeof(*s));
+    if (vol_open(&s->in, path) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", path);
+        return Z_ERRNO;
+    }
+    scan_fill(s);
+    if (s->in.err) {
+        vol_close(&s->in);
+        return Z_ERRNO;
+    }
+    s->mode = detect_mode(s->buf, s->strm.avail_in);
+    s->ret = s->mode == PLAIN ? Z_OK : inflateInit2(&s->strm, s->mode);
+    if (s->ret != Z_OK) {
+        vol_close(&s->in);
+        return s->ret;
+    }
+    return Z_OK;
+}
+
+// Deliver the next run of uncompressed data. Return its length with *data
+// pointing at it, 0 at the end of the input, or a negative zlib error. The
+// data is valid until the next call. Concatenated gzip members are
+// decompressed as one stream.
+long scan_read(gz_scan *s, const unsigned char **data) {
+    if (s->mode == PLAIN) {
+        if (s->strm.avail_in == 0 && scan_fill(s) == 0)
+            return s->in.err ? Z_ERRNO : 0;
+        *data = s->strm.next_in;
+        long n = s->strm.avail_in;
+        s->strm.avail_in = 0;
+        s->totout += n;
+        return n;
+    }
+
+    s->strm.next_out = s->win;
+    s->strm.avail_out = sizeof(s->win);
+    while (s->strm.avail_out && s->ret == Z_OK) {
+        if (s->strm.avail_in == 0 && scan_fill(s) == 0) {
+            // The compressed data ended prematurely, or could not be read.
+            s->ret = s->in.err ? Z_ERRNO : Z_BUF_ERROR;
+            break;
+        }
+        s->ret = inflate(&s->strm, Z_NO_FLUSH);
+        if (s->ret == Z_NEED_DICT)
+            s->ret = Z_DATA_ERROR;
+        else if (s->ret == Z_STREAM_END) {
+            s->members++;
+            if (s->mode == GZIP &&
+                (s->strm.avail_in || vol_more(&s->in)))
+                s->ret = inflateReset2(&s->strm, GZIP);
+        }
+    }
+
+    long n = sizeof(s->win) - s->strm.avail_out;
+    s->totout += n;
+    *data = s->win;
+    if (n)
+        return n;
+    return s->ret == Z_STREAM_END ? 0 : s->ret;
+}
+
+void scan_close(gz_scan *s) {
+    if (s->mode != PLAIN)
+        inflateEnd(&s->strm);
+    vol_close(&s->in);
+}
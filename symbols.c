@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Statistics of the deflate symbol stream, for choosing producer settings.
+// The in-tree decoder (deflate.c) counts each literal, match length and
+// distance code as it goes, in the one pass that also checks the members
+// against their trailers. What costs time to decode is mostly the number of
+// symbols per output byte: short matches and literals are slow, long matches
+// fast, and distance-1 matches are runs that a compressor aiming at decode
+// speed would rather have. Far distances miss the cache.
+
+struct digest {
+    int mode;
+    uLong check;
+};
+
+static void digest_sink(void *ctx, const unsigned char *data, size_t len) {
+    struct digest *g = ctx;
+    g->check = g->mode == GZIP ? crc32(g->check, data, len) :
+                                 adler32(g->check, data, len);
+}
+
+static uint32_t be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void add_stats(dfl_stats *to, const dfl_stats *s) {
+    to->literals += s->literals;
+    to->matches += s->matches;
+    to->match_bytes += s->match_bytes;
+    to->rle += s->rle;
+}
+
+static double pct(uint64_t n, uint64_t of) {
+    return of ? 100.0 * n / of : 0.0;
+}
+
+// Print one line of a histogram: the share of n in all, with a bar.
+static void bar(const char *label, uint64_t n, uint64_t all) {
+    char b[41];
+    int w = all ? (int)(40.0 * n / all + 0.5) : 0;
+    memset(b, '#', w);
+    b[w] = 0;
+    printf("  %-12s %6.2f%%  %s\n", label, pct(n, all), b);
+}
+
+static void print_hist(const dfl_hist *h, const dfl_stats *s, uint64_t out,
+                       uint64_t stored) {
+    uint64_t lits = s->literals - stored, syms = lits + s->matches;
+    printf("\nSymbol Statistics:\n");
+    printf("Literals: %llu (%.1f%% of output, %.1f%% of symbols)\n",
+           (unsigned long long)lits, pct(lits, out), pct(lits, syms));
+    printf("Matches: %llu (%.1f%% of output), mean length %.1f\n",
+           (unsigned long long)s->matches, pct(s->match_bytes, out),
+           s->matches ? (double)s->match_bytes / s->matches : 0.0);
+    printf("Distance 1 (RLE) Matches: %llu (%.1f%% of matches)\n",
+           (unsigned long long)s->rle, pct(s->rle, s->matches));
+    printf("Stored Bytes: %llu (%.1f%% of output)\n",
+           (unsigned long long)stored, pct(stored, out));
+    printf("Blocks: %llu stored, %llu fixed, %llu dynamic",
+           (unsigned long long)h->type[0], (unsigned long long)h->type[1],
+           (unsigned long long)h->type[2]);
+    if (h->type[2])
+        printf(", %.0f header bits per dynamic block",
+               (double)h->header_bits / h->type[2]);
+    printf("\nSymbols per KB of Output: %.1f\n",
+           out ? 1024.0 * syms / out : 0.0);
+
+    // Literal bytes: order-0 entropy, and the most frequent.
+    double bits = 0;
+    for (int i = 0; i < 256; i++)
+        if (h->lit[i])
+            bits -= h->lit[i] * log2((double)h->lit[i] / lits);
+    printf("Literal Entropy: %.2f bits per byte\n", lits ? bits / lits : 0.0);
+    printf("Most Frequent Literals:");
+    unsigned char seen[256] = {0};
+    for (int k = 0; k < 8; k++) {
+        int best = -1;
+        for (int i = 0; i < 256; i++)
+            if (!seen[i] && h->lit[i] && (best < 0 || h->lit[i] > h->lit[best]))
+                best = i;
+        if (best < 0)
+            break;
+        seen[best] = 1;
+        if (best > ' ' && best < 127)
+            printf(" '%c' %.1f%%", best, pct(h->lit[best], lits));
+        else
+            printf(" 0x%02x %.1f%%", best, pct(h->lit[best], lits));
+    }
+    printf("\n");
+
+    static const unsigned lo[] = {3, 4, 5, 6, 7, 9, 17, 33, 65, 129, 258};
+    printf("Match Lengths:\n");
+    for (size_t i = 0; i < sizeof(lo) / sizeof(lo[0]); i++) {
+        unsigned hi = i + 1 < sizeof(lo) / sizeof(lo[0]) ? lo[i + 1] - 1 : 258;
+        uint64_t n = 0;
+        for (unsigned k = lo[i]; k <= hi; k++)
+            n += h->len[k];
+        char label[16];
+        if (hi == lo[i])
+            snprintf(label, sizeof(label), "%u", lo[i]);
+        else
+            snprintf(label, sizeof(label), "%u-%u", lo[i], hi);
+        bar(label, n, s->matches);
+    }
+
+    // Distance codes 0, 1-3, 4-7, ... cover 1, 2-4, 5-16, ... up to 32K.
+    static const char *dlabel[] = {"1", "2-4", "5-16", "17-64", "65-256",
+                                   "257-1K", "1K-4K", "4K-16K", "16K-32K"};
+    printf("Match Distances:\n");
+    for (int i = 0; i < 9; i++) {
+        int from = i < 2 ? i : 4 * (i - 1), to = i < 2 ? 3 * i :
+                                                 i == 8 ? 29 : 4 * i - 1;
+        uint64_t n = 0;
+        for (int k = from; k <= to; k++)
+            n += h->dist[k];
+        bar(dlabel[i], n, s->matches);
+    }
+}
+
+int cmd_symbols(int argc, char **argv) {
+    int per_block = 0, opt;
+    while ((opt = getopt(argc, argv, "b")) != -1)
+        switch (opt) {
+        case 'b':
+            per_block = 1;
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo symbols [-b] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    if (vol_single(name) < 0)
+        return 1;
+    struct stat st;
+    int fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    size_t len = st.st_size;
+    const unsigned char *in = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (in == MAP_FAILED) {
+        fprintf(stderr, "gzinfo: read error on %s\n", name);
+        return 1;
+    }
+    int mode = detect_mode(in, len);
+    if (mode == PLAIN)
+        mode = RAW;
+
+    dfl_hist *h = calloc(1, sizeof(dfl_hist));
+    dfl_stats all = {0};
+    uint64_t members = 0, blocks = 0, out = 0, stored = 0, pos = 0;
+    const char *why = NULL;
+    if (h == NULL)
+        why = "out of memory";
+    if (per_block)
+        printf("%-8s %-7s %14s %8s %10s %7s %7s %6s %5s\n", "block", "type",
+               "bit", "header", "out", "lit%", "matches", "mlen", "rle%");
+    while (why == NULL && pos < len) {
+        // Find the deflate data of the next member.
+        uint64_t start = 0;
+        gz_hdr hd;
+        if (mode == GZIP) {
+            if (gz_header_parse(in + pos, len - pos, &hd) <= 0) {
+                why = "invalid gzip header";
+                break;
+            }
+            start = pos + hd.hdrlen;
+        }
+        else if (mode == ZLIB) {
+            if (len < 2 || (in[0] << 8 | in[1]) % 31 || in[1] & 0x20) {
+                why = "invalid or unsupported zlib header";
+                break;
+            }
+            start = 2;
+        }
+        dfl d;
+        struct digest g = {mode, mode == GZIP ? crc32(0, NULL, 0) :
+                                                adler32(0, NULL, 0)};
+        if (dfl_init(&d, in, len, 8 * start, NULL, 0, 0) < 0) {
+            why = "out of memory";
+            break;
+        }
+        d.hist = h;
+        d.sink = digest_sink;
+        d.ctx = &g;
+        int ret;
+        do {
+            dfl_stats was = d.stats;
+            uint64_t bit = d.pos, made = d.total;
+            ret = dfl_block(&d);
+            if (ret < 0)
+                break;
+            if (d.type == 0)
+                stored += d.total - made;
+            if (per_block) {
+                static const char *type[] = {"stored", "fixed", "dynamic"};
+                uint64_t n = d.total - made, m = d.stats.matches - was.matches;
+                uint64_t lit = d.stats.literals - was.literals;
+                printf("%-8llu %-7s %14llu %8llu %10llu %6.1f%% %7llu %6.1f "
+                       "%4.1f%%\n", (unsigned long long)blocks + d.blocks - 1,
+                       type[d.type], (unsigned long long)bit,
+                       (unsigned long long)d.header_bits,
+                       (unsigned long long)n, pct(lit, n),
+                       (unsigned long long)m,
+                       m ? (double)(d.stats.match_bytes - was.match_bytes) / m : 0,
+                       pct(d.stats.rle - was.rle, m));
+            }
+        } while (ret == DFL_OK);
+        add_stats(&all, &d.stats);
+        blocks += d.blocks;
+        out += d.total;
+        uint64_t t = (d.pos + 7) >> 3;
+        if (ret != DFL_END)
+            why = d.msg != NULL ? d.msg : "unexpected end of data";
+        else if (mode == GZIP && (t + 8 > len || le32(in + t) != g.check ||
+                                  le32(in + t + 4) != (uint32_t)d.total))
+            why = "CRC or length mismatch";
+        else if (mode == ZLIB && (t + 4 > len || be32(in + t) != g.check))
+            why = "check value mismatch";
+        dfl_free(&d);
+        if (why != NULL) {
+            pos = d.pos >> 3;
+            break;
+        }
+        members++;
+        pos = t + (mode == GZIP ? 8 : mode == ZLIB ? 4 : 0);
+        if (mode != GZIP)
+            break;
+    }
+    if (why == NULL && pos < len && mode != GZIP)
+        why = "trailing data";
+
+    int ret = 0;
+    if (why != NULL) {
+        fflush(stdout);
+        fprintf(stderr, "gzinfo: %s at %llu in %s\n", why,
+                (unsigned long long)pos, name);
+        ret = 1;
+    }
+    else {
+        // The same summary as verify_gzip() gives.
+        header_present = mode != RAW;
+        compressed_size = len;
+        uncompressed_size = out;
+        deflate_blocks = blocks;
+        gzip_members = mode == GZIP ? members - 1 : 0;
+        if (per_block)
+            printf("\n");
+        print_gzip_info();
+        print_hist(h, &all, out, stored);
+    }
+    free(h);
+    munmap((void *)in, len);
+    return ret;
+}
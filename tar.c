@@ -0,0 +1,635 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "gzinfo.h"
+
+// tar.gz listing and extraction through a sidecar index. One decompression
+// pass parses the ustar, pax and GNU headers out of the output windows and
+// builds a random access index alongside. The sidecar holds both, so that a
+// listing needs no decompression at all and extracting an entry decompresses
+// at most the span before it plus the entry itself. With -r, entries that are
+// themselves gzip files are decompressed as they go by, and any tar entries
+// inside them are recorded against their parent.
+
+#define TARX "GZTX"
+#define MAXEXT (1U << 20)       // largest pax or GNU long name record kept
+
+typedef struct {
+    uint32_t parent;            // containing entry, or NONE
+    int type;                   // tar type flag
+    uint64_t mtime;
+    uint64_t header;            // offset of the first header of the entry
+    uint64_t data;              // offset of the data, in the parent's content
+    uint64_t size;
+    char *name;
+} tar_entry;
+
+#define NONE 0xffffffffU
+
+typedef struct {
+    size_t have, size;
+    tar_entry *e;
+    int err;
+} tar_list;
+
+enum { HEADER, DATA, EXT, BAD };
+
+struct nested;
+
+// Streaming tar parser. Content of the archive is fed in arbitrary pieces.
+struct tar {
+    tar_list *list;
+    uint32_t parent;            // entry this archive is the content of
+    int recurse;
+    int state;
+    uint64_t at;                // offset of the next byte fed
+    uint64_t left, pad;         // data and padding left of the current record
+    unsigned char hdr[512];
+    size_t fill;
+    int ext;                    // type of the extended header being collected
+    char *buf;                  // its content
+    size_t len;
+    char *name;                 // long name for the next entry, or NULL
+    uint64_t size, mtime;       // pax overrides for the next entry
+    int has_size, has_mtime;
+    uint64_t start;             // offset of the first header of the entry
+    int pending;                // an extended header was seen for it
+    struct nested *child;       // decompressing the current entry, or NULL
+};
+
+// A gzip entry being decompressed into a nested parser.
+struct nested {
+    z_stream strm;
+    int ok;
+    unsigned char out[WINSIZE];
+    struct tar tar;
+};
+
+static void tar_feed(struct tar *t, const unsigned char *p, size_t n);
+
+static void tar_init(struct tar *t, tar_list *list, uint32_t parent,
+                     int recurse) {
+    memset(t, 0, sizeof(struct tar));
+    t->list = list;
+    t->parent = parent;
+    t->recurse = recurse;
+    t->state = HEADER;
+}
+
+static void tar_end(struct tar *t);
+
+static void nested_feed(struct nested *c, const unsigned char *p, size_t n) {
+    c->strm.next_in = (unsigned char *)p;
+    c->strm.avail_in = n;
+    while (c->ok && c->strm.avail_in) {
+        c->strm.next_out = c->out;
+        c->strm.avail_out = WINSIZE;
+        int ret = inflate(&c->strm, Z_NO_FLUSH);
+        tar_feed(&c->tar, c->out, WINSIZE - c->strm.avail_out);
+        if (ret == Z_STREAM_END)
+            ret = inflateReset2(&c->strm, GZIP);
+        if (ret != Z_OK)
+            c->ok = 0;
+    }
+}
+
+static void nested_end(struct tar *t) {
+    if (t->child != NULL) {
+        inflateEnd(&t->child->strm);
+        tar_end(&t->child->tar);
+        free(t->child);
+        t->child = NULL;
+    }
+}
+
+static void tar_end(struct tar *t) {
+    nested_end(t);
+    free(t->buf);
+    free(t->name);
+    t->buf = t->name = NULL;
+}
+
+// Parse a tar number: octal, or base-256 if the high bit is set.
+static uint64_t tar_number(const unsigned char *p, size_t n) {
+    uint64_t v = 0;
+    if (*p & 0x80) {
+        v = *p & 0x3f;
+        for (size_t i = 1; i < n; i++)
+            v = (v << 8) | p[i];
+        return v;
+    }
+    size_t i = 0;
+    while (i < n && (p[i] == ' ' || p[i] == 0))
+        i++;
+    for (; i < n && p[i] >= '0' && p[i] <= '7'; i++)
+        v = (v << 3) | (p[i] - '0');
+    return v;
+}
+
+static int ends_with(const char *s, const char *tail) {
+    size_t n = strlen(s), k = strlen(tail);
+    return n >= k && strcmp(s + n - k, tail) == 0;
+}
+
+// Take the fields of interest from a pax extended header.
+static void pax_parse(struct tar *t) {
+    size_t at = 0;
+    while (at < t->len) {
+        char *rec = t->buf + at, *end;
+        unsigned long n = strtoul(rec, &end, 10);
+        if (n == 0 || n > t->len - at || *end != ' ')
+            break;
+        char *key = end + 1, *eq = memchr(key, '=', rec + n - key);
+        if (eq == NULL)
+            break;
+        char *val = eq + 1;
+        size_t vlen = rec + n - 1 - val;        // less the newline
+        if (eq - key == 4 && memcmp(key, "path", 4) == 0) {
+            free(t->name);
+            if ((t->name = malloc(vlen + 1)) != NULL) {
+                memcpy(t->name, val, vlen);
+                t->name[vlen] = 0;
+            }
+        }
+        else if (eq - key == 4 && memcmp(key, "size", 4) == 0) {
+            t->size = strtoull(val, NULL, 10);
+            t->has_size = 1;
+        }
+        else if (eq - key == 5 && memcmp(key, "mtime", 5) == 0) {
+            t->mtime = strtoull(val, NULL, 10);
+            t->has_mtime = 1;
+        }
+        at += n;
+    }
+}
+
+// Process the complete header in t->hdr, which starts at t->at - 512.
+static void tar_header(struct tar *t) {
+    const unsigned char *h = t->hdr;
+    uint64_t here = t->at - 512;
+    unsigned sum = 0;
+    int zero = 1;
+    for (int i = 0; i < 512; i++) {
+        sum += i >= 148 && i < 156 ? ' ' : h[i];
+        zero &= h[i] == 0;
+    }
+    if (zero)
+        return;                 // end of archive blocks
+    if (sum != tar_number(h + 148, 8)) {
+        t->state = BAD;
+        return;
+    }
+    if (!t->pending)
+        t->start = here;
+    uint64_t size = tar_number(h + 124, 12);
+    int type = h[156];
+    t->pad = (512 - size % 512) % 512;
+
+    if (type == 'x' || type == 'L' || type == 'K' || type == 'g') {
+        // Extended header or GNU long name for the next entry. Global pax
+        // headers and long link names are skipped over.
+        t->ext = type;
+        t->len = 0;
+        t->left = size;
+        t->pending = 1;
+        t->state = EXT;
+        return;
+    }
+
+    // A regular entry.
+    if (t->has_size)
+        size = t->size;
+    char *name = t->name;
+    if (name == NULL && (name = malloc(257)) != NULL) {
+        // ustar splits long names into a prefix and a name.
+        size_t k = 0;
+        if (memcmp(h + 257, "ustar", 5) == 0 && h[345]) {
+            k = strnlen((const char *)h + 345, 155);
+            memcpy(name, h + 345, k);
+            name[k++] = '/';
+        }
+        size_t m = strnlen((const char *)h, 100);
+        memcpy(name + k, h, m);
+        name[k + m] = 0;
+    }
+    t->name = NULL;
+    tar_list *l = t->list;
+    if (name != NULL && l->have == l->size) {
+        size_t max = l->size ? l->size << 1 : 256;
+        tar_entry *more = realloc(l->e, max * sizeof(tar_entry));
+        if (more == NULL) {
+            free(name);
+            name = NULL;
+        }
+        else {
+            l->e = more;
+            l->size = max;
+        }
+    }
+    if (name == NULL)
+        l->err = 1;
+    else {
+        tar_entry *e = l->e + l->have++;
+        e->parent = t->parent;
+        e->type = type ? type : '0';
+        e->mtime = t->has_mtime ? t->mtime : tar_number(h + 136, 12);
+        e->header = t->start;
+        e->data = t->at;
+        e->size = type == '1' || type == '2' || type == '5' ? 0 : size;
+        e->name = name;
+        if (t->recurse && (e->type == '0' || e->type == '7') && e->size &&
+            (ends_with(name, ".gz") || ends_with(name, ".tgz"))) {
+            struct nested *c = malloc(sizeof(struct nested));
+            if (c != NULL) {
+                memset(&c->strm, 0, sizeof(z_stream));
+                c->ok = inflateInit2(&c->strm, GZIP) == Z_OK;
+                tar_init(&c->tar, l, l->have - 1, 1);
+                t->child = c;
+            }
+        }
+        size = e->size;
+    }
+    t->pending = t->has_size = t->has_mtime = 0;
+    t->left = size;
+    t->pad = (512 - size % 512) % 512;
+    t->state = DATA;
+}
+
+static void tar_feed(struct tar *t, const unsigned char *p, size_t n) {
+    while (n && t->state != BAD) {
+        size_t k;
+        if (t->state == HEADER) {
+            k = 512 - t->fill < n ? 512 - t->fill : n;
+            memcpy(t->hdr + t->fill, p, k);
+            t->fill += k;
+            t->at += k;
+            p += k;
+            n -= k;
+            if (t->fill == 512) {
+                t->fill = 0;
+                tar_header(t);
+            }
+            continue;
+        }
+        if (t->left) {
+            k = t->left < n ? t->left : n;
+            if (t->state == EXT && (t->ext == 'x' || t->ext == 'L') &&
+                t->len + k <= MAXEXT) {
+                char *more = realloc(t->buf, t->len + k + 1);
+                if (more != NULL) {
+                    memcpy(more + t->len, p, k);
+                    t->buf = more;
+                    t->len += k;
+                    t->buf[t->len] = 0;
+                }
+            }
+            else if (t->state == DATA && t->child != NULL)
+                nested_feed(t->child, p, k);
+            t->left -= k;
+        }
+        else {
+            k = t->pad < n ? t->pad : n;
+            t->pad -= k;
+        }
+        t->at += k;
+        p += k;
+        n -= k;
+        if (t->left == 0 && t->pad == 0) {
+            if (t->state == EXT && t->ext == 'x')
+                pax_parse(t);
+            else if (t->state == EXT && t->ext == 'L' && t->buf != NULL) {
+                free(t->name);
+                t->name = strdup(t->buf);
+            }
+            if (t->state == EXT)
+                t->len = 0;
+            nested_end(t);
+            t->state = HEADER;
+        }
+    }
+}
+
+static void tar_feed_window(void *ctx, const unsigned char *data, size_t len) {
+    tar_feed(ctx, data, len);
+}
+
+// Full path of entry i, parents first and separated by slashes.
+static void entry_path(const tar_list *l, uint32_t i, char *path, size_t max) {
+    uint32_t chain[64];
+    int depth = 0;
+    for (uint32_t k = i; k != NONE && depth < 64; k = l->e[k].parent)
+        chain[depth++] = k;
+    size_t at = 0;
+    path[0] = 0;
+    while (depth-- > 0 && at < max)     // a longer path is cut off at max
+        at += snprintf(path + at, max - at, "%s%s", at ? "/" : "",
+                       l->e[chain[depth]].name);
+}
+
+// The sidecar records whether it was built with -r, since a listing without
+// the nested entries, or with them, is no use for the other.
+static int save_sidecar(const char *path, int recurse, const gz_index *x,
+                        const tar_list *l) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL)
+        return -1;
+    fwrite(TARX, 1, 4, out);
+    put_le(out, recurse, 1);
+    gz_index_save(out, x);
+    put_le(out, l->have, 8);
+    for (size_t i = 0; i < l->have; i++) {
+        const tar_entry *e = l->e + i;
+        size_t n = strlen(e->name);
+        put_le(out, e->parent, 4);
+        put_le(out, e->type, 1);
+        put_le(out, e->mtime, 8);
+        put_le(out, e->header, 8);
+        put_le(out, e->data, 8);
+        put_le(out, e->size, 8);
+        put_le(out, n, 4);
+        fwrite(e->name, 1, n, out);
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Load the sidecar at path. Fail if it was built with a different -r, unless
+// recurse is -1 for either.
+static int load_sidecar(const char *path, int recurse, gz_index *x,
+                        tar_list *l) {
+    FILE *in = fopen(path, "rb");
+    char magic[4];
+    uint64_t n, v[7];
+    memset(x, 0, sizeof(gz_index));
+    memset(l, 0, sizeof(tar_list));
+    if (in == NULL)
+        return -1;
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, TARX, 4) ||
+        get_le(in, 1, v) || (recurse >= 0 && v[0] != (uint64_t)recurse) ||
+        gz_index_load(in, x) < 0) {
+        fclose(in);
+        return -1;
+    }
+    if (get_le(in, 8, &n) || n > x->length / 512 + 1 ||
+        (l->e = calloc(n ? n : 1, sizeof(tar_entry))) == NULL) {
+        fclose(in);
+        gz_index_free(x);
+        return -1;
+    }
+    l->size = n;
+    for (; l->have < n; l->have++) {
+        tar_entry *e = l->e + l->have;
+        if (get_le(in, 4, v) || get_le(in, 1, v + 1) || get_le(in, 8, v + 2) ||
+            get_le(in, 8, v + 3) || get_le(in, 8, v + 4) ||
+            get_le(in, 8, v + 5) || get_le(in, 4, v + 6) ||
+            (e->name = malloc(v[6] + 1)) == NULL ||
+            fread(e->name, 1, v[6], in) != v[6])
+            break;
+        e->name[v[6]] = 0;
+        e->parent = v[0];
+        e->type = v[1];
+        e->mtime = v[2];
+        e->header = v[3];
+        e->data = v[4];
+        e->size = v[5];
+        if (e->parent != NONE && e->parent >= l->have)
+            break;
+    }
+    fclose(in);
+    if (l->have < n) {
+        for (size_t i = 0; i <= l->have && i < n; i++)
+            free(l->e[i].name);
+        free(l->e);
+        gz_index_free(x);
+        return -1;
+    }
+    return 0;
+}
+
+static void list_free(tar_list *l) {
+    for (size_t i = 0; i < l->have; i++)
+        free(l->e[i].name);
+    free(l->e);
+}
+
+// Build the index and entry list for name in one pass, and save them.
+static int build(char *name, const char *side, uint64_t span, int recurse,
+                 gz_index *x, tar_list *l) {
+    struct tar t;
+    memset(l, 0, sizeof(tar_list));
+    tar_init(&t, l, NONE, recurse);
+    verify_hooks hooks = {tar_feed_window, NULL, &t};
+    int ret = gz_index_build(name, x, span, &hooks);
+    int bad = t.state == BAD && l->have == 0;
+    tar_end(&t);
+    if (ret != Z_OK) {
+        list_free(l);
+        return -1;
+    }
+    if (bad) {
+        fprintf(stderr, "gzinfo: %s does not contain a tar archive\n", name);
+        list_free(l);
+        gz_index_free(x);
+        return -1;
+    }
+    if (l->err)
+        fprintf(stderr, "gzinfo: out of memory, listing incomplete\n");
+    if (save_sidecar(side, recurse, x, l) < 0)
+        fprintf(stderr, "gzinfo: could not write index %s\n", side);
+    return 0;
+}
+
+// Extraction pipeline. The index delivers the content of the outermost
+// entry; each stage inflates an enclosing gzip entry and passes on the range
+// of its output that holds the next entry in, down to the one wanted.
+struct stage {
+    z_stream strm;
+    int ret;
+    uint64_t at, from, to;      // output offset, and the range passed on
+    struct stage *next;         // or NULL to write to out
+    FILE *out;
+    int err;
+};
+
+static int stage_sink(void *ctx, const unsigned char *data, size_t len);
+
+static int range_pass(struct stage *s, const unsigned char *data, size_t len) {
+    // data is output at offset s->at of this stage.
+    uint64_t a = s->at, b = s->at + len;
+    s->at = b;
+    if (b <= s->from || a >= s->to)
+        return a >= s->to;
+    size_t lo = s->from > a ? s->from - a : 0;
+    size_t hi = s->to < b ? s->to - a : len;
+    if (s->next != NULL)
+        return stage_sink(s->next, data + lo, hi - lo) || b >= s->to;
+    if (fwrite(data + lo, 1, hi - lo, s->out) != hi - lo)
+        s->err = 1;
+    return s->err || b >= s->to;
+}
+
+static int stage_sink(void *ctx, const unsigned char *data, size_t len) {
+    struct stage *s = ctx;
+    if (s->strm.state == NULL)  // pass through
+        return range_pass(s, data, len);
+    unsigned char out[WINSIZE];
+    s->strm.next_in = (unsigned char *)data;
+    s->strm.avail_in = len;
+    while (s->strm.avail_in && s->ret == Z_OK) {
+        s->strm.next_out = out;
+        s->strm.avail_out = sizeof(out);
+        s->ret = inflate(&s->strm, Z_NO_FLUSH);
+        if (range_pass(s, out, sizeof(out) - s->strm.avail_out))
+            return 1;
+        if (s->ret == Z_STREAM_END)
+            s->ret = inflateReset2(&s->strm, GZIP);
+    }
+    return s->ret != Z_OK;
+}
+
+static int extract(const gz_index *x, int fd, const tar_list *l, uint32_t i,
+                   FILE *out) {
+    uint32_t chain[64];
+    int depth = 0;
+    for (uint32_t k = i; k != NONE && depth < 64; k = l->e[k].parent)
+        chain[depth++] = k;
+    // chain[depth-1] is the outermost entry, read straight from the index.
+    struct stage st[64];
+    memset(st, 0, sizeof(st));
+    for (int k = depth - 2; k >= 0; k--) {
+        struct stage *s = st + k;
+        s->from = l->e[chain[k]].data;
+        s->to = s->from + l->e[chain[k]].size;
+        s->next = k ? st + k - 1 : NULL;
+        s->out = out;
+        s->ret = inflateInit2(&s->strm, GZIP);
+    }
+    const tar_entry *top = l->e + chain[depth - 1];
+    struct stage pass = {.from = top->data, .to = top->data + top->size,
+                         .at = top->data, .next = depth > 1 ? st + depth - 2 : NULL,
+                         .out = out};
+    int ret = gz_index_read(x, fd, top->data, top->size, stage_sink, &pass);
+    int err = pass.err;
+    for (int k = 0; k < depth - 1; k++) {
+        if (st[k].at < st[k].to || st[k].ret == Z_DATA_ERROR)
+            err = 1;
+        err |= st[k].err;
+        inflateEnd(&st[k].strm);
+    }
+    if (ret != Z_OK || err)
+        return -1;
+    return 0;
+}
+
+int cmd_tar(int argc, char **argv) {
+    int recurse = 0, opt;
+    uint64_t span = 0;
+    char *side = NULL, *save = NULL;
+    while ((opt = getopt(argc, argv, "rs:i:o:")) != -1)
+        switch (opt) {
+        case 'r':
+            recurse = 1;
+            break;
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            side = optarg;
+            break;
+        case 'o':
+            save = optarg;
+            break;
+        default:
+            optind = argc;
+        }
+    int args = argc - optind;
+    char *op = args ? argv[optind] : "";
+    if (!((args == 2 && (strcmp(op, "list") == 0 || strcmp(op, "index") == 0)) ||
+          (args == 3 && strcmp(op, "extract") == 0))) {
+        fprintf(stderr, "usage: gzinfo tar [-r] [-s span] [-i index] list file\n"
+                        "       gzinfo tar [-r] [-s span] [-i index] index file\n"
+                        "       gzinfo tar [-i index] [-o out] extract file path\n");
+        return 1;
+    }
+    char *name = argv[optind + 1], path[4096];
+    if (side == NULL) {
+        snprintf(path, sizeof(path), "%s.tidx", name);
+        side = path;
+    }
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        return 1;
+    }
+
+    // Use the sidecar if it is there and still matches, else build it.
+    // Extraction takes a sidecar built either way.
+    gz_index x;
+    tar_list l;
+    int built = 0;
+    int want = strcmp(op, "extract") == 0 ? -1 : recurse;
+    memset(&x, 0, sizeof(x));
+    if (strcmp(op, "index") == 0 || load_sidecar(side, want, &x, &l) < 0 ||
+        gz_index_stale(&x, fd)) {
+        if (x.list != NULL) {
+            gz_index_free(&x);
+            list_free(&l);
+        }
+        if (build(name, side, span, recurse, &x, &l) < 0) {
+            close(fd);
+            return 1;
+        }
+        built = 1;
+    }
+
+    int ret = 0;
+    char full[8192];
+    if (strcmp(op, "index") == 0)
+        printf("Indexed %zu entries, %zu access points %s apart, in %s\n",
+               l.have, x.have, humanSize(x.span), side);
+    else if (strcmp(op, "list") == 0) {
+        for (size_t i = 0; i < l.have; i++) {
+            tar_entry *e = l.e + i;
+            char when[32];
+            time_t t = e->mtime;
+            struct tm *tm = gmtime(&t);
+            if (tm == NULL || !strftime(when, sizeof(when), "%Y-%m-%d %H:%M", tm))
+                strcpy(when, "-");
+            entry_path(&l, i, full, sizeof(full));
+            printf("%c %14llu  %s  %s\n", e->type, (unsigned long long)e->size,
+                   when, full);
+        }
+        printf("Entries: %zu (index %s)\n", l.have, built ? "built" : "loaded");
+    }
+    else {
+        const char *want = argv[optind + 2];
+        size_t i = 0;
+        for (; i < l.have; i++) {
+            entry_path(&l, i, full, sizeof(full));
+            if (strcmp(full, want) == 0)
+                break;
+        }
+        FILE *out = save == NULL ? stdout : fopen(save, "wb");
+        if (i == l.have) {
+            fprintf(stderr, "gzinfo: %s not found in %s\n", want, name);
+            ret = 1;
+        }
+        else if (out == NULL) {
+            fprintf(stderr, "gzinfo: could not open %s for writing\n", save);
+            ret = 1;
+        }
+        else if (extract(&x, fd, &l, i, out) < 0) {
+            fprintf(stderr, "gzinfo: could not extract %s\n", want);
+            ret = 1;
+        }
+        if (out != NULL && out != stdout && fclose(out) != 0) {
+            fprintf(stderr, "gzinfo: write error on %s\n", save);
+            ret = 1;
+        }
+    }
+    close(fd);
+    gz_index_free(&x);
+    list_free(&l);
+    return ret;
+}
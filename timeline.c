@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gzinfo.h"
+
+// Compression ratio and decoding time along the data, per fixed span of
+// uncompressed bytes. The compressed length of each stretch between access
+// points, which verify_gzip() reports at every block boundary, is shared out
+// over the spans it covers in proportion to its output. Decoding time is
+// measured between successive runs of output and charged to the spans they
+// land in. Runs of spans that hardly compress are listed, as those are the
+// places to store raw or split out.
+
+#define WIDTH 64                    // spans per line of the sparkline
+#define RAWISH 0.9                  // compressed / uncompressed to list
+
+struct line {
+    uint64_t span;
+    gz_spans in;                    // compressed bytes of each span
+    gz_spans ns;                    // decoding time of each span
+    uint64_t out;                   // output seen so far
+    uint64_t pin, pout;             // the last point, in bits and bytes
+    double last;                    // clock at the last output
+    int err;
+};
+
+// Make sure s->v[0..i] exists, zeroing what is new. Return -1 if out of
+// memory.
+int spans_reach(gz_spans *s, uint64_t i) {
+    if (i < s->n)
+        return 0;
+    if (i >= s->room) {
+        size_t room = s->room ? 2 * s->room : 1024;
+        while (room <= i)
+            room *= 2;
+        double *v = realloc(s->v, room * sizeof(double));
+        if (v == NULL)
+            return -1;
+        s->v = v;
+        s->room = room;
+    }
+    memset(s->v + s->n, 0, (i + 1 - s->n) * sizeof(double));
+    s->n = i + 1;
+    return 0;
+}
+
+// Share v out over the spans that the output from..to falls in, in
+// proportion to the output in each. With no output, v goes to the span at
+// from. Return -1 if out of memory.
+int spans_share(gz_spans *s, uint64_t span, uint64_t from, uint64_t to,
+                double v) {
+    if (spans_reach(s, (to > from ? to - 1 : from) / span) < 0)
+        return -1;
+    if (to <= from) {
+        s->v[from / span] += v;
+        return 0;
+    }
+    for (uint64_t at = from; at < to;) {
+        uint64_t i = at / span, end = (i + 1) * span < to ?
+                                      (i + 1) * span : to;
+        s->v[i] += v * (end - at) / (to - from);
+        at = end;
+    }
+    return 0;
+}
+
+static void line_window(void *ctx, const unsigned char *data, size_t len) {
+    struct line *l = ctx;
+    double now = 1e9 * wall_now();
+    (void)data;
+    if (spans_share(&l->ns, l->span, l->out, l->out + len, now - l->last) < 0)
+        l->err = 1;
+    l->out += len;
+    l->last = now;
+}
+
+static void line_point(void *ctx, uint64_t in, int bits, uint64_t out,
+                       const unsigned char *win, unsigned pos) {
+    struct line *l = ctx;
+    uint64_t bit = 8 * in - bits;
+    (void)win;
+    (void)pos;
+    if (spans_share(&l->in, l->span, l->pout, out, (bit - l->pin) / 8.0) < 0)
+        l->err = 1;
+    l->pin = bit;
+    l->pout = out;
+}
+
+// Print a sparkline of v[0..n-1], scaled to top.
+static void spark(const char *label, const double *v, size_t n, double top) {
+    static const char *bar[] = {"▁", "▂", "▃", "▄",
+                                "▅", "▆", "▇", "█"};
+    printf("  %-7s ", label);
+    for (size_t i = 0; i < n; i++) {
+        int k = top > 0 ? (int)(8 * v[i] / top) : 0;
+        fputs(bar[k < 0 ? 0 : k > 7 ? 7 : k], stdout);
+    }
+    printf("\n");
+}
+
+int cmd_timeline(int argc, char **argv) {
+    int csv = 0, opt;
+    uint64_t span = SPAN;
+    while ((opt = getopt(argc, argv, "s:c")) != -1)
+        switch (opt) {
+        case 's':
+            span = strtoull(optarg, NULL, 0);
+            break;
+        case 'c':
+            csv = 1;
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1 || span == 0) {
+        fprintf(stderr, "usage: gzinfo timeline [-s span] [-c] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    struct line l = {span, {NULL, 0, 0}, {NULL, 0, 0}, 0, 0, 0,
+                     1e9 * wall_now(), 0};
+    verify_hooks hooks = {line_window, line_point, &l};
+    int ret = verify_gzip(name, &hooks);
+    if (ret == Z_OK) {
+        // The last block of each stream and the trailer come after the last
+        // point. Both series then cover the same spans.
+        if (spans_share(&l.in, span, l.pout, uncompressed_size,
+                        compressed_size - l.pin / 8.0) < 0 ||
+            spans_reach(&l.in, l.ns.n ? l.ns.n - 1 : 0) < 0 ||
+            spans_reach(&l.ns, l.in.n - 1) < 0)
+            l.err = 1;
+        if (l.err) {
+            fprintf(stderr, "gzinfo: out of memory\n");
+            ret = Z_MEM_ERROR;
+        }
+    }
+    if (ret != Z_OK) {
+        free(l.in.v);
+        free(l.ns.v);
+        return 1;
+    }
+
+    if (csv) {
+        printf("offset,uncompressed,compressed,ratio,decode_us\n");
+        for (size_t i = 0; i < l.in.n; i++) {
+            uint64_t u = i + 1 < l.in.n ? span : uncompressed_size - i * span;
+            printf("%llu,%llu,%.0f,%.4f,%.1f\n",
+                   (unsigned long long)(i * span), (unsigned long long)u,
+                   l.in.v[i], u ? l.in.v[i] / u : 0.0, l.ns.v[i] / 1e3);
+        }
+        free(l.in.v);
+        free(l.ns.v);
+        return 0;
+    }
+
+    print_gzip_info();
+    printf("\nTimeline: %zu spans of %s", l.in.n, humanSize(span));
+    double ratio[WIDTH], speed[WIDTH], worst = 0, slow = 0, total = 0;
+    for (size_t i = 0; i < l.in.n; i++) {
+        total += l.ns.v[i];
+        uint64_t u = i + 1 < l.in.n ? span : uncompressed_size - i * span;
+        double r = u ? l.in.v[i] / u : 0, t = u ? l.ns.v[i] / u : 0;
+        worst = r > worst ? r : worst;
+        slow = t > slow ? t : slow;
+    }
+    printf(", ratio up to %.1f%%, decoding up to %.1f ns/byte\n", 100 * worst,
+           slow);
+    for (size_t i = 0; i < l.in.n; i += WIDTH) {
+        size_t n = l.in.n - i < WIDTH ? l.in.n - i : WIDTH;
+        for (size_t k = 0; k < n; k++) {
+            uint64_t u = i + k + 1 < l.in.n ? span :
+                         uncompressed_size - (i + k) * span;
+            ratio[k] = u ? l.in.v[i + k] / u : 0;
+            speed[k] = u ? l.ns.v[i + k] / u : 0;
+        }
+        printf("%s\n", humanSize(i * span));
+        spark("ratio", ratio, n, 1.0);
+        spark("time", speed, n, slow);
+    }
+
+    // Runs of spans that barely compress.
+    int any = 0;
+    for (size_t i = 0; i < l.in.n;) {
+        uint64_t u = i + 1 < l.in.n ? span : uncompressed_size - i * span;
+        if (u == 0 || l.in.v[i] / u < RAWISH) {
+            i++;
+            continue;
+        }
+        size_t j = i;
+        double in = 0, ns = 0;
+        uint64_t out = 0;
+        for (; j < l.in.n; j++) {
+            uint64_t v = j + 1 < l.in.n ? span : uncompressed_size - j * span;
+            if (v == 0 || l.in.v[j] / v < RAWISH)
+                break;
+            in += l.in.v[j];
+            ns += l.ns.v[j];
+            out += v;
+        }
+        if (!any)
+            printf("\nIncompressible Regions (ratio %.0f%% or more):\n",
+                   100 * RAWISH);
+        any = 1;
+        printf("  %llu-%llu: %.1f%% ratio, %.1f%% of the decoding time\n",
+               (unsigned long long)(i * span),
+               (unsigned long long)(i * span + out - 1), 100 * in / out,
+               100 * ns / (total > 0 ? total : 1));
+        i = j;
+    }
+    free(l.in.v);
+    free(l.ns.v);
+    return 0;
+}
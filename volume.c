@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// Split volume sets: name.gz.001, name.gz.002, ... read as one logical input.
+// The reader hands out each volume's data straight into the caller's buffer
+// and never returns bytes from two volumes in one read, so that the caller
+// can tell which volume its input came from.
+
+// Open the volume set starting at name. A name that ends in .gz, a dot, and
+// three or more digits starts a set that runs for as long as the following
+// numbers exist. Anything else, such as log.20240101, is a set of one.
+// Return 0, or -1 if name can't be opened.
+int vol_open(gz_volumes *v, const char *name) {
+    memset(v, 0, sizeof(gz_volumes));
+    size_t len = strlen(name), digits = 0;
+    while (digits < len && isdigit((unsigned char)name[len - 1 - digits]))
+        digits++;
+    int set = digits >= 3 && digits < 10 && len - digits >= 4 &&
+              strncasecmp(name + len - digits - 4, ".gz.", 4) == 0;
+    unsigned long first = set ? strtoul(name + len - digits, NULL, 10) : 0;
+
+    for (;;) {
+        char *path = malloc(len + 12);
+        struct stat st;
+        if (path == NULL)
+            break;
+        if (set)
+            snprintf(path, len + 12, "%.*s%0*lu", (int)(len - digits), name,
+                     (int)digits, first + v->n);
+        else
+            strcpy(path, name);
+        if (stat(path, &st) < 0) {
+            free(path);
+            break;
+        }
+        if (v->n % 16 == 0) {
+            char **names = realloc(v->name, (v->n + 16) * sizeof(char *));
+            uint64_t *size = realloc(v->size, (v->n + 16) * sizeof(uint64_t));
+            uint64_t *out = realloc(v->out, (v->n + 16) * sizeof(uint64_t));
+            v->name = names != NULL ? names : v->name;
+            v->size = size != NULL ? size : v->size;
+            v->out = out != NULL ? out : v->out;
+            if (names == NULL || size == NULL || out == NULL) {
+                free(path);
+                break;
+            }
+        }
+        v->name[v->n] = path;
+        v->size[v->n] = st.st_size;
+        v->out[v->n] = 0;
+        v->n++;
+        if (!set)
+            break;
+    }
+    if (v->n == 0 || (v->f = fopen(v->name[0], "rb")) == NULL) {
+        vol_close(v);
+        return -1;
+    }
+    return 0;
+}
+
+// Return the number of volumes in the set starting at name, 1 for a single
+// file, or 0 if name can't be opened.
+int vol_count(const char *name) {
+    gz_volumes v;
+    if (vol_open(&v, name) < 0)
+        return 0;
+    int n = v.n;
+    vol_close(&v);
+    return n;
+}
+
+// Return 0 if name is a single file, or else -1 after a message. The offsets
+// of an index run across the whole set, but pread() sees only the first
+// volume, so the commands that read at random can't take a set.
+int vol_single(const char *name) {
+    int n = vol_count(name);
+    if (n <= 1)
+        return 0;               // if it can't be opened, the caller says so
+    fprintf(stderr, "gzinfo: %s is the first of %d split volumes, which can't "
+            "be read at random; join them first\n", name, n);
+    return -1;
+}
+
+// Read up to len bytes from the current volume, moving on to the next when
+// it is used up. Return the number of bytes read, 0 at the end of the last
+// volume or on an error. v->at is the volume they came from.
+size_t vol_read(gz_volumes *v, void *buf, size_t len) {
+    while (v->f != NULL) {
+        size_t got = fread(buf, 1, len, v->f);
+        if (got || ferror(v->f)) {
+            v->err = ferror(v->f);
+            v->at = v->cur;
+            return got;
+        }
+        fclose(v->f);
+        v->f = NULL;
+        if (v->cur + 1 < v->n && (v->f = fopen(v->name[++v->cur], "rb")) == NULL)
+            v->err = 1;
+    }
+    return 0;
+}
+
+// Return true if there is more input after what has been read so far.
+int vol_more(gz_volumes *v) {
+    if (v->f != NULL) {
+        int c = getc(v->f);
+        if (c != EOF) {
+            ungetc(c, v->f);
+            return 1;
+        }
+    }
+    for (int i = v->cur + 1; i < v->n; i++)
+        if (v->size[i])
+            return 1;
+    return 0;
+}
+
+// Close the volume being read, keeping the list and the counts.
+void vol_stop(gz_volumes *v) {
+    if (v->f != NULL)
+        fclose(v->f);
+    v->f = NULL;
+}
+
+void vol_close(gz_volumes *v) {
+    vol_stop(v);
+    for (int i = 0; i < v->n; i++)
+        free(v->name[i]);
+    free(v->name);
+    free(v->size);
+    free(v->out);
+    memset(v, 0, sizeof(gz_volumes));
+}
+
+// Parallel verification of volumes that each hold whole members.
+struct vol_check {
+    const gz_volumes *v;
+    uint64_t *members;
+    int *ret;
+    uint64_t *out;
+};
+
+static void vol_job(void *ctx, size_t i) {
+    struct vol_check *c = ctx;
+    int fd = open(c->v->name[i], O_RDONLY);
+    uint64_t off = 0, size = c->v->size[i];
+    c->ret[i] = fd < 0 ? Z_ERRNO : Z_OK;
+    while (c->ret[i] == Z_OK && off < size) {
+        uint64_t used, out;
+        c->ret[i] = gz_verify_member(fd, off, size - off, &used, &out);
+        off += used;
+        c->out[i] += out;
+        c->members[i]++;
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+int cmd_volumes(int argc, char **argv) {
+    int threads = 0, opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1)
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo volumes [-j threads] file.gz.001\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    gz_volumes v;
+    if (vol_open(&v, name) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        return 1;
+    }
+
+    // If every volume after the first starts with a member header, the
+    // volumes may be whole members each and can be checked independently.
+    int aligned = 1;
+    for (int i = 1; i < v.n && aligned; i++) {
+        unsigned char head[CHUNK];
+        int fd = open(v.name[i], O_RDONLY);
+        size_t n = v.size[i] < sizeof(head) ? v.size[i] : sizeof(head);
+        aligned = fd >= 0 && pread_full(fd, head, n, 0) == 0 &&
+                  gz_header_plausible(head, n);
+        if (fd >= 0)
+            close(fd);
+    }
+    uint64_t members[v.n], out[v.n];
+    int ret[v.n];
+    memset(members, 0, sizeof(members));
+    memset(out, 0, sizeof(out));
+    if (aligned) {
+        struct vol_check c = {&v, members, ret, out};
+        pool_run(threads, v.n, vol_job, &c);
+        for (int i = 0; i < v.n; i++)
+            aligned &= ret[i] != Z_BUF_ERROR;
+    }
+
+    // Otherwise, or if a member ran past the end of its volume after all,
+    // read the set as one stream.
+    int serial = !aligned, err = 0;
+    if (serial) {
+        err = verify_gzip(name, NULL) != Z_OK;
+        for (int i = 0; i < v.n && i < volume_set.n; i++)
+            out[i] = volume_set.out[i];
+    }
+
+    printf("%-40s %14s %14s %8s%s\n", "volume", "compressed", "uncompressed",
+           "members", serial ? "" : " status");
+    uint64_t zin = 0, zout = 0, nmem = 0;
+    for (int i = 0; i < v.n; i++) {
+        char count[24] = "-";
+        if (!serial) {
+            snprintf(count, sizeof(count), "%llu", (unsigned long long)members[i]);
+            err |= ret[i] != Z_OK;
+        }
+        printf("%-40s %14llu %14llu %8s%s\n", v.name[i],
+               (unsigned long long)v.size[i], (unsigned long long)out[i], count,
+               serial ? "" : ret[i] == Z_OK ? " ok" : ret[i] == Z_ERRNO ?
+               " FAILED: read error" : " FAILED: corrupt data");
+        zin += v.size[i];
+        zout += out[i];
+        nmem += members[i];
+    }
+    printf("Volumes: %d, read %s\n", v.n, serial ?
+           "as one stream (boundaries split members)" :
+           "in parallel (boundaries fall between members)");
+    printf("Compressed Size: %s\n", humanSize(zin));
+    printf("Uncompressed Size: %s\n", humanSize(zout));
+    if (!serial)
+        printf("Number of GZIP Members: %llu\n", (unsigned long long)nmem);
+    printf("Status: %s\n", err ? "FAILED" : "ok");
+    vol_close(&v);
+    return err;
+}
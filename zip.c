@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "gzinfo.h"
+
+// ZIP and ZIP64 archive verification. The central directory is read from the
+// end of the archive, and every entry is then checked in parallel straight
+// from its local header: deflated entries through a raw inflate, stored ones
+// as is, both against the CRC-32 and sizes recorded in the directory.
+
+#define EOCD 0x06054b50UL       // end of central directory record
+#define EOCD64 0x06064b50UL     // ZIP64 end of central directory record
+#define LOC64 0x07064b50UL      // ZIP64 end of central directory locator
+#define CENTRAL 0x02014b50UL    // central directory file header
+#define LOCAL 0x04034b50UL      // local file header
+
+struct entry {
+    char *name;
+    int method, flags;
+    uint32_t crc;
+    uint64_t csize, usize, off;
+    uint64_t used, out;         // bytes checked
+    const char *err;            // why it failed, or NULL
+    int skipped;                // not checkable here
+};
+
+struct archive {
+    int fd;
+    uint64_t shift;             // bytes prepended to the archive, if any
+    struct entry *e;
+    size_t *order;              // jobs, largest entries first
+};
+
+static uint32_t get2(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint64_t get8(const unsigned char *p) {
+    return le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+static void zip_job(void *ctx, size_t i) {
+    struct archive *a = ctx;
+    struct entry *e = a->e + a->order[i];
+    if (e->skipped)
+        return;
+    unsigned char loc[30];
+    uint64_t at = a->shift + e->off;
+    if (pread_full(a->fd, loc, sizeof(loc), at) < 0 || le32(loc) != LOCAL) {
+        e->err = "bad local header";
+        return;
+    }
+    at += sizeof(loc) + get2(loc + 26) + get2(loc + 28);
+
+    uLong crc;
+    int ret = inflate_at(a->fd, e->method == 8 ? RAW : PLAIN, at, e->csize,
+                         &e->used, &e->out, &crc);
+    if (ret == Z_BUF_ERROR)
+        e->err = "truncated";
+    else if (ret == Z_ERRNO)
+        e->err = "read error";
+    else if (ret != Z_OK)
+        e->err = "corrupt data";
+    else if (e->used != e->csize)
+        e->err = "compressed size mismatch";
+    else if (e->out != e->usize)
+        e->err = "length mismatch";
+    else if (crc != e->crc)
+        e->err = "CRC mismatch";
+}
+
+// Find the central directory. Set *off, *size and *count and return the
+// offset of the end record that follows it, or -1 if this is not a ZIP
+// archive.
+static int64_t find_directory(int fd, uint64_t len, uint64_t *off,
+                              uint64_t *size, uint64_t *count) {
+    // The end record is 22 bytes plus a comment of up to 65535.
+    size_t tail = len < 22 + 65535 ? len : 22 + 65535;
+    unsigned char *buf = malloc(tail);
+    if (buf == NULL || tail < 22 || pread_full(fd, buf, tail, len - tail) < 0) {
+        free(buf);
+        return -1;
+    }
+    int64_t end = -1;
+    for (size_t i = tail - 22 + 1; i-- > 0;)
+        if (le32(buf + i) == EOCD && i + 22 + get2(buf + i + 20) <= tail) {
+            end = i;
+            break;
+        }
+    if (end < 0) {
+        free(buf);
+        return -1;
+    }
+    const unsigned char *p = buf + end;
+    *count = get2(p + 10);
+    *size = le32(p + 12);
+    *off = le32(p + 16);
+    end += len - tail;
+
+    // ZIP64 moves the counts and offsets to a record of its own, found
+    // through a locator just before the end record. The record is then what
+    // follows the directory. If data was prepended, the locator's offset is
+    // off by that much, but the record normally sits right before it.
+    unsigned char loc[20], rec[56];
+    if (end >= 20 + 56 && pread_full(fd, loc, 20, end - 20) == 0 &&
+        le32(loc) == LOC64) {
+        uint64_t at = get8(loc + 8);
+        if (pread_full(fd, rec, 56, at) < 0 || le32(rec) != EOCD64)
+            at = end - 20 - 56;
+        if (pread_full(fd, rec, 56, at) == 0 && le32(rec) == EOCD64) {
+            *count = get8(rec + 32);
+            *size = get8(rec + 40);
+            *off = get8(rec + 48);
+            end = at;
+        }
+    }
+    free(buf);
+    return end;
+}
+
+int cmd_zip(int argc, char **argv) {
+    int threads = 0, quiet = 0, opt;
+    while ((opt = getopt(argc, argv, "qj:")) != -1)
+        switch (opt) {
+        case 'q':
+            quiet = 1;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    if (argc - optind != 1) {
+        fprintf(stderr, "usage: gzinfo zip [-q] [-j threads] file\n");
+        return 1;
+    }
+    char *name = argv[optind];
+    int fd = open(name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "gzinfo: could not open %s for reading\n", name);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    uint64_t cdoff, cdsize, count;
+    int64_t end = find_directory(fd, st.st_size, &cdoff, &cdsize, &count);
+    if (end < 0) {
+        printf("%s is not a ZIP archive\n", name);
+        close(fd);
+        return 1;
+    }
+    // Data prepended to the archive (a self-extractor stub, say) shifts all
+    // of the recorded offsets. It shows as a gap before the end record.
+    struct archive a = {fd, 0, NULL, NULL};
+    if (cdoff + cdsize <= (uint64_t)end)
+        a.shift = end - (cdoff + cdsize);
+    unsigned char *cd = malloc(cdsize + 1);
+    a.e = calloc(count ? count : 1, sizeof(struct entry));
+    a.order = malloc((count ? count : 1) * sizeof(size_t));
+    if (cd == NULL || a.e == NULL || a.order == NULL ||
+        pread_full(fd, cd, cdsize, a.shift + cdoff) < 0) {
+        fprintf(stderr, "gzinfo: could not read the central directory of %s\n",
+                name);
+        free(cd);
+        free(a.e);
+        free(a.order);
+        close(fd);
+        return 1;
+    }
+
+    // Parse the central directory.
+    size_t n = 0, at = 0;
+    while (n < count && at + 46 <= cdsize && le32(cd + at) == CENTRAL) {
+        const unsigned char *p = cd + at;
+        unsigned nlen = get2(p + 28), xlen = get2(p + 30), clen = get2(p + 32);
+        if (at + 46 + nlen + xlen + clen > cdsize)
+            break;
+        struct entry *e = a.e + n;
+        e->flags = get2(p + 8);
+        e->method = get2(p + 10);
+        e->crc = le32(p + 16);
+        e->csize = le32(p + 20);
+        e->usize = le32(p + 24);
+        e->off = le32(p + 42);
+
+        // The ZIP64 extra field holds, in order, those of the sizes and
+        // offset that did not fit.
+        const unsigned char *x = p + 46 + nlen, *xend = x + xlen;
+        while (x + 4 <= xend) {
+            unsigned id = get2(x), size = get2(x + 2);
+            const unsigned char *v = x + 4, *vend = v + size;
+            if (vend > xend)
+                break;
+            if (id == 1) {
+                if (e->usize == 0xffffffff && v + 8 <= vend)
+                    e->usize = get8(v), v += 8;
+                if (e->csize == 0xffffffff && v + 8 <= vend)
+                    e->csize = get8(v), v += 8;
+                if (e->off == 0xffffffff && v + 8 <= vend)
+                    e->off = get8(v);
+            }
+            x = vend;
+        }
+
+        e->name = malloc(nlen + 1);
+        if (e->name != NULL) {
+            memcpy(e->name, p + 46, nlen);
+            e->name[nlen] = 0;
+        }
+        e->skipped = (e->flags & 1) || (e->method != 0 && e->method != 8);
+        at += 46 + nlen + xlen + clen;
+        n++;
+    }
+    free(cd);
+    int bad = n < count;
+    if (bad)
+        printf("Central directory damaged: %zu of %llu entries readable\n", n,
+               (unsigned long long)count);
+
+    // Hand out the largest entries first, so that one big entry doesn't
+    // start last and leave the other threads idle.
+    for (size_t i = 0; i < n; i++)
+        a.order[i] = i;
+    for (size_t i = 1; i < n; i++) {
+        size_t k = a.order[i], j = i;
+        for (; j > 0 && a.e[a.order[j - 1]].csize < a.e[k].csize; j--)
+            a.order[j] = a.order[j - 1];
+        a.order[j] = k;
+    }
+    pool_run(threads, n, zip_job, &a);
+    close(fd);
+
+    uint64_t zin = 0, zout = 0;
+    long failed = 0, skipped = 0, deflated = 0, stored = 0;
+    if (!quiet)
+        printf("%-14s %-14s %-7s %-10s %s\n", "compressed", "uncompressed",
+               "ratio", "status", "name");
+    for (size_t i = 0; i < n; i++) {
+        struct entry *e = a.e + i;
+        const char *name = e->name != NULL ? e->name : "?";
+        if (e->skipped) {
+            skipped++;
+            if (!quiet)
+                printf("%-14llu %-14llu %-7s %-10s %s (%s)\n",
+                       (unsigned long long)e->csize,
+                       (unsigned long long)e->usize, "-", "skipped", name,
+                       e->flags & 1 ? "encrypted" : "unsupported method");
+        }
+        else if (e->err != NULL) {
+            failed++;
+            printf("%-14llu %-14llu %-7s %-10s %s: %s\n",
+                   (unsigned long long)e->csize, (unsigned long long)e->usize,
+                   "-", "FAILED", name, e->err);
+        }
+        else {
+            zin += e->csize;
+            zout += e->usize;
+            if (e->method == 8)
+                deflated++;
+            else
+                stored++;
+            if (!quiet)
+                printf("%-14llu %-14llu %-7.3f %-10s %s\n",
+                       (unsigned long long)e->csize,
+                       (unsigned long long)e->usize,
+                       e->csize ? (double)e->usize / e->csize : 0.0, "ok", name);
+        }
+        free(e->name);
+    }
+
+    printf("Entries: %zu (%ld deflated, %ld stored, %ld skipped, %ld failed)\n",
+           n, deflated, stored, skipped, failed);
+    printf("Compressed Size: %s\n", humanSize(zin));
+    printf("Uncompressed Size: %s\n", humanSize(zout));
+    if (zin)
+        printf("Ratio: %.3f\n", (double)zout / zin);
+    free(a.e);
+    free(a.order);
+    return failed || bad ? 1 : 0;
+}